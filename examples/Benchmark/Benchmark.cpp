@@ -0,0 +1,875 @@
+/**
+ * LoFS benchmark for Portduino builds
+ *
+ * Mounts two simulated devices over host directories (LittleFS-like flash at
+ * /simflash/, FAT-over-SPI-like SD at /simsd/) and reports ops/s and p50/p99
+ * latency for common operations, with heap allocations per operation (glibc
+ * hosts) and, when built with LOFS_STATS=1, lock acquisitions, hold and wait
+ * time per operation. The same operations on the RAM disk (/ram/) show
+ * LoFS's own overhead with no device time at all. Compression ratio and
+ * codec throughput of the /z/-style compressed mount are measured on
+ * generated log and JSON data, also over the RAM disk. Path routing is timed
+ * against LOFS_DIRECT handles and LoFS::Path objects on /internal/. The
+ * CRC32 kernel is timed on its own and as part of a verified flash-to-SD
+ * copy, and that copy's throughput for buffer sizes from 512 B to 8 KB. SD
+ * log appends with a flush per record are timed on a growing file and on one
+ * with space reserved by LoFS::reserve(). Loading 100 small assets is
+ * compared between separate files and one LoFS::Bundle, and a node table
+ * kept as one file per node against a LoFS::KV store. Threads hammering
+ * /internal/ and /sd/ alone and at the same time show how far the two
+ * filesystems block each other (real host locks, as LoFS uses on Portduino).
+ * Call lofsBenchmark(Serial) once the filesystem is up, e.g. from setup() in
+ * a test firmware. Compare runs before and after a change; absolute numbers
+ * only reflect the latency profiles.
+ */
+
+#include <lofs/LoFS.h>
+#include <lofs/RamBackend.h>
+#include <lofs/SimBackend.h>
+#include <lofs/Bundle.h>
+#include <lofs/CompressedBackend.h>
+#include <lofs/Direct.h>
+#include <lofs/KV.h>
+#include <lofs/Path.h>
+#include <lofs/LockDomain.h>
+#include <lofs/ReservedFile.h>
+#include <lofs/Stats.h>
+#include "configuration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(ARCH_PORTDUINO) && defined(__GLIBC__)
+#include <atomic>
+#endif
+#ifdef ARCH_PORTDUINO
+#include <thread>
+#endif
+
+#define BENCH_ROOT "/internal/lofs-bench"
+#define BENCH_MAX_SAMPLES 256
+#define BENCH_COMPRESS_BYTES 65536
+#define BENCH_ASSETS 100
+#define BENCH_ASSET_SLOT 64
+#define BENCH_NODES 200
+#define BENCH_NODE_BYTES 64
+#define BENCH_DISPATCH_CALLS 10000
+#define BENCH_COPY_BYTES (128 * 1024)
+#define BENCH_THREADS 2 // Per filesystem in the contention runs
+#define BENCH_THREAD_OPS 200
+
+static LoFS::SimBackend simFlash(BENCH_ROOT "/flash", LoFS::SimBackend::Profile::littleFS());
+static LoFS::SimBackend simSD(BENCH_ROOT "/sd", LoFS::SimBackend::Profile::fatSPI());
+
+static uint32_t samples[BENCH_MAX_SAMPLES];
+static size_t sampleCount;
+static uint32_t sampleStartUs;
+
+#if defined(ARCH_PORTDUINO) && defined(__GLIBC__)
+// glibc lets a program replace malloc and friends; strdup() and operator new
+// inside LoFS and the libraries then come through here too
+#define BENCH_COUNT_ALLOCS 1
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static std::atomic<uint32_t> benchAllocs(0);
+
+extern "C" void *malloc(size_t size)
+{
+    benchAllocs++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    benchAllocs++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    benchAllocs++;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+#else
+#define BENCH_COUNT_ALLOCS 0
+static uint32_t benchAllocs = 0;
+#endif
+
+// Per-op allocations and lock time, counted between startOp() and endOp() only
+static const LoFS::LockDomain *benchDomains[2];
+static uint32_t opAllocs;
+static uint32_t startAllocs;
+static LoFS::Stats::LockCounters opLock;
+static LoFS::Stats::LockCounters startLock;
+
+static LoFS::Stats::LockCounters lockTotals()
+{
+    LoFS::Stats::LockCounters sum = {};
+    for (const LoFS::LockDomain *domain : benchDomains) {
+        if (domain) {
+            sum.acquisitions += domain->lockCounters().acquisitions;
+            sum.waitUs += domain->lockCounters().waitUs;
+            sum.holdUs += domain->lockCounters().holdUs;
+        }
+    }
+    return sum;
+}
+
+static const LoFS::LockDomain *domainOf(const char *path)
+{
+    char stripped[64];
+    LoFS::Backend *backend = path ? LoFS::resolve(path, stripped, sizeof(stripped)) : nullptr;
+    return backend ? &backend->lockDomain() : nullptr;
+}
+
+/**
+ * @brief Start a series of samples
+ * @param path, path2 Paths whose lock domains the series uses (one domain is counted once)
+ */
+static void begin(const char *path = nullptr, const char *path2 = nullptr)
+{
+    sampleCount = 0;
+    opAllocs = 0;
+    memset(&opLock, 0, sizeof(opLock));
+    benchDomains[0] = domainOf(path);
+    benchDomains[1] = domainOf(path2);
+    if (benchDomains[1] == benchDomains[0]) {
+        benchDomains[1] = nullptr;
+    }
+}
+
+static void startOp()
+{
+    startAllocs = benchAllocs;
+    startLock = lockTotals();
+    sampleStartUs = micros();
+}
+
+static void endOp()
+{
+    uint32_t elapsed = micros() - sampleStartUs;
+    opAllocs += benchAllocs - startAllocs;
+    LoFS::Stats::LockCounters now = lockTotals();
+    opLock.acquisitions += now.acquisitions - startLock.acquisitions;
+    opLock.waitUs += now.waitUs - startLock.waitUs;
+    opLock.holdUs += now.holdUs - startLock.holdUs;
+    if (sampleCount < BENCH_MAX_SAMPLES) {
+        samples[sampleCount++] = elapsed;
+    }
+}
+
+static int compareSamples(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(Print &out, const char *name)
+{
+    if (sampleCount == 0) {
+        return;
+    }
+    uint64_t total = 0;
+    for (size_t i = 0; i < sampleCount; i++) {
+        total += samples[i];
+    }
+    qsort(samples, sampleCount, sizeof(samples[0]), compareSamples);
+    uint32_t p50 = samples[sampleCount / 2];
+    uint32_t p99 = samples[(sampleCount * 99) / 100 < sampleCount ? (sampleCount * 99) / 100 : sampleCount - 1];
+
+    char line[192];
+    int n = snprintf(line, sizeof(line), "%-28s %6u ops %9.1f ops/s  p50 %7lu us  p99 %7lu us", name,
+                     (unsigned)sampleCount, total ? sampleCount * 1e6 / total : 0.0, (unsigned long)p50,
+                     (unsigned long)p99);
+#if BENCH_COUNT_ALLOCS
+    n += snprintf(line + n, sizeof(line) - n, "  %5.1f allocs/op", (double)opAllocs / sampleCount);
+#endif
+#if LOFS_STATS
+    // Shared readers (exists, open "r" on shared domains) are not timed, only exclusive holds
+    if (opLock.acquisitions > 0) {
+        snprintf(line + n, sizeof(line) - n, "  lock %.1f/op hold %.1f us/op wait %.1f us/op",
+                 (double)opLock.acquisitions / sampleCount, (double)opLock.holdUs / sampleCount,
+                 (double)opLock.waitUs / sampleCount);
+    }
+#endif
+    (void)n;
+    out.println(line);
+}
+
+static bool writeFile(const char *path, size_t size)
+{
+    static uint8_t chunk[512];
+    LoFS::remove(path);
+    File f = LoFS::open(path, "w");
+    if (!f) {
+        return false;
+    }
+    while (size > 0) {
+        size_t n = size < sizeof(chunk) ? size : sizeof(chunk);
+        f.write(chunk, n);
+        size -= n;
+    }
+    f.close();
+    return true;
+}
+
+static void benchDevice(Print &out, const char *prefix, const char *label)
+{
+    char path[64];
+    char other[64];
+    char name[48];
+
+    snprintf(path, sizeof(path), "%sfile.bin", prefix);
+    writeFile(path, 1024);
+
+    begin(prefix);
+    for (int i = 0; i < 100; i++) {
+        startOp();
+        File f = LoFS::open(path, "r");
+        f.close();
+        endOp();
+    }
+    snprintf(name, sizeof(name), "%s open+close", label);
+    report(out, name);
+
+    begin(prefix);
+    for (int i = 0; i < 200; i++) {
+        startOp();
+        LoFS::exists(path);
+        endOp();
+    }
+    snprintf(name, sizeof(name), "%s exists (hit)", label);
+    report(out, name);
+
+    snprintf(other, sizeof(other), "%smissing.bin", prefix);
+    begin(prefix);
+    for (int i = 0; i < 200; i++) {
+        startOp();
+        LoFS::exists(other);
+        endOp();
+    }
+    snprintf(name, sizeof(name), "%s exists (miss)", label);
+    report(out, name);
+
+    snprintf(other, sizeof(other), "%sfile2.bin", prefix);
+    begin(prefix);
+    for (int i = 0; i < 50; i++) {
+        startOp();
+        LoFS::rename(path, other);
+        endOp();
+        startOp();
+        LoFS::rename(other, path);
+        endOp();
+    }
+    snprintf(name, sizeof(name), "%s rename (same FS)", label);
+    report(out, name);
+
+    begin(prefix);
+    for (int i = 0; i < 100; i++) {
+        startOp();
+        LoFS::freeBytes(prefix);
+        endOp();
+    }
+    snprintf(name, sizeof(name), "%s freeBytes", label);
+    report(out, name);
+
+    static const int fanouts[] = {8, 64};
+    for (int fanout : fanouts) {
+        begin(prefix);
+        for (int round = 0; round < 3; round++) {
+            snprintf(other, sizeof(other), "%stree", prefix);
+            LoFS::mkdir(other);
+            for (int i = 0; i < fanout; i++) {
+                snprintf(path, sizeof(path), "%stree/f%d", prefix, i);
+                writeFile(path, 64);
+            }
+            startOp();
+            LoFS::rmdir(other, true);
+            endOp();
+        }
+        snprintf(name, sizeof(name), "%s rmdir -r (%d files)", label, fanout);
+        report(out, name);
+    }
+}
+
+#if LOFS_COMPRESS && LOFS_RAMDISK && LOFS_RAM_BYTES > 0
+static LoFS::CompressedBackend ramZ("/ram/z");
+
+// Representative content: node log lines (kind 0) or a JSON config (kind 1)
+static int sampleLine(char *line, size_t size, int kind, int i)
+{
+    if (kind == 0) {
+        return snprintf(line, size, "%02d:%02d:%02d [Router] Received text msg from=0x%08x id=0x%08x rssi=-%d snr=%d.%d hops=%d\n",
+                        (i / 3600) % 24, (i / 60) % 60, i % 60, 0x4a2b1c00u + (i % 5) * 0x11, 0x7f000000u + i * 37,
+                        70 + (i * 7) % 40, (i * 3) % 12, i % 10, i % 4);
+    }
+    return snprintf(line, size,
+                    "{\"index\": %d, \"name\": \"Channel%d\", \"psk\": \"AQ==\", \"uplinkEnabled\": %s, "
+                    "\"downlinkEnabled\": false, \"positionPrecision\": %d},\n",
+                    i % 8, i % 8, (i & 1) ? "true" : "false", 10 + i % 22);
+}
+
+// Write BENCH_COMPRESS_BYTES of sample data; returns elapsed us
+static uint32_t writeSample(const char *path, int kind)
+{
+    char line[160];
+    uint32_t startUs = micros();
+    File f = LoFS::open(path, "w");
+    size_t written = 0;
+    for (int i = 0; f && written < BENCH_COMPRESS_BYTES; i++) {
+        int n = sampleLine(line, sizeof(line), kind, i);
+        if (n > (int)(BENCH_COMPRESS_BYTES - written)) {
+            n = BENCH_COMPRESS_BYTES - written;
+        }
+        written += f.write((const uint8_t *)line, n);
+    }
+    f.close();
+    return micros() - startUs;
+}
+
+static uint32_t readSample(const char *path)
+{
+    static uint8_t chunk[512];
+    uint32_t startUs = micros();
+    File f = LoFS::open(path, "r");
+    while (f && f.read(chunk, sizeof(chunk)) > 0) {
+    }
+    f.close();
+    return micros() - startUs;
+}
+
+static double kbPerSec(uint32_t us)
+{
+    return BENCH_COMPRESS_BYTES * 1e6 / 1024 / (us ? us : 1);
+}
+
+static void benchCompression(Print &out)
+{
+    static const char *const kinds[] = {"log", "json"};
+    if (!LoFS::mount("/ramz/", &ramZ)) {
+        return;
+    }
+    for (int kind = 0; kind < 2; kind++) {
+        uint32_t plainWriteUs = writeSample("/ram/plain.bin", kind);
+        uint32_t plainReadUs = readSample("/ram/plain.bin");
+        uint32_t zWriteUs = writeSample("/ramz/sample.bin", kind);
+        uint32_t zReadUs = readSample("/ramz/sample.bin");
+        File stored = LoFS::open("/ram/z/sample.bin", "r");
+        size_t storedBytes = stored.size();
+        stored.close();
+
+        char line[160];
+        snprintf(line, sizeof(line), "compress %-4s %u -> %u B (%.1f%%)  write %.0f KB/s (plain %.0f)  read %.0f KB/s (plain %.0f)",
+                 kinds[kind], (unsigned)BENCH_COMPRESS_BYTES, (unsigned)storedBytes,
+                 100.0 * storedBytes / BENCH_COMPRESS_BYTES, kbPerSec(zWriteUs), kbPerSec(plainWriteUs),
+                 kbPerSec(zReadUs), kbPerSec(plainReadUs));
+        out.println(line);
+    }
+    LoFS::unmount("/ramz/");
+    LoFS::remove("/ram/plain.bin");
+    LoFS::rmdir("/ram/z", true);
+}
+#endif
+
+// Routing cost on its own: the same calls by runtime path and through a LOFS_DIRECT handle
+static void benchDispatch(Print &out)
+{
+    static constexpr auto direct = LOFS_DIRECT(BENCH_ROOT "/direct.bin");
+    LoFS::Path path(BENCH_ROOT "/direct.bin");
+    writeFile(BENCH_ROOT "/direct.bin", 16);
+    LoFS::exists(BENCH_ROOT "/direct.bin"); // Cached from here on: exists() is nearly all dispatch
+
+    uint32_t startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        LoFS::exists(BENCH_ROOT "/direct.bin");
+    }
+    uint32_t pathExistsUs = micros() - startUs;
+    startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        direct.exists();
+    }
+    uint32_t directExistsUs = micros() - startUs;
+    startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        LoFS::exists(path);
+    }
+    uint32_t resolvedExistsUs = micros() - startUs;
+
+    startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        File f = LoFS::open(BENCH_ROOT "/direct.bin", "r");
+        f.close();
+    }
+    uint32_t pathOpenUs = micros() - startUs;
+    startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        File f = direct.open("r");
+        f.close();
+    }
+    uint32_t directOpenUs = micros() - startUs;
+    startUs = micros();
+    for (int i = 0; i < BENCH_DISPATCH_CALLS; i++) {
+        File f = LoFS::open(path, "r");
+        f.close();
+    }
+    uint32_t resolvedOpenUs = micros() - startUs;
+    LoFS::remove(BENCH_ROOT "/direct.bin");
+
+    char line[128];
+    snprintf(line, sizeof(line), "exists (cached) by path %.2f us, direct %.2f us, LoFS::Path %.2f us",
+             (double)pathExistsUs / BENCH_DISPATCH_CALLS, (double)directExistsUs / BENCH_DISPATCH_CALLS,
+             (double)resolvedExistsUs / BENCH_DISPATCH_CALLS);
+    out.println(line);
+    snprintf(line, sizeof(line), "open+close by path %.2f us, direct %.2f us, LoFS::Path %.2f us",
+             (double)pathOpenUs / BENCH_DISPATCH_CALLS, (double)directOpenUs / BENCH_DISPATCH_CALLS,
+             (double)resolvedOpenUs / BENCH_DISPATCH_CALLS);
+    out.println(line);
+}
+
+static void benchChecksum(Print &out)
+{
+    static uint8_t data[4096];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 131 + (i >> 5));
+    }
+    uint32_t crc = 0;
+    uint32_t startUs = micros();
+    for (int i = 0; i < 256; i++) {
+        crc = LoFS::crc32(data, sizeof(data), crc);
+    }
+    uint32_t crcUs = micros() - startUs;
+
+    // The same copy with and without reading the destination back
+    writeFile("/simflash/crc.bin", 65536);
+    LoFS::CopyOptions options;
+    startUs = micros();
+    LoFS::copy("/simflash/crc.bin", "/simsd/crc.bin", options);
+    uint32_t plainUs = micros() - startUs;
+    options.verify = true;
+    startUs = micros();
+    bool ok = LoFS::copy("/simflash/crc.bin", "/simsd/crc.bin", options);
+    uint32_t verifiedUs = micros() - startUs;
+    LoFS::remove("/simflash/crc.bin");
+    LoFS::remove("/simsd/crc.bin");
+
+    char line[128];
+    snprintf(line, sizeof(line), "crc32 %.0f KB/s (crc %08lx)", sizeof(data) * 256 * 1e6 / 1024 / (crcUs ? crcUs : 1),
+             (unsigned long)crc);
+    out.println(line);
+    snprintf(line, sizeof(line), "copy flash->sd 64 KB: %lu us, verified %lu us (%+.0f%%)%s", (unsigned long)plainUs,
+             (unsigned long)verifiedUs, plainUs ? 100.0 * ((double)verifiedUs - plainUs) / plainUs : 0.0,
+             ok ? "" : " MISMATCH");
+    out.println(line);
+}
+
+// Cross-filesystem copy throughput for each CopyOptions::bufferSize
+static void benchCopyBuffers(Print &out)
+{
+    static const size_t bufferSizes[] = {512, 1024, 2048, 4096, 8192};
+    writeFile("/simflash/copy.bin", BENCH_COPY_BYTES);
+    for (size_t bufferSize : bufferSizes) {
+        LoFS::CopyOptions options;
+        options.bufferSize = bufferSize;
+        options.verify = false;
+        uint32_t chunks = 0;
+        bool ok = true;
+        begin("/simflash/", "/simsd/");
+        for (int i = 0; i < 3; i++) {
+            LoFS::CopyStats stats;
+            startOp();
+            ok = LoFS::copy("/simflash/copy.bin", "/simsd/copy.bin", options, &stats) && ok;
+            endOp();
+            chunks += stats.chunks;
+        }
+        uint64_t totalUs = 0;
+        for (size_t i = 0; i < sampleCount; i++) {
+            totalUs += samples[i];
+        }
+
+        char line[96];
+        snprintf(line, sizeof(line), "copy flash->sd buf %u B", (unsigned)bufferSize);
+        report(out, line);
+        snprintf(line, sizeof(line), "  %.0f KB/s, %lu chunks per copy%s",
+                 totalUs ? BENCH_COPY_BYTES * sampleCount * 1e6 / 1024 / totalUs : 0.0,
+                 (unsigned long)(chunks / sampleCount), ok ? "" : " FAILED");
+        out.println(line);
+    }
+    LoFS::remove("/simflash/copy.bin");
+    LoFS::remove("/simsd/copy.bin");
+}
+
+// Flushed log records on SD: every flush of a growing file updates the FAT
+static void benchReserve(Print &out)
+{
+    static const char record[] = "2024-05-01T12:00:00Z,47.60620,-122.33210,56.2,7\n";
+    const size_t len = sizeof(record) - 1;
+
+    LoFS::remove("/simsd/plain.csv");
+    File plain = LoFS::open("/simsd/plain.csv", "a");
+    begin("/simsd/");
+    for (int i = 0; i < 200; i++) {
+        startOp();
+        plain.write((const uint8_t *)record, len);
+        plain.flush();
+        endOp();
+    }
+    plain.close();
+    report(out, "sd append+flush (growing)");
+
+    LoFS::remove("/simsd/reserved.csv");
+    begin("/simsd/");
+    startOp();
+    LoFS::ReservedFile reserved = LoFS::reserve("/simsd/reserved.csv", 16 * 1024);
+    endOp();
+    report(out, "sd reserve (16 KB)");
+    begin("/simsd/");
+    for (int i = 0; i < 200; i++) {
+        startOp();
+        reserved.write((const uint8_t *)record, len);
+        reserved.sync();
+        endOp();
+    }
+    report(out, "sd append+flush (reserved)");
+    begin("/simsd/");
+    startOp();
+    reserved.close();
+    endOp();
+    report(out, "sd reserved close (trim)");
+
+    LoFS::remove("/simsd/plain.csv");
+    LoFS::remove("/simsd/reserved.csv");
+}
+
+static int assetBody(char *body, int i)
+{
+    return snprintf(body, BENCH_ASSET_SLOT, "{\"index\":%d,\"name\":\"asset %d\",\"hops\":3}", i, i);
+}
+
+// The same assets as separate files and as a bundle laid out like tools/lofs-pack.py output
+static void writeAssets()
+{
+    char path[64];
+    char body[BENCH_ASSET_SLOT];
+    LoFS::mkdir("/simflash/assets");
+    for (int i = 0; i < BENCH_ASSETS; i++) {
+        snprintf(path, sizeof(path), "/simflash/assets/a%03d.json", i);
+        File f = LoFS::open(path, "w");
+        f.write((const uint8_t *)body, assetBody(body, i));
+        f.close();
+    }
+
+    const uint32_t nameLen = 10; // "a000.json" + NUL
+    const uint32_t dataStart = 16 + 16 * BENCH_ASSETS + nameLen * BENCH_ASSETS;
+    uint8_t word[16] = {'L', 'o', 'F', 'B', 1, 0, 0, 0};
+    File f = LoFS::open("/simflash/assets.lfb", "w");
+    uint32_t header[2] = {BENCH_ASSETS, nameLen * BENCH_ASSETS}; // Little-endian hosts
+    memcpy(word + 8, header, sizeof(header));
+    f.write(word, 16);
+    for (int i = 0; i < BENCH_ASSETS; i++) {
+        int len = assetBody(body, i);
+        uint32_t entry[4] = {nameLen * i, dataStart + BENCH_ASSET_SLOT * i, (uint32_t)len, LoFS::crc32(body, len)};
+        f.write((const uint8_t *)entry, sizeof(entry));
+    }
+    for (int i = 0; i < BENCH_ASSETS; i++) {
+        char name[nameLen] = {0};
+        snprintf(name, sizeof(name), "a%03d.json", i);
+        f.write((const uint8_t *)name, nameLen);
+    }
+    for (int i = 0; i < BENCH_ASSETS; i++) {
+        memset(body, 0, sizeof(body));
+        assetBody(body, i);
+        f.write((const uint8_t *)body, BENCH_ASSET_SLOT);
+    }
+    f.close();
+}
+
+static void benchBundle(Print &out)
+{
+    char path[64];
+    char body[BENCH_ASSET_SLOT];
+    writeAssets();
+
+    begin("/simflash/");
+    for (int round = 0; round < 5; round++) {
+        startOp();
+        for (int i = 0; i < BENCH_ASSETS; i++) {
+            snprintf(path, sizeof(path), "/simflash/assets/a%03d.json", i);
+            File f = LoFS::open(path, "r");
+            f.read((uint8_t *)body, sizeof(body));
+            f.close();
+        }
+        endOp();
+    }
+    report(out, "flash 100 assets (files)");
+
+    begin("/simflash/");
+    for (int round = 0; round < 5; round++) {
+        startOp();
+        LoFS::Bundle bundle;
+        bundle.begin("/simflash/assets.lfb");
+        for (int i = 0; i < BENCH_ASSETS; i++) {
+            snprintf(path, sizeof(path), "a%03d.json", i);
+            int index = bundle.find(path);
+            bundle.read(index, 0, body, bundle.size(index));
+        }
+        bundle.end();
+        endOp();
+    }
+    report(out, "flash 100 assets (bundle)");
+
+    LoFS::rmdir("/simflash/assets", true);
+    LoFS::remove("/simflash/assets.lfb");
+}
+
+// A node table updated in place: one small file per node vs. one KV store
+static void benchKV(Print &out)
+{
+    char path[64];
+    uint8_t node[BENCH_NODE_BYTES];
+    memset(node, 0x5a, sizeof(node));
+
+    LoFS::mkdir("/simflash/nodes");
+    begin("/simflash/");
+    for (uint32_t i = 0; i < BENCH_NODES; i++) {
+        snprintf(path, sizeof(path), "/simflash/nodes/%08lx.bin", (unsigned long)i);
+        startOp();
+        LoFS::writeAtomic(path, node, sizeof(node));
+        endOp();
+    }
+    report(out, "flash node update (files)");
+    LoFS::rmdir("/simflash/nodes", true);
+
+    LoFS::KV::Options options;
+    options.segmentBytes = 8 * 1024;
+    {
+        LoFS::KV kv("/simflash/kv", options);
+        kv.begin();
+        begin("/simflash/");
+        for (int round = 0; round < 4; round++) {
+            for (uint32_t i = 0; i < BENCH_NODES; i++) {
+                node[0] = (uint8_t)round;
+                startOp();
+                kv.put(&i, sizeof(i), node, sizeof(node));
+                kv.sync();
+                endOp();
+            }
+        }
+        report(out, "flash node update (KV+sync)");
+
+        begin("/simflash/");
+        for (uint32_t i = 0; i < BENCH_NODES; i++) {
+            startOp();
+            kv.get(&i, sizeof(i), node, sizeof(node));
+            endOp();
+        }
+        report(out, "flash node read (KV)");
+        kv.compact();
+    }
+
+    // Boot: sealed segments come back from their hint files, only the active one is read
+    begin("/simflash/");
+    for (int round = 0; round < 5; round++) {
+        LoFS::KV kv("/simflash/kv", options);
+        startOp();
+        kv.begin();
+        endOp();
+    }
+    report(out, "flash KV begin");
+
+    LoFS::rmdir("/simflash/kv", true);
+}
+
+#ifdef ARCH_PORTDUINO
+struct ContentionWorker {
+    std::thread thread;
+    char path[64];
+    uint32_t ops;
+    uint32_t elapsedUs;
+    uint64_t totalUs;
+    uint32_t maxUs;
+};
+
+// Write, read back and stat the worker's own file, BENCH_THREAD_OPS times
+static void contentionLoop(ContentionWorker *w)
+{
+    uint8_t buf[256];
+    memset(buf, 0xa5, sizeof(buf));
+    uint32_t startUs = micros();
+    for (int i = 0; i < BENCH_THREAD_OPS; i++) {
+        uint32_t opStartUs = micros();
+        File f = LoFS::open(w->path, "w");
+        f.write(buf, sizeof(buf));
+        f.close();
+        f = LoFS::open(w->path, "r");
+        f.read(buf, sizeof(buf));
+        f.close();
+        LoFS::exists(w->path);
+        uint32_t us = micros() - opStartUs;
+        w->totalUs += us;
+        if (us > w->maxUs) {
+            w->maxUs = us;
+        }
+        w->ops++;
+    }
+    w->elapsedUs = micros() - startUs;
+    LoFS::remove(w->path);
+}
+
+static void reportContention(Print &out, const char *name, const ContentionWorker *workers, size_t count,
+                             const LoFS::LockDomain *domain, const LoFS::Stats::LockCounters &before)
+{
+    uint32_t ops = 0;
+    uint32_t wallUs = 0;
+    uint64_t totalUs = 0;
+    uint32_t maxUs = 0;
+    for (size_t i = 0; i < count; i++) {
+        ops += workers[i].ops;
+        totalUs += workers[i].totalUs;
+        wallUs = workers[i].elapsedUs > wallUs ? workers[i].elapsedUs : wallUs;
+        maxUs = workers[i].maxUs > maxUs ? workers[i].maxUs : maxUs;
+    }
+    if (ops == 0) {
+        return;
+    }
+    char line[160];
+    int n = snprintf(line, sizeof(line), "%-28s %6u ops %9.1f ops/s  mean %6.0f us  max %7lu us", name, (unsigned)ops,
+                     wallUs ? ops * 1e6 / wallUs : 0.0, (double)totalUs / ops, (unsigned long)maxUs);
+#if LOFS_STATS
+    // Other threads on the same domain are included: for a shared domain both groups show the sum
+    if (domain) {
+        const LoFS::Stats::LockCounters &now = domain->lockCounters();
+        snprintf(line + n, sizeof(line) - n, "  lock wait %.1f us/op, %lu contended",
+                 (double)(now.waitUs - before.waitUs) / ops, (unsigned long)(now.contended - before.contended));
+    }
+#endif
+    (void)n;
+    out.println(line);
+}
+
+/**
+ * @brief BENCH_THREADS threads per filesystem hammering /internal/ and/or /sd/ at once
+ *
+ * With per-backend lock domains, internal flash keeps its throughput while
+ * SD is busy; with both on spiLock the "with" runs drop to a shared rate.
+ */
+static void runContention(Print &out, bool internal, bool sd)
+{
+    ContentionWorker workers[2 * BENCH_THREADS];
+    size_t count = 0;
+    for (int fs = 0; fs < 2; fs++) {
+        if ((fs == 0 && !internal) || (fs == 1 && !sd)) {
+            continue;
+        }
+        for (int i = 0; i < BENCH_THREADS; i++) {
+            ContentionWorker &w = workers[count++];
+            snprintf(w.path, sizeof(w.path), fs == 0 ? BENCH_ROOT "/thread%d.bin" : "/sd/lofs-bench-thread%d.bin", i);
+            w.ops = 0;
+            w.elapsedUs = 0;
+            w.totalUs = 0;
+            w.maxUs = 0;
+        }
+    }
+
+    const LoFS::LockDomain *internalDomain = domainOf(BENCH_ROOT);
+    const LoFS::LockDomain *sdDomain = domainOf("/sd/");
+    LoFS::Stats::LockCounters internalBefore = {};
+    LoFS::Stats::LockCounters sdBefore = {};
+    if (internalDomain) {
+        internalBefore = internalDomain->lockCounters();
+    }
+    if (sdDomain) {
+        sdBefore = sdDomain->lockCounters();
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers[i].thread = std::thread(contentionLoop, &workers[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        workers[i].thread.join();
+    }
+
+    char name[48];
+    if (internal) {
+        snprintf(name, sizeof(name), "internal x%d %s", BENCH_THREADS, sd ? "(sd busy)" : "(alone)");
+        reportContention(out, name, workers, BENCH_THREADS, internalDomain, internalBefore);
+    }
+    if (sd) {
+        snprintf(name, sizeof(name), "sd x%d %s", BENCH_THREADS, internal ? "(internal busy)" : "(alone)");
+        reportContention(out, name, workers + (internal ? BENCH_THREADS : 0), BENCH_THREADS, sdDomain, sdBefore);
+    }
+}
+
+static void benchContention(Print &out)
+{
+    runContention(out, true, false);
+    if (!LoFS::isSDCardAvailable()) {
+        out.println("contention: no SD card, /sd/ runs skipped");
+        return;
+    }
+    runContention(out, false, true);
+    runContention(out, true, true);
+}
+#endif
+
+void lofsBenchmark(Print &out)
+{
+    LoFS::mkdir(BENCH_ROOT);
+    LoFS::mkdir(BENCH_ROOT "/flash");
+    LoFS::mkdir(BENCH_ROOT "/sd");
+    if (!LoFS::mount("/simflash/", &simFlash) || !LoFS::mount("/simsd/", &simSD)) {
+        out.println("lofsBenchmark: mount failed");
+        return;
+    }
+
+    benchDevice(out, "/simflash/", "flash");
+    benchDevice(out, "/simsd/", "sd");
+#if LOFS_RAMDISK && LOFS_RAM_BYTES > 0
+    benchDevice(out, "/ram/", "ram");
+#endif
+#if LOFS_COMPRESS && LOFS_RAMDISK && LOFS_RAM_BYTES > 0
+    benchCompression(out);
+#endif
+    benchDispatch(out);
+    benchChecksum(out);
+    benchCopyBuffers(out);
+    benchReserve(out);
+    benchBundle(out);
+    benchKV(out);
+#ifdef ARCH_PORTDUINO
+    benchContention(out);
+#endif
+
+    // Cross-filesystem rename copies the data
+    static const size_t sizes[] = {256, 4096, 65536};
+    for (size_t size : sizes) {
+        char name[48];
+        writeFile("/simflash/move.bin", size);
+        begin("/simflash/", "/simsd/");
+        for (int i = 0; i < 10; i++) {
+            startOp();
+            LoFS::rename("/simflash/move.bin", "/simsd/move.bin");
+            endOp();
+            startOp();
+            LoFS::rename("/simsd/move.bin", "/simflash/move.bin");
+            endOp();
+        }
+        snprintf(name, sizeof(name), "rename cross-FS (%u B)", (unsigned)size);
+        report(out, name);
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "simulated device time: flash %lu ms, sd %lu ms",
+             (unsigned long)(simFlash.simulatedUs() / 1000), (unsigned long)(simSD.simulatedUs() / 1000));
+    out.println(line);
+
+    LoFS::unmount("/simflash/");
+    LoFS::unmount("/simsd/");
+    LoFS::rmdir(BENCH_ROOT, true);
+}
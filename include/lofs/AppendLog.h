@@ -0,0 +1,104 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Append-only record log with group commit and size-based rotation
+ *
+ * Records are gathered in a RAM buffer and written with one open/write/close
+ * when the buffer fills, when flushIntervalMs has passed since the first
+ * uncommitted record, or on flush(). When the live file would exceed
+ * maxFileSize it is rotated: path -> <archiveDir>/<name>.0, older segments
+ * shift to .1, .2, ... and the oldest beyond maxSegments is deleted. The
+ * archive directory may be on another filesystem (e.g. keep the live log on
+ * /internal/ and rotated segments on /sd/); segments are moved with
+ * LoFS::rename.
+ *
+ * Not thread-safe; use one instance from one task.
+ *
+ * Usage example:
+ *   LoFS::AppendLog::Options opts;
+ *   opts.maxFileSize = 32 * 1024;
+ *   opts.archiveDir = "/sd/logs";
+ *   static LoFS::AppendLog telemetry("/internal/telemetry.log", opts);
+ *
+ *   telemetry.append(record, len); // buffered
+ *   telemetry.loop();              // call periodically: commits after flushIntervalMs
+ */
+class LoFS::AppendLog
+{
+  public:
+    struct Options {
+        size_t bufferSize;        ///< Group-commit buffer (default 512)
+        uint32_t flushIntervalMs; ///< Commit pending records at most this long after they arrive (0 = only when full)
+        uint32_t maxFileSize;     ///< Rotate before the live file grows past this (0 = never rotate)
+        uint8_t maxSegments;      ///< Rotated segments to keep (<name>.0 ... <name>.N-1)
+        const char *archiveDir;   ///< Directory for rotated segments (nullptr = same directory as the log)
+
+        Options() : bufferSize(512), flushIntervalMs(5000), maxFileSize(64 * 1024), maxSegments(4), archiveDir(nullptr) {}
+    };
+
+    struct Stats {
+        uint32_t records;   ///< append() calls accepted
+        uint32_t commits;   ///< Backend writes issued
+        uint32_t rotations; ///< Segments rotated out
+        uint64_t bytes;     ///< Record bytes committed
+    };
+
+    AppendLog(const char *path, const Options &options = Options());
+    ~AppendLog();
+
+    /**
+     * @brief Buffer a record
+     * @return false if the record could not be committed (backend error)
+     *
+     * After a failed commit, buffered bytes that did not reach the file are
+     * retried by the next flush; bytes that did are not written again. A
+     * record larger than the buffer is written on its own and not retried.
+     */
+    bool append(const void *data, size_t len);
+
+    /**
+     * @brief Commit pending records if the flush interval has elapsed
+     */
+    void loop();
+
+    /**
+     * @brief Commit pending records now
+     */
+    bool flush();
+
+    /**
+     * @brief Flush and rotate the live file regardless of size
+     * @return true if the live file was rotated, or does not exist yet (nothing to rotate)
+     */
+    bool rotate();
+
+    /**
+     * @brief Bytes buffered but not yet written
+     */
+    size_t pending() const { return used; }
+
+    const Stats &stats() const { return counters; }
+
+  private:
+    AppendLog(const AppendLog &) = delete;
+    AppendLog &operator=(const AppendLog &) = delete;
+
+    /**
+     * @brief Append data to the live file, rotating first if it would grow too large
+     * @param written Receives the bytes that reached the file, also when the write falls short
+     */
+    bool commit(const uint8_t *data, size_t len, size_t *written);
+    bool rotateFile();
+    void segmentPath(char *out, size_t outSize, int index) const;
+
+    char path[LOFS_PATH_MAX];
+    Options options;
+    uint8_t *buffer;
+    size_t used;
+    uint32_t firstPendingMs; ///< millis() of the oldest uncommitted record
+    uint32_t fileSize;       ///< Live file size, valid once sizeKnown
+    bool sizeKnown;          ///< fileSize has been read from the backend
+    Stats counters;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Status of a request submitted with LoFS::submit()
+ */
+enum class LoFS::AsyncStatus : uint8_t {
+    UNKNOWN, ///< Invalid handle, or completed long enough ago that its slot was reused
+    PENDING, ///< Queued or running
+    DONE,    ///< Completed successfully
+    FAILED   ///< Completed with an error
+};
+
+/**
+ * @brief Background filesystem operation for LoFS::submit()
+ *
+ * Usage example:
+ *   // Fire-and-forget append; consecutive appends to one file share one open
+ *   LoFS::submit(LoFS::AsyncOp::append("/sd/data/log.txt", line, len));
+ *
+ *   // Rename with completion callback
+ *   LoFS::submit(LoFS::AsyncOp::rename("/internal/a.bin", "/sd/a.bin").onComplete(done, nullptr));
+ */
+struct LoFS::AsyncOp {
+    enum class Type : uint8_t {
+        WRITE,  ///< Replace file contents with data
+        APPEND, ///< Append data to file
+        REMOVE, ///< LoFS::remove(path)
+        RENAME, ///< LoFS::rename(path, newPath)
+        RMDIR   ///< LoFS::rmdir(path, true)
+    };
+
+    Type type;
+    const char *path;
+    const char *newPath;
+    const void *data;
+    size_t len;
+    AsyncCallback callback;
+    void *context;
+
+    static AsyncOp write(const char *path, const void *data, size_t len) { return AsyncOp(Type::WRITE, path, nullptr, data, len); }
+    static AsyncOp append(const char *path, const void *data, size_t len) { return AsyncOp(Type::APPEND, path, nullptr, data, len); }
+    static AsyncOp remove(const char *path) { return AsyncOp(Type::REMOVE, path, nullptr, nullptr, 0); }
+    static AsyncOp rename(const char *path, const char *newPath) { return AsyncOp(Type::RENAME, path, newPath, nullptr, 0); }
+    static AsyncOp rmdir(const char *path) { return AsyncOp(Type::RMDIR, path, nullptr, nullptr, 0); }
+
+    /**
+     * @brief Attach a completion callback
+     */
+    AsyncOp &onComplete(AsyncCallback cb, void *ctx)
+    {
+        callback = cb;
+        context = ctx;
+        return *this;
+    }
+
+  private:
+    AsyncOp(Type type, const char *path, const char *newPath, const void *data, size_t len)
+        : type(type), path(path), newPath(newPath), data(data), len(len), callback(nullptr), context(nullptr)
+    {
+    }
+};
+
+/**
+ * @brief Async queue counters (see LoFS::asyncStats())
+ */
+struct LoFS::AsyncStats {
+    uint32_t submitted;    ///< Requests accepted by submit()
+    uint32_t rejected;     ///< submit() calls refused (queue full / no memory)
+    uint32_t completed;    ///< Requests finished (success or failure)
+    uint32_t failed;       ///< Requests finished with an error
+    uint32_t coalesced;    ///< Writes merged into a preceding write's open/close
+    uint16_t depth;        ///< Requests currently queued or running
+    uint16_t maxDepth;     ///< High-water mark of depth
+    uint32_t avgLatencyMs; ///< Mean submit-to-completion time
+    uint32_t maxLatencyMs; ///< Worst submit-to-completion time
+};
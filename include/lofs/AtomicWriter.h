@@ -0,0 +1,70 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/// Suffix of a temp file still being written (deleted by LoFS::recoverAtomic)
+#define LOFS_ATOMIC_TMP_SUFFIX ".lofs-tmp"
+
+/// Suffix of a complete temp file awaiting its final rename (moved into place by LoFS::recoverAtomic)
+#define LOFS_ATOMIC_NEW_SUFFIX ".lofs-new"
+
+/**
+ * @brief Streaming crash-safe replacement of a file
+ *
+ * Written data is first compared with the existing file. As long as it
+ * matches, nothing is written to flash. At the first difference a temp
+ * sibling is created with the matching prefix, and the rest of the data goes
+ * there. commit() then renames the temp file over the target. If the new
+ * content equals the old one, commit() succeeds without any write.
+ *
+ * Usage example:
+ *   LoFS::AtomicWriter w("/internal/prefs/config.json");
+ *   w.print(json);
+ *   if (!w.commit()) {
+ *       // old contents are still intact
+ *   }
+ */
+class LoFS::AtomicWriter : public Print
+{
+  public:
+    explicit AtomicWriter(const char *filepath);
+
+    /// Discards uncommitted data
+    ~AtomicWriter();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+
+    /**
+     * @brief Make the written data the file's contents
+     * @return true on success (including the unchanged case)
+     */
+    bool commit();
+
+    /**
+     * @brief Drop written data and leave the file untouched
+     */
+    void abort();
+
+    /**
+     * @brief After commit(): whether the file contents actually changed
+     */
+    bool changed() const { return diverged; }
+
+  private:
+    AtomicWriter(const AtomicWriter &) = delete;
+    AtomicWriter &operator=(const AtomicWriter &) = delete;
+
+    bool diverge();
+
+    char path[LOFS_PATH_MAX];
+    char tmpPath[LOFS_PATH_MAX];
+    LockDomain *domain;   ///< Lock of the backend holding path and tmpPath
+    File existing;        ///< Current contents, compared against incoming data
+    uint32_t existingSize;
+    uint32_t matched;     ///< Leading bytes identical to the existing file
+    File tmp;
+    bool diverged;        ///< Data differs; writing to tmp
+    bool failed;
+    bool done;            ///< commit() or abort() already ran
+};
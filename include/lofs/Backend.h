@@ -0,0 +1,69 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+#include <lofs/LockDomain.h>
+
+/**
+ * @brief Storage backend that can be mounted into the LoFS namespace
+ *
+ * A backend receives paths that have already been stripped of their mount
+ * prefix and normalized (see leadingSlash()). LoFS holds the backend's lock
+ * domain around every backend call, so implementations must not take it
+ * themselves.
+ *
+ * Usage example:
+ *   static MyFlashChip flashChip;
+ *   LoFS::mount("/ext/", &flashChip);
+ *   File f = LoFS::open("/ext/scratch.bin", "w");
+ */
+class LoFS::Backend
+{
+  public:
+    virtual ~Backend() {}
+
+    /**
+     * @brief Check whether the backend can currently serve requests
+     * @return false to make every path under this mount fail (e.g. SD card removed)
+     */
+    virtual bool isAvailable() { return true; }
+
+    /**
+     * @brief Whether stripped paths should start with '/'
+     *
+     * FSCom expects "/config/x", the SD library historically gets "config/x".
+     */
+    virtual bool leadingSlash() const { return true; }
+
+    /**
+     * @brief Lock held around calls into this backend and I/O on its files
+     *
+     * Defaults to the SPI domain, which is always safe. Override to give the
+     * backend its own lock (see LockDomain).
+     */
+    virtual LockDomain &lockDomain() { return LockDomain::spi(); }
+
+    /**
+     * @brief Open a file or directory
+     * @param path Stripped path
+     * @param mode Mode string ("r", "w" or "a")
+     */
+    virtual File open(const char *path, const char *mode) = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual bool mkdir(const char *path) = 0;
+    virtual bool remove(const char *path) = 0;
+
+    /**
+     * @brief Rename within this backend (cross-backend moves are handled by LoFS)
+     */
+    virtual bool rename(const char *oldpath, const char *newpath) = 0;
+    virtual bool rmdir(const char *path) = 0;
+
+    /**
+     * @brief Cut a closed file (path) down to size bytes in place
+     * @return false if the backend cannot (callers then rewrite the file instead)
+     */
+    virtual bool truncate(const char *, uint32_t) { return false; }
+
+    virtual uint64_t totalBytes() = 0;
+    virtual uint64_t usedBytes() = 0;
+};
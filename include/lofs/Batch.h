@@ -0,0 +1,111 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Runs many exists/mkdir/remove/rmdir calls with one lock hold per backend
+ *
+ * Paths are resolved once, when an operation is added, into a buffer owned
+ * by the batch (no malloc per call). run() then takes each backend's lock
+ * once and executes that backend's operations in the order they were added.
+ * Backends run in the order of their first operation. Cache, exists() and
+ * free-space bookkeeping is the same as for the single calls.
+ *
+ * Operations on different backends are not ordered against each other, so
+ * do not batch steps that depend on each other across filesystems.
+ *
+ * Not thread-safe; use one instance from one task.
+ *
+ * Usage example:
+ *   LoFS::Batch b;
+ *   b.remove("/internal/tmp/a.bin");
+ *   b.remove("/internal/tmp/b.bin");
+ *   b.rmdir("/internal/tmp");
+ *   int marker = b.exists("/sd/meshtastic/marker");
+ *   b.run(); // continue past failures
+ *   if (b.result(marker)) { ... }
+ */
+class LoFS::Batch
+{
+  public:
+    enum class Policy : uint8_t {
+        CONTINUE,      ///< Run every operation
+        STOP_ON_ERROR, ///< Stop at the first failed mkdir/remove/rmdir; run nothing if a path is invalid
+    };
+
+    enum class Status : uint8_t {
+        PENDING, ///< Not run yet
+        DONE,    ///< Ran; result() holds its return value
+        FAILED,  ///< A mkdir/remove/rmdir that returned false
+        INVALID, ///< Path did not resolve (bad prefix, backend unavailable, or path buffer full)
+        SKIPPED, ///< Not run because of STOP_ON_ERROR
+    };
+
+    /**
+     * @param maxOps Most operations the batch can hold
+     * @param pathBytes Buffer for resolved paths, shared by all operations
+     */
+    explicit Batch(size_t maxOps = 32, size_t pathBytes = 1024);
+    ~Batch();
+
+    /**
+     * @brief Queue an operation
+     * @return Index for result()/status(), or -1 if the batch is full
+     */
+    int exists(const char *filepath);
+    int mkdir(const char *filepath);
+    int remove(const char *filepath);
+
+    /**
+     * @brief Queue removal of an empty directory (succeeds if it does not exist and fails for a file, like LoFS::rmdir)
+     */
+    int rmdir(const char *filepath);
+
+    /**
+     * @brief Execute all pending operations
+     * @return true if no operation failed or was invalid
+     */
+    bool run(Policy policy = Policy::CONTINUE);
+
+    /// Return value of operation i (exists: whether the path exists)
+    bool result(int i) const { return i >= 0 && (size_t)i < count && ops[i].result; }
+    Status status(int i) const { return (i >= 0 && (size_t)i < count) ? ops[i].status : Status::INVALID; }
+
+    size_t size() const { return count; }
+
+    /// Operations that ended FAILED or INVALID
+    size_t failures() const;
+
+    /// Forget all operations, keeping the buffers
+    void clear();
+
+  private:
+    enum class Kind : uint8_t { EXISTS, MKDIR, REMOVE, RMDIR };
+
+    struct Op {
+        Backend *backend;
+        size_t pathOffset;
+        Kind kind;
+        Status status;
+        bool result;
+    };
+
+    Batch(const Batch &) = delete;
+    Batch &operator=(const Batch &) = delete;
+
+    int add(Kind kind, const char *filepath);
+    bool runGroup(size_t first, bool stopOnError);
+
+    /**
+     * @brief Run one backend's operations; the caller holds its lock
+     * @param available Result of isAvailable(), checked before the lock was taken
+     */
+    bool execute(size_t first, bool stopOnError, bool available, bool tracked, uint64_t *freed);
+
+    Op *ops;
+    char *paths;
+    size_t maxOps;
+    size_t pathBytes;
+    size_t count;
+    size_t pathsUsed;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Write-only file that gathers small writes into whole flash pages
+ *
+ * Writes are copied into a RAM buffer of whole LOFS_WRITE_PAGE_SIZE pages.
+ * When the buffer fills, everything up to the last page boundary of the
+ * file is written in one call, so the filesystem programs full pages instead
+ * of rewriting one page per few-byte write. The rest stays buffered until
+ * the next fill, sync(), close(), or until it has waited longer than
+ * Buffered::flushMs (checked on each write() and by flushIfDue()).
+ *
+ * Data in the buffer is lost on a crash or power loss; call sync() at points
+ * that must be durable.
+ *
+ * Usage example:
+ *   LoFS::BufferedFile log = LoFS::open("/internal/log.txt", "a", LoFS::Buffered{1024, 5000});
+ *   log.print("boot\n");
+ *   ...
+ *   log.close();
+ *   // log.stats().programmedBytes vs. log.stats().unbufferedProgrammedBytes
+ */
+class LoFS::BufferedFile : public Stream
+{
+  public:
+    BufferedFile();
+    BufferedFile(BufferedFile &&other);
+    BufferedFile &operator=(BufferedFile &&other);
+    ~BufferedFile() { close(); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+
+    /// Write-only: nothing to read
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    /// Same as sync()
+    void flush() override { sync(); }
+
+    /**
+     * @brief Write everything buffered, including a partial page, and flush the file
+     * @return false if the filesystem accepted fewer bytes than buffered
+     */
+    bool sync();
+
+    /**
+     * @brief sync() if data has been buffered longer than Buffered::flushMs
+     *
+     * Call from a loop when the file may sit idle with data buffered.
+     */
+    bool flushIfDue();
+
+    /// Bytes written so far, buffered or not
+    size_t position() const { return fileOffset + used; }
+
+    void close();
+    operator bool() const { return (bool)file; }
+
+    /// Counters for this file since it was opened
+    const WriteStats &stats() const { return counters; }
+
+  private:
+    friend class LoFS;
+
+    BufferedFile(const BufferedFile &) = delete;
+    BufferedFile &operator=(const BufferedFile &) = delete;
+
+    bool drain(bool all);
+
+    LockDomain *domain; ///< Lock of the file's backend
+    File file;
+    uint8_t *buffer;
+    size_t capacity;       ///< 0 when the buffer could not be allocated (writes go straight through)
+    size_t used;
+    size_t fileOffset;     ///< File position of buffer[0]
+    uint32_t flushMs;
+    uint32_t bufferedSinceMs; ///< millis() when the oldest buffered byte arrived
+    WriteStats counters;
+};
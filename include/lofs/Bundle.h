@@ -0,0 +1,121 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+/**
+ * @brief Read-only pack of many small files in one bundle file or memory image
+ *
+ * A bundle is built on the host with tools/lofs-pack.py. Its index (names
+ * sorted byte-wise, offsets, sizes, CRC32s) is loaded once by begin(), so
+ * finding an asset is a binary search in RAM and reading it a seek + read on
+ * the one bundle file kept open. Loading hundreds of assets then costs one
+ * LoFS::open() instead of hundreds.
+ *
+ * Bundles linked into the firmware (lofs-pack.py --c-array) are used in
+ * place: view() returns a pointer to an asset's bytes without copying.
+ *
+ * A bundle is also a Backend. Mounted at a prefix, its assets open as
+ * read-only Files (ESP32 and Portduino) and can be listed like a directory
+ * tree; exists() answers from the index.
+ *
+ * Format (little-endian): 16-byte header ("LoFB", version 1, 3 reserved
+ * bytes, entry count, name table size), one 16-byte entry per asset (name
+ * offset, data offset, size, CRC32), the NUL-terminated names, then the
+ * data, each asset 4-byte aligned.
+ *
+ * Usage example:
+ *   static LoFS::Bundle assets;
+ *   assets.begin("/internal/assets.lfb");
+ *   int i = assets.find("presets/long_fast.json");
+ *   assets.read(i, 0, buf, assets.size(i));
+ *
+ *   LoFS::mount("/assets/", &assets);
+ *   File f = LoFS::open("/assets/strings/en.txt", "r");
+ */
+class LoFS::Bundle : public LoFS::Backend
+{
+  public:
+    Bundle();
+    ~Bundle();
+
+    /**
+     * @brief Open a bundle file and load its index
+     * @param filepath Path with prefix, e.g. "/internal/assets.lfb"
+     * @return false if the file is missing or not a valid bundle, or Files of the current one are open
+     */
+    bool begin(const char *filepath);
+
+    /**
+     * @brief Use a bundle image in memory (e.g. linked into the firmware)
+     * @param image Bundle bytes; must stay valid until end()
+     */
+    bool begin(const uint8_t *image, size_t len);
+
+    /**
+     * @brief Close the bundle file and free the index
+     * @return false (and nothing is freed) while Files opened through a mount are still open
+     */
+    bool end();
+
+    /// Number of assets
+    size_t count() const { return entryCount; }
+
+    /**
+     * @brief Index of an asset by name ("dir/name", a leading '/' is ignored)
+     * @return -1 if there is no such asset
+     */
+    int find(const char *name) const;
+
+    const char *name(int index) const;
+    uint32_t size(int index) const;
+    uint32_t crc(int index) const;
+
+    /**
+     * @brief An asset's bytes, without copying
+     * @return nullptr unless the bundle is a memory image
+     */
+    const uint8_t *view(int index) const;
+
+    /**
+     * @brief Copy part of an asset
+     * @return Bytes read; fewer than len at the end of the asset
+     */
+    size_t read(int index, uint32_t offset, void *buf, size_t len);
+
+    /// Check an asset against the CRC32 stored at pack time
+    bool verify(int index);
+
+    LockDomain &lockDomain() override;
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *) override { return false; }
+    bool remove(const char *) override { return false; }
+    bool rename(const char *, const char *) override { return false; }
+    bool rmdir(const char *) override { return false; }
+    uint64_t totalBytes() override { return imageSize; }
+    uint64_t usedBytes() override { return imageSize; }
+
+  private:
+    class Handle;
+
+    Bundle(const Bundle &) = delete;
+    Bundle &operator=(const Bundle &) = delete;
+
+    bool load(const uint8_t *header, uint32_t totalSize);
+    const uint8_t *entry(int index) const;
+    bool isDir(const char *path) const;
+    int lowerBound(const char *prefix, size_t len) const;
+    size_t readAt(int index, uint32_t offset, void *buf, size_t len);
+
+    const uint8_t *image;        ///< Memory bundle, or nullptr
+    uint8_t *table;              ///< Entries and names loaded from a bundle file
+    const uint8_t *entries;
+    const char *names;
+    uint32_t entryCount;
+    uint32_t namesSize;
+    uint32_t imageSize;
+    File file;
+    Backend *fileBackend;        ///< Backend holding the bundle file
+    Lock *readLock; ///< Keeps seek + read on the shared file together; guards openHandles
+    uint32_t openHandles; ///< Open Files of assets and directories, which read the index
+};
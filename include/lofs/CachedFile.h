@@ -0,0 +1,56 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Read-only file whose reads go through the LoFS block cache
+ *
+ * Mirrors the read side of File (read, peek, available, seek, position, size,
+ * close) so it can replace a File in read paths. Reads are served in
+ * LOFS_BLOCK_CACHE_BLOCK_SIZE blocks from a shared LRU cache; only misses touch
+ * the backend. Blocks are keyed by the file's backend and full path, interned
+ * while the file is open or still has blocks cached.
+ *
+ * On ESP32 and Portduino, LoFS::openCachedFile() returns the same reader as
+ * a File. Elsewhere File has no hook for other implementations, so this
+ * Stream is the only form.
+ *
+ * Usage example:
+ *   LoFS::CachedFile f = LoFS::openCached("/sd/tables/lookup.bin");
+ *   f.seek(offset);
+ *   f.read(buf, sizeof(buf));
+ *   f.close();
+ */
+class LoFS::CachedFile : public Stream
+{
+  public:
+    CachedFile() : backend(nullptr), fileId(0), pos(0), fileSize(0) {}
+    CachedFile(const CachedFile &other);
+    CachedFile &operator=(const CachedFile &other);
+    ~CachedFile();
+
+    size_t read(uint8_t *buf, size_t size);
+    int read() override;
+    int peek() override;
+    int available() override;
+
+    /// Read-only: writes are rejected
+    size_t write(uint8_t) override { return 0; }
+    size_t write(const uint8_t *, size_t) override { return 0; }
+
+    bool seek(uint32_t pos);
+    size_t position() const { return pos; }
+    size_t size() const { return fileSize; }
+    void close();
+    operator bool() { return (bool)file; }
+
+  private:
+    friend class LoFS;
+    class Handle;
+
+    Backend *backend;  ///< Owner of file; its lock domain guards every call on it
+    File file;
+    uint32_t fileId;   ///< Cache entry holding backend + stripped path; 0 = read uncached
+    uint32_t pos;      ///< Logical read position
+    uint32_t fileSize; ///< Size at open
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+// Compressed files are returned through the ESP32-style fs::FileImpl, which
+// exists on ESP32 and Portduino only
+#ifndef LOFS_COMPRESS
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define LOFS_COMPRESS 1
+#else
+#define LOFS_COMPRESS 0
+#endif
+#endif
+
+// Directory holding the files of the built-in /z/ mount; empty leaves /z/ unmounted
+#ifndef LOFS_Z_DIR
+#define LOFS_Z_DIR "/internal/.z"
+#endif
+
+#if LOFS_COMPRESS
+/**
+ * @brief Backend that stores files LZ-compressed in a directory of another mount
+ *
+ * Files opened through this mount read and write plain data through the
+ * normal File API. On the target they are kept as LZSS frames with a bounded
+ * window (LOFS_LZ_WINDOW), so text logs and JSON configs take a fraction of
+ * the flash and cost fewer page programs to write.
+ *
+ * Each write session ("w", "a", or a flush()) adds one frame, and a frame
+ * becomes readable once it is closed or flushed. Appending small records with
+ * an open/append/close per record therefore compresses poorly; keep the file
+ * open or write through AppendLog or BufferedFile. Files are written
+ * sequentially: seek() works when reading (backwards seeks decode from the
+ * start again), not when writing. A frame cut short by a power loss is
+ * ignored when reading and the earlier frames stay readable.
+ *
+ * Directories are not compressed. Listings report the stored (compressed)
+ * size, while size() on an opened file reports the plain size.
+ *
+ * An instance over LOFS_Z_DIR is mounted at /z/. More can be mounted at
+ * other prefixes:
+ *   static LoFS::CompressedBackend sdLogs("/sd/logs.z");
+ *   LoFS::mount("/sdz/", &sdLogs);
+ *   File f = LoFS::open("/sdz/today.log", "a");
+ */
+class LoFS::CompressedBackend : public LoFS::Backend
+{
+  public:
+    /**
+     * @brief Bytes passing through the mount since boot or resetStats()
+     */
+    struct Stats {
+        uint64_t rawBytes;    ///< Plain bytes written
+        uint64_t storedBytes; ///< Bytes those took on the target, frame overhead included
+    };
+
+    /**
+     * @param target LoFS path of the directory holding the compressed files (e.g. "/internal/.z")
+     */
+    explicit CompressedBackend(const char *target);
+
+    /// The target's backend is available (e.g. an SD card is present)
+    bool isAvailable() override;
+    LockDomain &lockDomain() override;
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *oldpath, const char *newpath) override;
+    bool rmdir(const char *path) override;
+    uint64_t totalBytes() override;
+    uint64_t usedBytes() override;
+
+    Stats stats() const { return counters; }
+    void resetStats() { counters = Stats(); }
+
+  private:
+    class Handle;
+
+    Backend *map(const char *path, char *buf, size_t size);
+
+    char target[LOFS_PATH_MAX];
+    bool rootReady; ///< Target directory known to exist
+    Stats counters;
+};
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief Lightweight directory iterator
+ *
+ * Yields entry name, size and directory flag. The name is copied into a
+ * buffer inside the iterator and reused for every entry, so iterating
+ * allocates nothing on the heap per entry ("." and ".." are skipped).
+ *
+ * Usage example:
+ *   LoFS::DirIterator it("/sd/logs");
+ *   while (it.next()) {
+ *       if (!it.isDirectory()) {
+ *           total += it.size();
+ *       }
+ *   }
+ */
+class LoFS::DirIterator
+{
+  public:
+    /**
+     * @param dirpath Directory path with prefix
+     */
+    explicit DirIterator(const char *dirpath);
+    explicit DirIterator(const Path &dirpath);
+    ~DirIterator() { close(); }
+
+    /**
+     * @brief Advance to the next entry
+     * @return false when there are no more entries (or the directory could not be opened)
+     */
+    bool next();
+
+    /// Entry name without directory part; valid until the next call to next()
+    const char *name() const { return entryName; }
+    uint32_t size() const { return entrySize; }
+    bool isDirectory() const { return entryIsDir; }
+
+    void close();
+
+    /// false if the path could not be opened as a directory
+    operator bool() const { return open; }
+
+  private:
+    friend class LoFS;
+
+    DirIterator() : backend(nullptr), entrySize(0), entryIsDir(false), open(false) { entryName[0] = '\0'; }
+    DirIterator(const DirIterator &) = delete;
+    DirIterator &operator=(const DirIterator &) = delete;
+
+    void attach(Backend *dirBackend, const char *strippedPath);
+
+    Backend *backend; ///< Owner of dir; its lock domain guards every call on it
+    File dir;
+    char entryName[LOFS_PATH_MAX];
+    uint32_t entrySize;
+    bool entryIsDir;
+    bool open;
+};
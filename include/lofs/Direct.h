@@ -0,0 +1,84 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/// True if path starts with prefix; constant-evaluated for string literals
+constexpr bool lofsHasPrefix(const char *path, const char *prefix)
+{
+    return *prefix == '\0' || (*path == *prefix && lofsHasPrefix(path + 1, prefix + 1));
+}
+
+/// Built-in filesystem named by a path's prefix; INVALID for unprefixed paths and other mounts
+constexpr LoFS::FSType lofsDirectType(const char *path)
+{
+    return lofsHasPrefix(path, "/internal/") ? LoFS::FSType::INTERNAL
+           : lofsHasPrefix(path, "/sd/")     ? LoFS::FSType::SD
+                                             : LoFS::FSType::INVALID;
+}
+
+/// Characters of prefix to skip: "/internal" (keeping the '/' FSCom wants) or "/sd/"
+constexpr size_t lofsDirectOffset(const char *path)
+{
+    return lofsHasPrefix(path, "/internal/") ? 9 : lofsHasPrefix(path, "/sd/") ? 4 : 0;
+}
+
+/**
+ * @brief Direct handle for a path literal, routed while compiling
+ *
+ * LOFS_DIRECT("/internal/prefs/config.json") is a
+ * LoFS::Direct<FSType::INTERNAL> for "/prefs/config.json". Any other
+ * prefix fails to compile.
+ */
+#define LOFS_DIRECT(path) LoFS::Direct<lofsDirectType(path)>((path) + lofsDirectOffset(path))
+
+/**
+ * @brief A path on internal flash or the SD card whose backend is fixed at compile time
+ *
+ * LoFS::open() and friends resolve every path at runtime: a heap copy of
+ * the path, a mount table lookup and slash fix-ups. A Direct handle skips
+ * all of that and calls the built-in backend with the path as given. Locks,
+ * the exists() cache, the block cache, space accounting and instrumentation
+ * are shared with the path API, so both can be mixed freely on the same
+ * files. SD calls still fail while no card is present.
+ *
+ * Direct always targets the built-in /internal/ and /sd/ backends, even if
+ * another backend was mounted at those prefixes.
+ *
+ * Usage example:
+ *   static constexpr auto config = LOFS_DIRECT("/internal/prefs/config.json");
+ *   File f = config.open("r");
+ *
+ *   LoFS::Direct<LoFS::FSType::SD>("logs/boot.txt").exists();
+ */
+template <LoFS::FSType T> class LoFS::Direct
+{
+    static_assert(T == FSType::INTERNAL || T == FSType::SD, "LoFS::Direct needs an /internal/ or /sd/ path");
+
+  public:
+    /**
+     * @param path Path below the mount ("/prefs/config.json", "logs/boot.txt"); must outlive the handle.
+     *             SD drops a leading '/', internal flash adds one if missing.
+     */
+    constexpr explicit Direct(const char *path) : path(path) {}
+
+    File open(const char *mode) const;
+    bool exists() const;
+    bool mkdir() const;
+    bool remove() const;
+
+    /// Path below the mount, as passed in
+    constexpr const char *c_str() const { return path; }
+
+  private:
+    /**
+     * @brief Backend and backend-style path, without touching the mount table
+     * @param buf Scratch space, used only when a leading '/' has to be added
+     * @return nullptr if the SD card is not available or the path does not fit
+     */
+    static Backend *route(const char *path, char *buf, size_t size, const char **routed);
+
+    const char *path;
+};
+
+extern template class LoFS::Direct<LoFS::FSType::INTERNAL>;
+extern template class LoFS::Direct<LoFS::FSType::SD>;
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+#include <string.h>
+
+// Segment files one store may have at a time (sealed + active)
+#ifndef LOFS_KV_MAX_SEGMENTS
+#define LOFS_KV_MAX_SEGMENTS 16
+#endif
+
+/**
+ * @brief Log-structured key-value store for many small entries
+ *
+ * put() and remove() append a record to the active segment file in the
+ * store's directory; nothing is rewritten in place. A RAM index maps each
+ * key's hash to the segment and offset of its newest record, so get() is
+ * one seek + read. Once the active segment reaches segmentBytes it is sealed
+ * and a new one started. Sealed segments whose records are mostly
+ * overwritten or deleted are compacted: the live records are copied to the
+ * active segment and the old file removed.
+ *
+ * When a segment is sealed, a hint file listing its records (hash, offset,
+ * length, no values) is written beside it, so begin() rebuilds the index
+ * from the hints and only scans the active segment. Hints and compaction
+ * run on the async worker (see processAsync()), or on compact().
+ *
+ * The index holds a 32-bit hash plus a 16-bit check value per key, not the
+ * key itself: two keys are taken to be the same if both match. get()
+ * compares the stored key, so it never returns another key's value.
+ *
+ * Records are CRC32-protected; a record torn by a power loss ends the
+ * segment at the last complete one. So does a write that fails part-way;
+ * if no segment slot is free to carry on in, put() and remove() fail until
+ * compaction frees one. Writes reach the file system when the
+ * File buffer fills, on sync(), and when a segment is sealed.
+ *
+ * Thread-safe; each call holds the store's lock.
+ *
+ * Usage example:
+ *   static LoFS::KV nodes("/internal/kv/nodes");
+ *   nodes.begin();
+ *   nodes.put(&nodeNum, sizeof(nodeNum), &info, sizeof(info));
+ *   int len = nodes.get(&nodeNum, sizeof(nodeNum), &info, sizeof(info));
+ *   nodes.sync(); // before a planned shutdown
+ */
+class LoFS::KV
+{
+  public:
+    struct Options {
+        uint32_t maxKeys;       ///< Index capacity; put() of a new key fails beyond it (default 1024)
+        uint32_t segmentBytes;  ///< Seal the active segment once it reaches this size (default 32 KB)
+        uint8_t compactPercent; ///< Compact a sealed segment once this share of it is dead (default 50)
+
+        Options() : maxKeys(1024), segmentBytes(32 * 1024), compactPercent(50) {}
+    };
+
+    struct Stats {
+        uint32_t keys;            ///< Live keys
+        uint16_t segments;        ///< Segment files, including the active one
+        uint16_t hintedSegments;  ///< Segments begin() indexed from their hint file
+        uint16_t scannedSegments; ///< Segments begin() had to read record by record
+        uint64_t bytes;           ///< Total size of all segments
+        uint64_t deadBytes;       ///< Overwritten and deleted records not yet compacted
+        uint32_t compactions;     ///< Segments compacted since begin()
+        uint32_t beginMs;         ///< Time begin() took to rebuild the index
+    };
+
+    /**
+     * @param dirpath Directory for the segment files, with prefix (e.g. "/internal/kv/nodes")
+     */
+    KV(const char *dirpath, const Options &options = Options());
+    ~KV();
+
+    /**
+     * @brief Create the directory if needed and rebuild the index
+     * @return false if the directory or the index could not be set up
+     */
+    bool begin();
+
+    /// Flush the active segment, close the files and free the index
+    void end();
+
+    /**
+     * @brief Store a value, replacing any previous one
+     * @param key Key bytes (1 to 255)
+     * @param value Value bytes (up to 65535 bytes of record, header and key included)
+     * @return false if the key is too long, the index or the store is full, or the write failed
+     */
+    bool put(const void *key, size_t keyLen, const void *value, size_t len);
+    bool put(const char *key, const void *value, size_t len) { return put(key, strlen(key), value, len); }
+
+    /**
+     * @brief Read a value
+     * @param buf Receives up to size bytes of the value
+     * @return Full length of the value (may exceed size), or -1 if the key is not stored
+     */
+    int get(const void *key, size_t keyLen, void *buf, size_t size);
+    int get(const char *key, void *buf, size_t size) { return get(key, strlen(key), buf, size); }
+
+    bool contains(const void *key, size_t keyLen);
+    bool contains(const char *key) { return contains(key, strlen(key)); }
+
+    /**
+     * @brief Delete a key
+     * @return false if the key was not stored or the tombstone could not be written
+     */
+    bool remove(const void *key, size_t keyLen);
+    bool remove(const char *key) { return remove(key, strlen(key)); }
+
+    /// Number of live keys
+    size_t count() const { return keys; }
+
+    /**
+     * @brief Write buffered records to the file system
+     */
+    bool sync();
+
+    /**
+     * @brief Write missing hint files and compact segments now
+     * @param force Compact the segment with the most dead bytes even below compactPercent
+     * @return Number of segments compacted
+     */
+    int compact(bool force = false);
+
+    Stats stats();
+
+  private:
+    friend class LoFS;
+
+    /**
+     * @brief A segment file and how much of it is still needed
+     */
+    struct Segment {
+        uint32_t id;    ///< File name number; 0 = unused slot
+        uint32_t bytes; ///< Valid length
+        uint32_t dead;  ///< Bytes of overwritten or deleted records
+        uint32_t tombs; ///< Bytes of tombstones (dead once no older segment is left)
+        bool hinted;    ///< Hint file written (or loaded)
+    };
+
+    /**
+     * @brief Index slot: key hash and where its newest record is
+     */
+    struct Slot {
+        uint32_t hash;   ///< 0 = empty
+        uint32_t loc;    ///< Segment slot << 24 | offset
+        uint16_t length; ///< Record bytes
+        uint16_t check;  ///< Second, independent key hash
+    };
+
+    struct Record;
+    typedef void (*ScanVisitor)(KV *store, const Record &record, void *context);
+
+    KV(const KV &) = delete;
+    KV &operator=(const KV &) = delete;
+
+    bool segmentPath(char *buf, size_t size, uint32_t id, bool hint) const;
+    int oldestSegment() const;
+    int findSlot(uint32_t hash, uint16_t check) const;
+    bool indexPut(const Record &record);
+    void indexRemove(const Record &record);
+    bool apply(const Record &record);
+    bool readAt(int seg, uint32_t offset, void *buf, size_t len);
+
+    /**
+     * @brief Read a segment's records in order, checking each CRC
+     * @param clean Set if the file ends after the last good record
+     * @param visit Called per record; nullptr applies them to the index
+     * @return Length of the segment up to the first bad record
+     */
+    uint32_t scanSegment(int seg, File &file, bool *clean, ScanVisitor visit, void *context);
+    bool loadHint(int seg);
+    bool writeHint(int seg);
+    bool openSegment();
+    /// @param torn The active segment ends in a partial record: never append to it again
+    bool roll(bool torn = false);
+    bool append(Record *record, const void *key, const void *value, size_t len, File *from);
+    int pickVictim(bool force) const;
+    bool compactSegment(int seg);
+    void schedule();
+
+    char dir[LOFS_PATH_MAX];
+    Options options;
+    LockDomain *domain;
+    Lock *lock;        ///< Guards everything below; held across the store's file I/O
+    Lock *compactLock; ///< One compact() at a time
+    Slot *slots;
+    uint32_t mask; ///< Slot count - 1
+    uint32_t keys;
+    Segment segments[LOFS_KV_MAX_SEGMENTS];
+    int active;       ///< Slot of the segment being appended to, -1 before begin()
+    File writer;      ///< Open for appending to the active segment
+    bool unsynced;    ///< writer has data not yet flushed
+    File reader;      ///< Last segment read by get()
+    int readerSeg;    ///< Slot reader belongs to, -1 if none
+    bool readerStale; ///< The active segment grew since reader was opened
+    bool pending;     ///< Background work requested
+    uint32_t compactions;
+    uint16_t hinted;
+    uint16_t scanned;
+    uint32_t beginMs;
+    KV *next; ///< Stores visited by the async worker
+};
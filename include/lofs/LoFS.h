@@ -2,6 +2,21 @@
 
 #define LOFS_VERSION "0.2.0"
 
+// Longest full path (with prefix) built internally by LoFS helpers
+#ifndef LOFS_PATH_MAX
+#define LOFS_PATH_MAX 256
+#endif
+
+// Default for CopyOptions::verify, and so for rename() across filesystems
+#ifndef LOFS_COPY_VERIFY
+#define LOFS_COPY_VERIFY 0
+#endif
+
+// Set LOFS_AUTO_TIER to 0 to drop the tiered /auto/ namespace
+#ifndef LOFS_AUTO_TIER
+#define LOFS_AUTO_TIER 1
+#endif
+
 #include "FSCommon.h"
 #include "configuration.h"
 #include <Stream.h>
@@ -24,8 +39,13 @@
  * Supports path prefixes:
  * - /internal/... -> routes to internal filesystem (onboard flash via FSCommon)
  * - /sd/...  -> routes to SD card (if available and HAS_SDCARD is defined)
+ * - /auto/... -> internal flash or SD, chosen per file (see FSType::AUTO)
+ * - /ram/...  -> RAM disk for scratch files, lost at reboot (ESP32 and Portduino)
+ * - /z/...    -> files stored compressed on internal flash (ESP32 and Portduino)
  * 
  * Paths without prefix default to internal filesystem for backward compatibility.
+ * Additional backends can be mounted at their own prefix with LoFS::mount()
+ * (see lofs/Backend.h).
  * 
  * Usage examples:
  *   // Open from internal filesystem
@@ -53,6 +73,20 @@
 class LoFS
 {
   public:
+    class Backend;
+
+    /// Latency-model wrapper for benchmarking; see lofs/SimBackend.h
+    class SimBackend;
+
+    /// In-memory filesystem with a byte budget (mounted at /ram/); see lofs/RamBackend.h
+    class RamBackend;
+
+    /// LZ-compressed view of a directory of another mount (mounted at /z/); see lofs/CompressedBackend.h
+    class CompressedBackend;
+
+    /// Read-only pack of small assets with an in-RAM index, mountable at a prefix; see lofs/Bundle.h
+    class Bundle;
+
     /**
      * @brief Open a file or directory
      * @param filepath Path with prefix (/internal/... or /sd/...)
@@ -73,6 +107,10 @@ class LoFS
      * @brief Check if file or directory exists
      * @param filepath Path with prefix
      * @return true if exists
+     *
+     * Answers (including "does not exist") are kept in a small hash-keyed
+     * cache (LOFS_DENTRY_CACHE_ENTRIES) until LoFS changes the path, so
+     * repeated checks skip the directory scan.
      */
     static bool exists(const char *filepath);
 
@@ -98,7 +136,7 @@ class LoFS
      * 
      * If both paths are on the same filesystem, performs a simple rename.
      * If paths are on different filesystems (e.g., /internal/file -> /sd/file),
-     * performs a copy + delete operation.
+     * performs a copy + delete operation (see move()).
      */
     static bool rename(const char *oldfilepath, const char *newfilepath);
 
@@ -110,15 +148,76 @@ class LoFS
      */
     static bool rmdir(const char *filepath, bool recursive = false);
 
+    /// Directory entry iterator; see lofs/DirIterator.h
+    class DirIterator;
+
+    /**
+     * @brief Callback for list()
+     * @param name Entry name without directory (only valid during the call)
+     * @param size File size in bytes (0 for directories)
+     * @param isDirectory true for subdirectories
+     * @param context Passed through from list()
+     * @return false to stop listing
+     */
+    typedef bool (*ListCallback)(const char *name, uint32_t size, bool isDirectory, void *context);
+
+    /**
+     * @brief Enumerate a directory without per-entry heap allocations
+     * @param dirpath Directory path with prefix
+     * @param callback Called once per entry ("." and ".." are skipped)
+     * @param context Passed through to callback
+     * @return false if the directory could not be opened
+     */
+    static bool list(const char *dirpath, ListCallback callback, void *context = nullptr);
+
     /**
      * @brief Check if SD card is available (compile-time and runtime check)
      * @return true if SD card is supported and present, false otherwise
      * 
      * This function works even when HAS_SDCARD is false (returns false).
      * Useful for checking SD card availability before attempting operations.
+     *
+     * The result is cached: once the card is present this is a flag read with
+     * no SPI traffic. While the card is missing, re-initialization is only
+     * attempted after an exponential backoff (see refreshSD()).
      */
     static bool isSDCardAvailable();
 
+    /**
+     * @brief Cached SD card state
+     */
+    enum class SDState : uint8_t {
+        ABSENT,   ///< No card (card-detect pin reports empty slot, or SD not compiled in)
+        PRESENT,  ///< Card initialized and usable
+        RETRYING  ///< Last init failed; next attempt after backoff
+    };
+
+    /**
+     * @brief Callback invoked when the SD card state changes (insert/remove)
+     */
+    typedef void (*SDStateCallback)(SDState state);
+
+    /**
+     * @brief Get the cached SD card state without probing the card
+     */
+    static SDState sdState();
+
+    /**
+     * @brief Force an immediate SD card re-probe, ignoring the backoff
+     * @return true if the card is present after the probe
+     *
+     * Call after a card swap when no card-detect pin is wired
+     * (LOFS_SD_DETECT_PIN). A card that was present is re-checked in place;
+     * it is only re-initialized, which invalidates open SD Files, once it
+     * stops answering.
+     */
+    static bool refreshSD();
+
+    /**
+     * @brief Register a hot-plug callback (nullptr to clear)
+     */
+    static void onSDStateChange(SDStateCallback callback);
+
     /**
      * @brief Get total space in bytes for the filesystem
      * @param filepath Path with prefix (/internal/... or /sd/...) - prefix determines filesystem
@@ -140,28 +239,694 @@ class LoFS
      */
     static uint64_t freeBytes(const char *filepath);
 
+    /**
+     * @brief Space figures of one filesystem
+     */
+    struct SpaceInfo {
+        uint64_t totalBytes;
+        uint64_t usedBytes;
+        uint64_t freeBytes;
+
+        SpaceInfo() : totalBytes(0), usedBytes(0), freeBytes(0) {}
+    };
+
+    /**
+     * @brief Get total, used and free space in one call
+     * @param filepath Path with prefix - prefix determines filesystem
+     * @return All zero if filesystem is invalid/unavailable
+     *
+     * Measured once per filesystem, then kept up to date from the bytes LoFS
+     * itself writes and removes. Figures older than LOFS_SPACE_RESYNC_MS are
+     * re-measured in the background (async worker, or inline on targets
+     * without one), so the call normally costs no flash access. Writes made
+     * through a File handle are picked up at the next re-measure.
+     * totalBytes(), usedBytes() and freeBytes() read the same figures.
+     */
+    static SpaceInfo spaceInfo(const char *filepath);
+
+    /**
+     * @brief Drop cached space figures so the next spaceInfo() measures again
+     *
+     * Called automatically when the SD card is inserted or removed.
+     */
+    static void invalidateSpaceInfo();
+
+    /**
+     * @brief Drop cached space figures of one backend
+     */
+    static void invalidateSpaceInfo(Backend *backend);
+
     /**
      * @brief Filesystem type enum for specifying which filesystem to use
      */
     enum class FSType : int {
-        AUTO = -1,  ///< Auto-select: use SD if available, otherwise INTERNAL
+        AUTO = -1,  ///< Tiered: /auto/ paths live on INTERNAL while hot, on SD once idle or large
         INTERNAL = 0,    ///< Internal filesystem (onboard flash via FSCommon)
         SD = 1,     ///< SD Card (if available)
         INVALID     ///< Invalid filesystem type (internal use)
     };
 
-  private:
+    /**
+     * @brief Filesystem a path currently maps to
+     * @return INTERNAL or SD (for /auto/ paths, the tier holding the file); INVALID for
+     *         unavailable paths and other mounts
+     */
+    static FSType fsTypeOf(const char *filepath);
+
+    /**
+     * @brief Move an /auto/ file to a tier now instead of waiting for the background scan
+     * @param filepath Path starting with /auto/
+     * @param tier FSType::INTERNAL or FSType::SD
+     * @return true if the file is on that tier afterwards; false if the move needs an absent SD
+     *         card, the file is open (where open files are tracked: ESP32, Portduino) or it was
+     *         used while being copied
+     */
+    static bool migrate(const char *filepath, FSType tier);
 
     /**
-     * @brief Parse path prefix and return filesystem type and stripped path
+     * @brief Schedule a tier scan of /auto/ files
+     *
+     * Scans normally run every LOFS_AUTO_SCAN_MS while /auto/ is in use and
+     * right after an SD card is inserted. They run on the async worker, or
+     * from processAsync() on targets without one.
+     */
+    static void rebalanceAuto();
+
+    /**
+     * @brief Mount a backend at a single-segment prefix
+     * @param prefix Mount prefix, e.g. "/ext/" (leading/trailing slashes optional)
+     * @param backend Backend instance; must outlive the mount
+     * @return false if the prefix is invalid, already mounted, or the table is full
+     *
+     * /internal/ and /sd/ are mounted by default. Mounting is not thread-safe;
+     * do it during startup before other tasks use LoFS.
+     */
+    static bool mount(const char *prefix, Backend *backend);
+
+    /**
+     * @brief Remove a mount
+     * @param prefix Mount prefix as passed to mount()
+     * @return true if the prefix was mounted
+     */
+    static bool unmount(const char *prefix);
+
+    /**
+     * @brief Resolve a path to its backend without performing any I/O
      * @param filepath Full path with prefix
-     * @param strippedPath Output buffer for path without prefix (must be at least strlen(filepath)+1)
-     * @return Filesystem type
+     * @param strippedPath Output buffer for the backend-relative path
+     * @param bufferSize Size of strippedPath (at least strlen(filepath)+2)
+     * @return Backend serving the path, or nullptr if invalid/unavailable
+     *
+     * Exposed so the routing cost can be measured on its own.
+     */
+    static Backend *resolve(const char *filepath, char *strippedPath, size_t bufferSize);
+
+    /// Path on /internal/ or /sd/ routed at compile time, skipping resolve(); see lofs/Direct.h
+    template <FSType T> class Direct;
+
+    /**
+     * @brief Copy progress callback
+     * @param copied Bytes of the destination written so far (including resumed bytes)
+     * @param total Source file size
+     * @param context CopyOptions::context
+     * @return false to cancel the copy
+     */
+    typedef bool (*CopyProgressCallback)(uint64_t copied, uint64_t total, void *context);
+
+    /**
+     * @brief Tuning for copy() / move()
+     */
+    struct CopyOptions {
+        size_t bufferSize;             ///< Chunk size, rounded up to a multiple of 512 (default 4096)
+        CopyProgressCallback progress; ///< Called after every chunk
+        void *context;                 ///< Passed through to progress
+        bool resume;                   ///< Append to a partial destination instead of restarting
+        bool verify;                   ///< Re-read the destination and compare CRC32s (default LOFS_COPY_VERIFY)
+
+        CopyOptions() : bufferSize(4096), progress(nullptr), context(nullptr), resume(false), verify(LOFS_COPY_VERIFY)
+        {
+        }
+    };
+
+    /**
+     * @brief Result of a copy() / move()
+     */
+    struct CopyStats {
+        uint64_t bytesCopied; ///< Bytes written by this call (excludes resumed prefix)
+        uint32_t elapsedMs;   ///< Wall time spent copying
+        uint32_t chunks;      ///< Number of read/write rounds
+        uint32_t verifyMs;    ///< Part of elapsedMs spent re-reading the destination (options.verify)
+        uint32_t crc;         ///< CRC32 of the whole source file (options.verify)
+
+        CopyStats() : bytesCopied(0), elapsedMs(0), chunks(0), verifyMs(0), crc(0) {}
+    };
+
+    /**
+     * @brief Copy a file, within or across filesystems
+     * @param srcpath Source path with prefix
+     * @param dstpath Destination path with prefix (replaced unless options.resume)
+     * @param options Buffer size, progress/cancel callback, resume
+     * @param stats Optional output for throughput measurement
+     * @return true if the whole file was copied
+     *
+     * The SPI lock is released between chunks so other SPI users (radio,
+     * display) are not starved during large copies. With options.resume an
+     * existing shorter destination is treated as an already-copied prefix and
+     * is kept when the copy fails or is cancelled.
+     *
+     * With options.verify the CRC32 of the source is computed while copying
+     * (a resumed prefix is read from the source as well) and the destination
+     * is read back and compared. A mismatch fails the copy and removes the
+     * destination, resumed or not.
+     */
+    static bool copy(const char *srcpath, const char *dstpath, const CopyOptions &options = CopyOptions(),
+                     CopyStats *stats = nullptr);
+
+    /**
+     * @brief Move a file: rename on the same filesystem, copy + delete across filesystems
+     * @return true if successful; the source is only removed after a complete copy
+     *
+     * With options.verify (or LOFS_COPY_VERIFY=1 for rename()) the source is
+     * only removed once the copy has been read back and matches.
+     */
+    static bool move(const char *srcpath, const char *dstpath, const CopyOptions &options = CopyOptions(),
+                     CopyStats *stats = nullptr);
+
+    /**
+     * @brief CRC-32 (IEEE 802.3, as zlib and PNG) of a buffer
+     * @param crc Result of the previous call when checksumming in pieces, 0 to start
+     *
+     * Slice-by-8 with tables built on first use; see LOFS_CRC32_SLICES.
+     */
+    static uint32_t crc32(const void *data, size_t len, uint32_t crc = 0);
+
+    /**
+     * @brief CRC-32 of a file's contents
+     * @param crc Receives the checksum
+     * @return false if the path cannot be opened as a file
      */
-    static FSType parsePath(const char *filepath, char *strippedPath, size_t bufferSize);
+    static bool checksum(const char *filepath, uint32_t *crc);
+
+    /**
+     * @brief How sync() decides that a destination file is already up to date
+     */
+    enum class SyncCompare : uint8_t {
+        METADATA, ///< Same size and not older than the source (size only where File has no getLastWrite())
+        CHECKSUM, ///< Same size and same CRC32; reads both files when the sizes match
+    };
+
+    /**
+     * @brief Tuning for sync()
+     */
+    struct SyncOptions {
+        SyncCompare compare;   ///< Up-to-date test (default METADATA)
+        bool deleteExtraneous; ///< Remove destination entries missing from the source
+        CopyOptions copy;      ///< Chunk size and progress/cancel callback for each copied file
+
+        SyncOptions() : compare(SyncCompare::METADATA), deleteExtraneous(false) {}
+    };
+
+    /**
+     * @brief Result of a sync()
+     */
+    struct SyncStats {
+        uint32_t filesCopied;  ///< New or changed files written
+        uint32_t filesSkipped; ///< Files found up to date
+        uint32_t filesDeleted; ///< Extraneous files and directories removed
+        uint32_t errors;       ///< Entries that could not be synced (copy failed, path too long, too deep)
+        uint64_t bytesCopied;  ///< Bytes written by this call (excludes resumed prefixes)
+        uint64_t bytesSkipped; ///< Size of the files found up to date
+        uint32_t elapsedMs;    ///< Wall time of the whole sync
+
+        SyncStats()
+            : filesCopied(0), filesSkipped(0), filesDeleted(0), errors(0), bytesCopied(0), bytesSkipped(0), elapsedMs(0)
+        {
+        }
+    };
+
+    /**
+     * @brief Mirror a directory tree, copying only new or changed files
+     * @param srcDir Source directory with prefix
+     * @param dstDir Destination directory with prefix (created if missing)
+     * @param options Comparison, deletion of extraneous entries, copy tuning
+     * @param stats Optional output: files and bytes copied vs. skipped
+     * @return true if every entry was synced
+     *
+     * Files are copied to a temp sibling and renamed into place, so an
+     * interrupted run never leaves a truncated file under the real name. The
+     * next run skips what is already up to date and, where it can tell the
+     * source has not changed since (mtime, or CHECKSUM verification), resumes
+     * the partial temp file instead of starting over. Directories deeper than
+     * LOFS_SYNC_MAX_DEPTH below srcDir are not synced.
+     */
+    static bool sync(const char *srcDir, const char *dstDir, const SyncOptions &options = SyncOptions(),
+                     SyncStats *stats = nullptr);
+
+    /// Asynchronous request types; see lofs/Async.h
+    struct AsyncOp;
+    struct AsyncStats;
+    enum class AsyncStatus : uint8_t;
+    typedef uint32_t AsyncHandle;
+
+    /**
+     * @brief Completion callback for submit(); runs on the worker task
+     */
+    typedef void (*AsyncCallback)(AsyncHandle handle, bool ok, void *context);
+
+    /**
+     * @brief Queue a write/remove/rename/rmdir to run in the background
+     * @param op Operation; paths and data are copied, so the caller's buffers may be reused
+     * @return Handle for poll(), or 0 if the queue is full or out of memory
+     */
+    static AsyncHandle submit(const AsyncOp &op);
+
+    /**
+     * @brief Get the status of a submitted request
+     * @return AsyncStatus::UNKNOWN once the handle has been recycled
+     */
+    static AsyncStatus poll(AsyncHandle handle);
+
+    /**
+     * @brief Run all queued requests on the calling thread
+     *
+     * Background maintenance (space re-measures, /auto/ tier scans, KV
+     * compaction) runs here too, with the queue drained again between jobs.
+     * Called by the worker task on ESP32 and Portduino. Other targets have no
+     * worker and must call this from their main loop.
+     */
+    static void processAsync();
+
+    /**
+     * @brief Snapshot of async queue depth and latency counters
+     */
+    static AsyncStats asyncStats();
+
+    /// Instrumentation snapshot; see lofs/Stats.h
+    struct Stats;
+
+    /**
+     * @brief Copy per-operation, per-backend and lock counters
+     * @param out Receives the snapshot (several KB; keep it off the stack)
+     * @return false if LoFS was built without LOFS_STATS (out is left untouched)
+     */
+    static bool stats(Stats *out);
+
+    /**
+     * @brief Zero all instrumentation counters
+     */
+    static void resetStats();
+
+    /// Binary semaphore behind LoFS's own locks (a real mutex on Portduino); see lofs/Lock.h
+    class Lock;
+
+    /// Per-backend lock, possibly shared by readers; see lofs/LockDomain.h
+    class LockDomain;
+
+    /// Block-cached reader; see lofs/CachedFile.h
+    class CachedFile;
+
+    /**
+     * @brief Block cache counters
+     */
+    struct CacheStats {
+        uint32_t hits;          ///< Block lookups served from RAM
+        uint32_t misses;        ///< Block lookups that read from the backend
+        uint32_t evictions;     ///< Valid blocks dropped to make room
+        uint32_t invalidations; ///< Blocks dropped by writes, remove or rename
+        uint16_t blocks;        ///< Cache capacity in blocks (LOFS_BLOCK_CACHE_BLOCKS)
+        uint16_t blockSize;     ///< Bytes per block (LOFS_BLOCK_CACHE_BLOCK_SIZE)
+    };
+
+    /**
+     * @brief Open a file for reading through the shared LRU block cache
+     * @param filepath Path with prefix (intended for /sd/...)
+     * @return Reader with the File read API; evaluates false if the file could not be opened
+     *
+     * Blocks stay valid until LoFS itself writes, removes or renames the file.
+     * Writes made through a File obtained elsewhere are not seen by the cache.
+     */
+    static CachedFile openCached(const char *filepath);
+
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+    /**
+     * @brief openCached() behind a plain read-only File, for code written against File
+     *
+     * Built on the ESP32-style fs::FileImpl, so available on ESP32 and Portduino only.
+     * @return File that evaluates false if the file could not be opened; writes are rejected
+     */
+    static File openCachedFile(const char *filepath);
+#endif
+
+    /**
+     * @brief Snapshot of block cache counters
+     */
+    static CacheStats cacheStats();
+
+    /**
+     * @brief Zero the block cache hit/miss/eviction counters
+     */
+    static void resetCacheStats();
+
+    /**
+     * @brief Forget every cached exists() result
+     *
+     * Needed only after files were created or deleted behind LoFS's back
+     * (e.g. directly through FSCom or SD). Called automatically when the SD
+     * card is inserted or removed.
+     */
+    static void flushExistsCache();
+
+    /**
+     * @brief Forget cached exists() results for one backend
+     */
+    static void flushExistsCache(Backend *backend);
+
+    /// Batched, rotating record log; see lofs/AppendLog.h
+    class AppendLog;
+
+    /// Streaming crash-safe file replacement; see lofs/AtomicWriter.h
+    class AtomicWriter;
+
+    /**
+     * @brief Replace a file's contents crash-safely
+     * @param filepath Path with prefix
+     * @param data New contents
+     * @param len Length of data
+     * @param changed Optional output: false if the file already held exactly this data
+     * @return true if the file now holds data
+     *
+     * Writes a temp sibling and renames it over the target, so a power loss
+     * leaves either the old or the new contents. If the existing file already
+     * matches, nothing is written (no flash erase).
+     */
+    static bool writeAtomic(const char *filepath, const void *data, size_t len, bool *changed = nullptr);
+
+    /**
+     * @brief Finish or discard interrupted atomic writes in one directory
+     * @param dirpath Directory with prefix
+     * @return Number of leftover temp files deleted or moved into place
+     *
+     * Call once at boot for each directory written with writeAtomic() or
+     * AtomicWriter. Incomplete temp files are deleted; fully written ones
+     * whose final rename was interrupted are moved into place. The directory
+     * is listed once; a leftover that cannot be handled is skipped and left
+     * for the next call.
+     */
+    static int recoverAtomic(const char *dirpath);
+
+    /// exists/mkdir/remove/rmdir run with one lock hold per backend; see lofs/Batch.h
+    class Batch;
+
+    /// Page-coalescing writer; see lofs/BufferedFile.h
+    class BufferedFile;
+
+    /**
+     * @brief Options for a buffered open()
+     */
+    struct Buffered {
+        size_t size;      ///< Buffer bytes, rounded up to whole LOFS_WRITE_PAGE_SIZE pages
+        uint32_t flushMs; ///< Write out data buffered longer than this; 0 = only when full, on sync() and close()
+
+        explicit Buffered(size_t size = 1024, uint32_t flushMs = 0) : size(size), flushMs(flushMs) {}
+    };
+
+    /**
+     * @brief Write amplification counters of buffered writes
+     *
+     * "Programmed" figures are estimates: every write handed to the filesystem
+     * is charged the whole LOFS_WRITE_PAGE_SIZE pages it touches. Compare
+     * programmedBytes with unbufferedProgrammedBytes to see what buffering
+     * saved, and with requestedBytes for the remaining amplification.
+     */
+    struct WriteStats {
+        uint64_t requestedBytes;            ///< Bytes passed to write()
+        uint32_t requestedWrites;           ///< write() calls
+        uint64_t writtenBytes;              ///< Bytes handed to the filesystem
+        uint32_t backendWrites;             ///< Writes handed to the filesystem
+        uint64_t programmedBytes;           ///< Pages touched by those writes
+        uint64_t unbufferedProgrammedBytes; ///< Pages the same write() calls would touch unbuffered
+    };
+
+    /**
+     * @brief Open a file for writing through a page-aligned RAM buffer
+     * @param filepath Path with prefix (intended for /internal/...)
+     * @param mode "w" or "a"; reading is not supported
+     * @param options Buffer size and time-based flush
+     * @return Writer with the Print API; evaluates false if the file could not be opened
+     *
+     * Small writes are gathered and handed to the filesystem in whole pages,
+     * saving flash programs for logs and other many-small-write files.
+     * Buffered data is written on sync(), close() and when options.flushMs
+     * has passed. If the buffer cannot be allocated, writes go straight through.
+     */
+    static BufferedFile open(const char *filepath, const char *mode, const Buffered &options);
+
+    /**
+     * @brief Totals over all buffered files since boot or resetWriteStats()
+     */
+    static WriteStats writeStats();
+
+    /**
+     * @brief Zero the buffered write counters
+     */
+    static void resetWriteStats();
+
+    /// Append-only file with space allocated ahead of the data; see lofs/ReservedFile.h
+    class ReservedFile;
+
+    /**
+     * @brief Open a file for appending with space reserved ahead of the data
+     * @param filepath Path with prefix (intended for /sd/...)
+     * @param bytes Space to allocate past the current end of data, and the step it grows by
+     * @return Writer with the Print API; evaluates false if the file could not be opened
+     *
+     * The file is padded out to its end of data plus bytes, so appends
+     * overwrite already allocated space instead of extending the FAT cluster
+     * chain and directory entry on every flush. close() cuts the unused space
+     * off again. Reopening after a crash finds the end of data from the
+     * marker file left beside it. Internal flash and targets without
+     * read/write opens get a plain append.
+     */
+    static ReservedFile reserve(const char *filepath, uint32_t bytes);
+
+    /// Log-structured key-value store; see lofs/KV.h
+    class KV;
+
+    /// Path parsed and routed once, for paths used over and over; see lofs/Path.h
+    class Path;
+
+    /**
+     * @brief The calls above for a Path
+     *
+     * open(), exists(), mkdir(), remove(), rmdir() and list() use the backend
+     * and backend path the Path already resolved; the others take c_str().
+     */
+    static File open(const Path &path, uint8_t mode);
+    static File open(const Path &path, const char *mode);
+    static BufferedFile open(const Path &path, const char *mode, const Buffered &options);
+    static bool exists(const Path &path);
+    static bool mkdir(const Path &path);
+    static bool remove(const Path &path);
+    static bool rename(const Path &oldpath, const Path &newpath);
+    static bool rmdir(const Path &path, bool recursive = false);
+    static bool list(const Path &dirpath, ListCallback callback, void *context = nullptr);
+    static uint64_t totalBytes(const Path &path);
+    static uint64_t usedBytes(const Path &path);
+    static uint64_t freeBytes(const Path &path);
+    static SpaceInfo spaceInfo(const Path &path);
+    static FSType fsTypeOf(const Path &path);
+    static bool migrate(const Path &path, FSType tier);
+    static bool copy(const Path &srcpath, const Path &dstpath, const CopyOptions &options = CopyOptions(),
+                     CopyStats *stats = nullptr);
+    static bool move(const Path &srcpath, const Path &dstpath, const CopyOptions &options = CopyOptions(),
+                     CopyStats *stats = nullptr);
+    static bool checksum(const Path &path, uint32_t *crc);
+    static bool sync(const Path &srcDir, const Path &dstDir, const SyncOptions &options = SyncOptions(),
+                     SyncStats *stats = nullptr);
+    static CachedFile openCached(const Path &path);
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+    static File openCachedFile(const Path &path);
+#endif
+    static bool writeAtomic(const Path &path, const void *data, size_t len, bool *changed = nullptr);
+    static int recoverAtomic(const Path &dirpath);
+    static ReservedFile reserve(const Path &path, uint32_t bytes);
+
+  private:
 
     /**
      * @brief Get stripped path (helper that allocates buffer)
+     * @return Backend serving the path, or nullptr if invalid/unavailable
+     */
+    static Backend *parsePath(const char *filepath, char **strippedPath);
+
+    /**
+     * @brief open/exists/mkdir/remove on a resolved path (shared by the path API and Direct)
+     */
+    static File openResolved(Backend *backend, const char *strippedPath, const char *mode);
+    static bool existsResolved(Backend *backend, const char *strippedPath);
+    static bool mkdirResolved(Backend *backend, const char *strippedPath);
+    static bool removeResolved(Backend *backend, const char *strippedPath);
+
+    /**
+     * @brief rmdir() on a resolved path
+     * @param path Backend path in a LOFS_PATH_MAX buffer; removeTree() extends it in place
+     */
+    static bool rmdirResolved(Backend *backend, char *path, bool recursive);
+
+    /**
+     * @brief Bumped by mount() and unmount(), so a Path can tell its cached route is stale
+     */
+    static uint32_t mountGeneration();
+
+    /**
+     * @brief Backend built in at /internal/ or /sd/, whatever is mounted there now
+     */
+    static Backend *builtinBackend(FSType type);
+
+    /**
+     * @brief resolve(), optionally without asking the backend whether it is available
+     *
+     * Backends forwarding to another mount route their calls with
+     * checkAvailable false, since they run under the target's lock: for /sd/
+     * the check may probe the card, which takes spiLock again.
+     */
+    static Backend *resolveRoute(const char *filepath, char *strippedPath, size_t bufferSize, bool checkAvailable);
+
+    /**
+     * @brief Store the target directory of a forwarding backend (SimBackend, CompressedBackend)
+     * @param target Buffer of LOFS_PATH_MAX bytes; receives the path without trailing slashes
+     */
+    static void setTarget(char *target, const char *path);
+
+    /**
+     * @brief Map a path of a forwarding backend to its target's backend and stripped path
+     *
+     * No availability check (see resolveRoute()); targetAvailable() covers it
+     * before any lock is taken.
+     */
+    static Backend *mapTarget(const char *target, const char *path, char *strippedPath, size_t bufferSize);
+
+    /**
+     * @brief Whether a forwarding backend's target resolves and its backend is available
+     */
+    static bool targetAvailable(const char *target);
+
+    /**
+     * @brief Lock domain of a forwarding backend's target (SPI domain if it does not resolve)
+     */
+    static LockDomain &targetLockDomain(const char *target);
+
+    /**
+     * @brief Map a path below /auto/ to the tier holding it (new files: internal flash)
+     * @param rel Path after "/auto", starting with '/'
+     */
+    static Backend *resolveAuto(const char *rel, char *strippedPath, size_t bufferSize);
+
+    /**
+     * @brief Count a user access to an /auto/ path towards tiering; other paths are ignored
+     *
+     * Called where a path enters the API, not from resolveAuto(), so LoFS's
+     * own re-resolves of a path do not count as extra accesses.
+     */
+    static void touchAuto(const char *filepath);
+
+    /**
+     * @brief Count an opened /auto/ file as open until the returned File closes, so it is not moved
+     * @param backend Backend the file was opened on; gives the tier of a file not indexed yet
+     */
+    static File holdAuto(const char *filepath, Backend *backend, File file);
+
+    /**
+     * @brief Demote idle or large /auto/ files to SD and promote busy small ones (runs on the async worker)
+     */
+    static void scanAuto();
+
+    /**
+     * @brief Write hint files and compact segments of KV stores that asked for it (runs on the async worker)
+     */
+    static void compactKV();
+
+    /**
+     * @brief Run the submit() queue until it is empty (returns at once if another thread is at it)
+     */
+    static void drainAsync();
+
+    /**
+     * @brief Lock domain of the backend serving a path (SPI domain if it does not resolve)
+     */
+    static LockDomain &lockDomain(const char *filepath);
+
+    /**
+     * @brief Chunked copy between two resolved paths (shared by copy() and move())
+     */
+    static bool copyFile(Backend *srcBackend, const char *srcPath, Backend *dstBackend, const char *dstPath,
+                         const CopyOptions &options, CopyStats *stats);
+
+    /**
+     * @brief Drop cached blocks of a file that is about to change
+     * @param subtree Also drop every file below the path (directory about to be renamed or removed)
+     */
+    static void invalidateCache(Backend *backend, const char *strippedPath, bool subtree = false);
+
+    /**
+     * @brief Look up a cached exists() result
+     * @param generation Receives the cache generation to pass to dentryStore()
+     * @return true on a hit (*exists is set)
+     */
+    static bool dentryLookup(Backend *backend, const char *strippedPath, bool *exists, uint32_t *generation);
+
+    /**
+     * @brief Cache an exists() result unless the cache changed since @p generation
+     */
+    static void dentryStore(Backend *backend, const char *strippedPath, bool exists, uint32_t generation);
+
+    /**
+     * @brief Drop cached results for a path that just changed, and for its ancestors
+     * @param subtree Also drop anything that may lie below the path (removed or renamed directory)
+     * @return New cache generation
+     */
+    static uint32_t dentryForget(Backend *backend, const char *strippedPath, bool subtree);
+
+    /**
+     * @brief Record the known outcome of a successful mutation
+     */
+    static void dentrySet(Backend *backend, const char *strippedPath, bool exists);
+
+    /**
+     * @brief Whether space figures are cached for a backend (worth sizing removed files)
+     */
+    static bool spaceTracked(Backend *backend);
+
+    /**
+     * @brief Apply bytes LoFS added (positive) or freed (negative) to cached space figures
+     */
+    static void spaceAdjust(Backend *backend, int64_t delta);
+    static void spaceAdjust(const char *filepath, int64_t delta);
+
+    /**
+     * @brief Request a background re-measure after changes too large to track
+     */
+    static void spaceStale(Backend *backend);
+
+    /**
+     * @brief Re-measure space figures flagged for resync (runs on the async worker)
+     */
+    static void resyncSpace();
+
+    /**
+     * @brief Size of a file, 0 if missing or a directory (caller holds the backend's lock)
+     */
+    static uint64_t fileLength(Backend *backend, const char *strippedPath);
+
+    /**
+     * @brief Wake the async worker
+     * @return false if this target has no worker (LOFS_ASYNC_WORKER is 0)
+     */
+    static bool wakeAsync();
+
+    /**
+     * @brief Delete a directory tree iteratively (one open directory at a time)
+     * @param path Stripped directory path; used as scratch space, capacity LOFS_PATH_MAX
      */
-    static FSType parsePath(const char *filepath, char **strippedPath);
+    static bool removeTree(Backend *backend, char *path);
 };
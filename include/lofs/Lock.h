@@ -0,0 +1,61 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+#ifdef ARCH_PORTDUINO
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace concurrency
+{
+class Lock;
+}
+
+/**
+ * @brief Binary semaphore behind LoFS's own locks
+ *
+ * On FreeRTOS targets this is the firmware's concurrency::Lock. Without
+ * HAS_FREE_RTOS that class has empty lock()/unlock(), which is fine where
+ * LoFS runs on one thread but not on Portduino, whose async worker is a
+ * std::thread. There a std::mutex and condition variable stand in. In both
+ * cases the lock may be released by another thread than the one that took
+ * it, as LoFS::LockDomain's shared readers require.
+ *
+ * Locks are created up front, never on first use: as members of their
+ * owner, or at static initialization for LoFS's module-wide locks. The
+ * latter are never freed, so the async worker can still take them while
+ * the process exits.
+ */
+class LoFS::Lock
+{
+  public:
+    Lock();
+    ~Lock();
+
+    void lock();
+    void unlock();
+
+    /// Holds a Lock for one scope
+    class Guard
+    {
+      public:
+        explicit Guard(Lock *lock) : lock(lock) { lock->lock(); }
+        ~Guard() { lock->unlock(); }
+
+      private:
+        Lock *lock;
+    };
+
+  private:
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
+
+#ifdef ARCH_PORTDUINO
+    std::mutex mutex;
+    std::condition_variable released;
+    bool held;
+#else
+    concurrency::Lock *impl;
+#endif
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+#include <lofs/Stats.h>
+
+/**
+ * @brief Lock protecting one or more backends
+ *
+ * Each backend names the domain its calls must run under. Backends on the
+ * radio's SPI bus share the SPI domain (spiLock, or one LoFS::Lock on
+ * Portduino, where spiLock does nothing); a backend with its own storage
+ * path can get a dedicated lock so its I/O no longer waits behind SD
+ * transfers.
+ *
+ * A domain may allow shared reads: readers then run concurrently and only
+ * writers exclude each other and the readers. Enable it only when the
+ * underlying filesystem is safe for concurrent readers (e.g. it has its own
+ * internal lock, like the ESP32 VFS, or it is the host filesystem).
+ *
+ * Usage example:
+ *   class MyFlashChip : public LoFS::Backend {
+ *       LoFS::LockDomain domain{LoFS::LockDomain::Kind::OWN, true};
+ *     public:
+ *       LoFS::LockDomain &lockDomain() override { return domain; }
+ *       ...
+ *   };
+ */
+class LoFS::LockDomain
+{
+  public:
+    enum class Kind : uint8_t {
+        SPI, ///< Share spiLock with the radio and other SPI users
+        OWN, ///< Dedicated lock
+    };
+
+    explicit LockDomain(Kind kind, bool sharedReads = false);
+
+    /// Domain of everything on the SPI bus (SD card; default for custom backends)
+    static LockDomain &spi();
+
+    void lock();
+    void unlock();
+
+    /// Shared access for readers; same as lock() unless the domain allows shared reads
+    void lockShared();
+    void unlockShared();
+
+    bool sharedReads() const { return shared; }
+
+    /// Wait/hold time of acquisitions made through this domain (collected with LOFS_STATS)
+    const Stats::LockCounters &lockCounters() const { return counters; }
+    void resetLockCounters();
+
+    /// Exclusive access for one scope
+    class Guard
+    {
+      public:
+        explicit Guard(LockDomain &domain) : domain(domain) { domain.lock(); }
+        ~Guard() { domain.unlock(); }
+
+      private:
+        LockDomain &domain;
+    };
+
+    /// Shared (reader) access for one scope
+    class SharedGuard
+    {
+      public:
+        explicit SharedGuard(LockDomain &domain) : domain(domain) { domain.lockShared(); }
+        ~SharedGuard() { domain.unlockShared(); }
+
+      private:
+        LockDomain &domain;
+    };
+
+    /**
+     * @brief Exclusive access to two domains for one scope
+     *
+     * Locks are always taken in address order of the underlying lock, so two
+     * threads working on the same pair in opposite directions cannot
+     * deadlock. Domains sharing one lock are locked once.
+     */
+    class PairGuard
+    {
+      public:
+        PairGuard(LockDomain &a, LockDomain &b);
+        ~PairGuard();
+
+      private:
+        LockDomain *first;
+        LockDomain *second; ///< nullptr when both domains share a lock
+    };
+
+  private:
+    LockDomain(const LockDomain &) = delete;
+    LockDomain &operator=(const LockDomain &) = delete;
+
+    /// Take / release the underlying lock (no counters)
+    void acquire();
+    void release();
+
+    /// Identity of the underlying lock, for PairGuard's ordering
+    const void *lockId();
+
+    Lock *own;  ///< Kind::OWN lock, or the host SPI lock on Portduino; nullptr = spiLock
+    Lock *gate; ///< Guards readers (shared reads only)
+    uint16_t readers;        ///< Active shared holders
+    Kind kind;
+    bool shared;
+    Stats::LockCounters counters;
+    uint32_t heldSinceUs;    ///< micros() when the current exclusive holder got the lock
+};
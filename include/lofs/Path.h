@@ -0,0 +1,94 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/**
+ * @brief A path parsed and routed once, for paths used over and over
+ *
+ * The string API resolves its path on every call: a heap copy, the mount
+ * table lookup and slash fix-ups. A Path does that once when it is built.
+ * It keeps the normalized path in an inline buffer (repeated '/' collapsed,
+ * trailing '/' dropped except after the mount name, as in "/sd/") together
+ * with the backend it maps to, and the backend's view of the path is a
+ * suffix of that buffer. The Path overloads of open(), exists(), mkdir(),
+ * remove(), rmdir() and list() go straight to the backend; the other calls
+ * take c_str().
+ *
+ * join() and parent() derive a new Path by copying and cutting the buffer;
+ * while the result stays below the same mount, the route is inherited
+ * instead of looked up again. Nothing is allocated on the heap.
+ *
+ * The route is re-checked cheaply on use: SD paths fail while no card is
+ * present, and a Path built before mount() or unmount() resolves its string
+ * again. /auto/ paths are never cached, since the tier can change.
+ *
+ * Usage example:
+ *   LoFS::Path logs("/sd/logs");
+ *   LoFS::Path today = logs.join("2024-06-01.txt");
+ *   if (!LoFS::exists(today)) {
+ *       LoFS::mkdir(logs);
+ *   }
+ *   File f = LoFS::open(today, "a");
+ */
+class LoFS::Path
+{
+  public:
+    /// Empty path; evaluates false and every call on it fails
+    Path();
+
+    /**
+     * @param filepath Path with prefix; evaluates false if it is empty or does not fit LOFS_PATH_MAX
+     */
+    explicit Path(const char *filepath);
+
+    /**
+     * @brief Path of an entry in this directory
+     * @param name Entry name, or a relative path ("a/b.txt")
+     */
+    Path join(const char *name) const;
+
+    /// Containing directory ("/sd/a" of "/sd/a/b.txt", "/sd/" of "/sd/a"); "/" for "/" and mount roots
+    Path parent() const;
+
+    /// Last component ("b.txt" of "/sd/a/b.txt"); empty for "/" and mount roots
+    const char *filename() const;
+
+    /// Normalized path with prefix
+    const char *c_str() const { return full; }
+    size_t length() const { return len; }
+
+    /// false if the path was empty or too long
+    explicit operator bool() const { return len > 0; }
+
+  private:
+    friend class LoFS;
+    friend class DirIterator;
+
+    /**
+     * @brief Append text, collapsing repeated '/' and dropping a trailing one
+     * @return false (and the path empty) if the result does not fit
+     */
+    bool append(const char *text);
+
+    /// Look the route up for the current contents of full
+    void lookup();
+
+    /// Offset of the '/' ending the first component ("/sd/..."), 0 if there is none
+    size_t firstSlash() const;
+
+    /// Cached route is still valid (mount table unchanged)
+    bool routed() const;
+
+    /**
+     * @brief Backend and backend-style path
+     * @param buf Scratch space, used only when the path has no cached route
+     * @return nullptr if the path is empty, its backend unavailable or the path invalid
+     */
+    Backend *route(char *buf, size_t size, const char **strippedPath) const;
+
+    char full[LOFS_PATH_MAX];
+    Backend *backend;    ///< Cached route; nullptr = resolve full on each use (/auto/, SD absent when built)
+    uint32_t generation; ///< Mount table generation the route was taken from
+    uint16_t len;
+    uint16_t offset; ///< Start of the backend path in full
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+// The RAM disk hands out File objects through the ESP32-style fs::FileImpl,
+// which exists on ESP32 and Portduino only
+#ifndef LOFS_RAMDISK
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define LOFS_RAMDISK 1
+#else
+#define LOFS_RAMDISK 0
+#endif
+#endif
+
+// Byte budget of the built-in /ram/ mount; 0 leaves /ram/ unmounted
+#ifndef LOFS_RAM_BYTES
+#ifdef ARCH_PORTDUINO
+#define LOFS_RAM_BYTES (4UL * 1024 * 1024)
+#else
+#define LOFS_RAM_BYTES 16384
+#endif
+#endif
+
+#if LOFS_RAMDISK
+/**
+ * @brief In-memory filesystem with a hard byte budget
+ *
+ * Files and directories live on the heap and vanish at reboot, which makes
+ * the RAM disk a good place for scratch and staging files: writes cost no
+ * flash erase and no SPI transfer. Memory is only taken as files grow, and
+ * nothing is allocated once the budget is reached, so writes come back short
+ * like on a full disk. The budget covers file data plus a small per-entry
+ * overhead. totalBytes() is the budget and usedBytes() the part in use.
+ *
+ * A file removed while open stays readable through that handle until it
+ * is closed, like on LittleFS.
+ *
+ * An instance is mounted at /ram/ with LOFS_RAM_BYTES. More can be mounted
+ * at other prefixes:
+ *   static LoFS::RamBackend staging(64 * 1024);
+ *   LoFS::mount("/staging/", &staging);
+ *   LoFS::copy("/sd/fw.bin", "/staging/fw.bin");
+ */
+class LoFS::RamBackend : public LoFS::Backend
+{
+  public:
+    /**
+     * @param budget Most bytes the disk may hold, including per-entry overhead
+     */
+    explicit RamBackend(size_t budget);
+    ~RamBackend() override;
+
+    LockDomain &lockDomain() override { return domain; }
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *oldpath, const char *newpath) override;
+    bool rmdir(const char *path) override;
+    uint64_t totalBytes() override { return budget; }
+    uint64_t usedBytes() override { return used; }
+
+  private:
+    struct Node;
+    class Handle;
+
+    RamBackend(const RamBackend &) = delete;
+    RamBackend &operator=(const RamBackend &) = delete;
+
+    Node *lookup(const char *path, size_t len);
+    Node *lookupParent(const char *path, const char **leaf, size_t *leafLen);
+    Node *create(const char *path, bool isDir);
+    bool charge(size_t bytes);
+    void release(size_t bytes);
+    void detach(Node *node);
+    void unlink(Node *node);
+    void destroy(Node *node);
+
+    LockDomain domain;
+    Node *root;
+    Handle *openDirs; ///< Directory handles whose position must survive removals
+    size_t budget;
+    size_t used;
+};
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+/// Suffix of the marker kept beside a file while it holds reserved space
+#define LOFS_RESERVE_SUFFIX ".lofs-rsv"
+
+/**
+ * @brief Append-only file whose space is allocated ahead of the data
+ *
+ * LoFS::reserve() pads the file with LOFS_RESERVE_PAD bytes up to its end of
+ * data plus the requested reservation, once. Appends then overwrite that
+ * padding in place: on FAT this is a plain data-sector write, with no
+ * cluster allocation, FAT update or size change per flush. When the
+ * reservation runs out it grows by the same amount again. close() gives
+ * the unused space back by truncating the file where the backend supports
+ * it (SD on ESP32), otherwise by copying the data to a temp sibling and
+ * renaming it into place. close(false) keeps it for the next reserve().
+ *
+ * While reserved, a marker file (LOFS_RESERVE_SUFFIX) sits beside the file.
+ * After a power loss, reserve() takes the last byte that is not padding as
+ * the end of data, so data that itself ends in LOFS_RESERVE_PAD bytes loses
+ * them; text logs are safe. Readers of a file that is open or was not closed
+ * see the padding after the data.
+ *
+ * Usage example:
+ *   LoFS::ReservedFile log = LoFS::reserve("/sd/logs/gps.csv", 64 * 1024);
+ *   log.print(line);
+ *   log.sync();     // data sectors (and the directory entry) only
+ *   ...
+ *   log.close();    // trims the file to its data
+ */
+class LoFS::ReservedFile : public Stream
+{
+  public:
+    ReservedFile();
+    ReservedFile(ReservedFile &&other);
+    ReservedFile &operator=(ReservedFile &&other);
+    ~ReservedFile() { close(); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override;
+
+    /// Write-only: nothing to read
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+    /// Same as sync()
+    void flush() override { sync(); }
+
+    /**
+     * @brief Flush written data to the card
+     */
+    bool sync();
+
+    /// End of data: bytes written, including data from before reserve()
+    size_t position() const { return end; }
+
+    /// File size on the filesystem: data plus unused reservation
+    size_t reserved() const { return extent; }
+
+    /// Space is preallocated (false: plain append, see LoFS::reserve())
+    bool preallocated() const { return inPlace; }
+
+    /**
+     * @brief Close the file
+     * @param release Trim the file to its data (default); false keeps the
+     *        reservation and the marker for the next reserve()
+     * @return false if trimming failed; the data is intact either way
+     */
+    bool close(bool release = true);
+
+    operator bool() const { return (bool)file; }
+
+  private:
+    friend class LoFS;
+
+    ReservedFile(const ReservedFile &) = delete;
+    ReservedFile &operator=(const ReservedFile &) = delete;
+
+    bool extend(size_t minimum);
+    bool trim();
+
+    LockDomain *domain; ///< Lock of the file's backend
+    File file;
+    char path[LOFS_PATH_MAX];
+    size_t end;
+    size_t extent;
+    size_t step;   ///< Bytes added each time the reservation runs out
+    bool inPlace;
+};
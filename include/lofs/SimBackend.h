@@ -0,0 +1,89 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+/**
+ * @brief Backend that adds simulated device latency to another LoFS path
+ *
+ * Forwards every call to a directory served by an existing mount, after
+ * sleeping for the time the modelled device would take. The delay is spent
+ * while holding the target's lock, like a real SPI transaction, so lock
+ * contention shows up as well. Intended for measuring LoFS changes on
+ * Portduino, where /internal/ is a host directory and far faster than any
+ * real flash or SD card.
+ *
+ * On ESP32 and Portduino, writes through an open File are delayed as well:
+ * per KB written, per flush/close after writing, and extra for a flush/close
+ * that follows writes which grew the file (FAT cluster chain and FSINFO
+ * updates). Reads on an open File run at the speed of the target.
+ *
+ * Usage example:
+ *   static LoFS::SimBackend simSD("/internal/simsd", LoFS::SimBackend::Profile::fatSPI());
+ *   LoFS::mkdir("/internal/simsd");
+ *   LoFS::mount("/simsd/", &simSD);
+ *   LoFS::exists("/simsd/x.bin"); // takes as long as a FAT directory scan
+ */
+class LoFS::SimBackend : public LoFS::Backend
+{
+  public:
+    /**
+     * @brief Per-call latency in microseconds
+     */
+    struct Profile {
+        uint32_t openUs;
+        uint32_t existsUs;
+        uint32_t mkdirUs;
+        uint32_t removeUs;
+        uint32_t renameUs;
+        uint32_t rmdirUs;
+        uint32_t totalBytesUs;
+        uint32_t usedBytesUs;      ///< Fixed part of a usedBytes() call
+        uint32_t usedBytesUsPerMB; ///< Per MB of capacity (FAT walks the whole table)
+        uint32_t writeUsPerKB;     ///< Data written through an open File
+        uint32_t syncUs;           ///< flush() or close() after writes (directory entry / metadata commit)
+        uint32_t growUs;           ///< Extra when those writes made the file larger (allocation)
+
+        Profile()
+            : openUs(0), existsUs(0), mkdirUs(0), removeUs(0), renameUs(0), rmdirUs(0), totalBytesUs(0),
+              usedBytesUs(0), usedBytesUsPerMB(0), writeUsPerKB(0), syncUs(0), growUs(0)
+        {
+        }
+
+        /// Internal NOR flash with LittleFS: cheap lookups, metadata commits cost an erase/program
+        static Profile littleFS();
+
+        /// SD card over SPI with FAT: directory scans per lookup, usedBytes() scans the FAT
+        static Profile fatSPI();
+    };
+
+    /**
+     * @param target LoFS path of the directory holding the simulated files (e.g. "/internal/sim")
+     * @param profile Latency model
+     */
+    SimBackend(const char *target, const Profile &profile);
+
+    /// The target's backend is available (e.g. an SD card is present)
+    bool isAvailable() override;
+    LockDomain &lockDomain() override;
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *oldpath, const char *newpath) override;
+    bool rmdir(const char *path) override;
+    uint64_t totalBytes() override;
+    uint64_t usedBytes() override;
+
+    /// Total simulated delay so far, in microseconds
+    uint64_t simulatedUs() const { return simulated; }
+
+  private:
+    class Handle;
+
+    Backend *map(const char *path, char *buf, size_t size);
+    void wait(uint32_t us);
+
+    char target[LOFS_PATH_MAX];
+    Profile profile;
+    uint64_t simulated;
+};
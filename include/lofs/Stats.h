@@ -0,0 +1,74 @@
+#pragma once
+
+#include <lofs/LoFS.h>
+
+// Set LOFS_STATS to 1 to collect LoFS::stats(); at 0 the hooks compile to nothing
+#ifndef LOFS_STATS
+#define LOFS_STATS 0
+#endif
+
+// Backends with their own counters; further backends are not counted
+#ifndef LOFS_STATS_BACKENDS
+#define LOFS_STATS_BACKENDS 4
+#endif
+
+// Latency histogram buckets: bucket i counts calls taking [2^(i-1), 2^i) us, the last one everything slower
+#define LOFS_STATS_BUCKETS 20
+
+/**
+ * @brief Instrumentation snapshot (see LoFS::stats())
+ *
+ * Collected only when LOFS_STATS is 1. Counters are updated without a
+ * shared lock, so a snapshot taken during heavy I/O may be off by a few
+ * calls; it is meant for finding where time goes, not for accounting.
+ *
+ * Usage example:
+ *   static LoFS::Stats s; // large: keep it off the stack
+ *   if (LoFS::stats(&s)) {
+ *       const LoFS::Stats::OpCounters &w = s.backends[0].ops[(int)LoFS::Stats::Op::OPEN];
+ *       // w.calls, w.errors, w.maxUs, w.histogram[...]
+ *   }
+ */
+struct LoFS::Stats {
+    enum class Op : uint8_t {
+        OPEN,
+        EXISTS,
+        MKDIR,
+        REMOVE,
+        RENAME, ///< rename() and move()
+        RMDIR,
+        COPY,
+        SPACE, ///< spaceInfo() and totalBytes/usedBytes/freeBytes
+        COUNT
+    };
+
+    struct OpCounters {
+        uint32_t calls;
+        uint32_t errors; ///< Calls that failed; an exists() miss is not one
+        uint64_t totalUs;
+        uint32_t maxUs;
+        uint32_t histogram[LOFS_STATS_BUCKETS];
+    };
+
+    /// Time spent waiting for a lock versus holding it (exclusive acquisitions only)
+    struct LockCounters {
+        uint32_t acquisitions;
+        uint32_t contended; ///< Acquisitions that had to wait at least 1 ms
+        uint64_t waitUs;
+        uint64_t holdUs;
+        uint32_t maxWaitUs;
+        uint32_t maxHoldUs;
+    };
+
+    struct BackendCounters {
+        Backend *backend; ///< nullptr for an unused slot; compare with LoFS::resolve()
+        OpCounters ops[(size_t)Op::COUNT];
+        uint64_t bytesRead;    ///< Read by copy/move
+        uint64_t bytesWritten; ///< Written by copy/move
+        LockCounters lock;     ///< The backend's lock domain (shared domains show the same figures)
+    };
+
+    BackendCounters backends[LOFS_STATS_BACKENDS];
+    OpCounters sdProbe;   ///< SD card (re-)initialization in isSDCardAvailable()/refreshSD()
+    LockCounters spiLock; ///< SPI domain: SD card and anything else sharing spiLock
+};
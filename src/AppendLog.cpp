@@ -0,0 +1,181 @@
+#include <lofs/AppendLog.h>
+#include <lofs/LockDomain.h>
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+LoFS::AppendLog::AppendLog(const char *path, const Options &options)
+    : options(options), buffer(nullptr), used(0), firstPendingMs(0), fileSize(0), sizeKnown(false)
+{
+    strncpy(this->path, path ? path : "", sizeof(this->path) - 1);
+    this->path[sizeof(this->path) - 1] = '\0';
+    memset(&counters, 0, sizeof(counters));
+}
+
+LoFS::AppendLog::~AppendLog()
+{
+    flush();
+    free(buffer);
+}
+
+bool LoFS::AppendLog::append(const void *data, size_t len)
+{
+    if (!data || len == 0) {
+        return true;
+    }
+    counters.records++;
+
+    if (!buffer && options.bufferSize > 0) {
+        buffer = (uint8_t *)malloc(options.bufferSize);
+    }
+
+    // Make room, committing what is already buffered
+    if (used + len > options.bufferSize && !flush()) {
+        return false;
+    }
+
+    // No buffer (out of memory) or record larger than the buffer: write it on its own
+    if (!buffer || len > options.bufferSize) {
+        size_t written = 0;
+        return commit((const uint8_t *)data, len, &written);
+    }
+
+    if (used == 0) {
+        firstPendingMs = millis();
+    }
+    memcpy(buffer + used, data, len);
+    used += len;
+
+    if (used == options.bufferSize) {
+        return flush();
+    }
+    loop();
+    return true;
+}
+
+void LoFS::AppendLog::loop()
+{
+    if (used > 0 && options.flushIntervalMs > 0 && (uint32_t)(millis() - firstPendingMs) >= options.flushIntervalMs) {
+        flush();
+    }
+}
+
+bool LoFS::AppendLog::flush()
+{
+    if (used == 0) {
+        return true;
+    }
+    // On failure the unwritten records stay buffered for the next flush. A
+    // short write already put a prefix in the file, so only the rest is kept.
+    size_t written = 0;
+    bool ok = commit(buffer, used, &written);
+    if (written > 0 && written < used) {
+        memmove(buffer, buffer + written, used - written);
+    }
+    used -= written;
+    return ok;
+}
+
+bool LoFS::AppendLog::rotate()
+{
+    return flush() && rotateFile();
+}
+
+bool LoFS::AppendLog::commit(const uint8_t *data, size_t len, size_t *written)
+{
+    *written = 0;
+    if (!sizeKnown) {
+        File existing = LoFS::open(path, FILE_O_READ);
+        fileSize = existing ? existing.size() : 0;
+        if (existing) {
+            LockDomain::SharedGuard g(LoFS::lockDomain(path));
+            existing.close();
+        }
+        sizeKnown = true;
+    }
+
+    if (options.maxFileSize > 0 && fileSize > 0 && fileSize + len > options.maxFileSize && !rotateFile()) {
+        return false;
+    }
+
+    File file = LoFS::open(path, "a");
+    if (!file) {
+        return false;
+    }
+
+    {
+        LockDomain::Guard g(LoFS::lockDomain(path));
+        *written = file.write(data, len);
+        file.flush();
+        file.close();
+    }
+
+    fileSize += *written;
+    LoFS::spaceAdjust(path, (int64_t)*written);
+    counters.commits++;
+    counters.bytes += *written;
+    return *written == len;
+}
+
+bool LoFS::AppendLog::rotateFile()
+{
+    char from[LOFS_PATH_MAX];
+    char to[LOFS_PATH_MAX];
+
+    if (!LoFS::exists(path)) {
+        // Nothing written since the last rotation (or ever): already a fresh log
+        fileSize = 0;
+        sizeKnown = true;
+        return true;
+    }
+
+    if (options.maxSegments == 0) {
+        // No history kept: just start over
+        if (!LoFS::remove(path)) {
+            return false;
+        }
+    } else {
+        if (options.archiveDir && !LoFS::exists(options.archiveDir)) {
+            LoFS::mkdir(options.archiveDir);
+        }
+
+        // Drop the oldest segment, then shift the rest up by one
+        segmentPath(to, sizeof(to), options.maxSegments - 1);
+        LoFS::remove(to);
+        for (int i = options.maxSegments - 2; i >= 0; i--) {
+            segmentPath(from, sizeof(from), i);
+            segmentPath(to, sizeof(to), i + 1);
+            if (LoFS::exists(from)) {
+                LoFS::rename(from, to);
+            }
+        }
+
+        // Cross-filesystem when archiveDir is on another backend (copy + delete)
+        segmentPath(to, sizeof(to), 0);
+        if (!LoFS::rename(path, to)) {
+            return false;
+        }
+    }
+
+    fileSize = 0;
+    counters.rotations++;
+    return true;
+}
+
+void LoFS::AppendLog::segmentPath(char *out, size_t outSize, int index) const
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+
+    if (options.archiveDir) {
+        size_t dirLen = strlen(options.archiveDir);
+        while (dirLen > 0 && options.archiveDir[dirLen - 1] == '/') {
+            dirLen--;
+        }
+        snprintf(out, outSize, "%.*s/%s.%d", (int)dirLen, options.archiveDir, name, index);
+    } else {
+        // Same directory as the live log
+        snprintf(out, outSize, "%s.%d", path, index);
+    }
+}
@@ -0,0 +1,350 @@
+#include <lofs/Async.h>
+#include <lofs/Lock.h>
+#include <lofs/LockDomain.h>
+#include "configuration.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef LOFS_ASYNC_QUEUE_DEPTH
+#define LOFS_ASYNC_QUEUE_DEPTH 16
+#endif
+
+// Background worker: FreeRTOS task on ESP32, std::thread on Portduino.
+// Other targets drain the queue from their main loop via LoFS::processAsync().
+#ifndef LOFS_ASYNC_WORKER
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#define LOFS_ASYNC_WORKER 1
+#else
+#define LOFS_ASYNC_WORKER 0
+#endif
+#endif
+
+// The worker also runs KV compaction and /auto/ tier moves, whose frames hold several paths
+#ifndef LOFS_ASYNC_STACK_SIZE
+#define LOFS_ASYNC_STACK_SIZE 8192
+#endif
+
+#ifndef LOFS_ASYNC_PRIORITY
+#define LOFS_ASYNC_PRIORITY 1
+#endif
+
+#if LOFS_ASYNC_WORKER
+#ifdef ARCH_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+static TaskHandle_t asyncTask = nullptr;
+static LoFS::Lock *const asyncStartLock = new LoFS::Lock(); // Only one of the tasks waking the worker creates it
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+// Heap-allocated and never freed: the detached worker may still be waiting at process exit
+static std::mutex *asyncWakeMutex = new std::mutex();
+static std::condition_variable *asyncWake = new std::condition_variable();
+static bool asyncWakePending = false;
+static bool asyncThreadStarted = false;
+#endif
+#endif
+
+struct AsyncSlot {
+    LoFS::AsyncHandle id; ///< Handle occupying this slot (slot index = id % depth)
+    LoFS::AsyncStatus status;
+    LoFS::AsyncOp::Type type;
+    char *path;
+    char *newPath;
+    uint8_t *data;
+    size_t len;
+    LoFS::AsyncCallback callback;
+    void *context;
+    uint32_t submitMs;
+};
+
+// Handles are assigned in order, so the queue is the id range [tailId, nextId).
+// Ids start at 1 so that 0 can mean "rejected".
+static AsyncSlot asyncSlots[LOFS_ASYNC_QUEUE_DEPTH];
+static LoFS::AsyncHandle nextId = 1;
+static LoFS::AsyncHandle tailId = 1;
+static bool asyncProcessing = false;
+static LoFS::Lock *const asyncLock = new LoFS::Lock(); // Never freed, like the wakeup below
+
+static LoFS::AsyncStats asyncCounters;
+static uint64_t asyncLatencyTotalMs = 0;
+
+static AsyncSlot &slotFor(LoFS::AsyncHandle id)
+{
+    return asyncSlots[id % LOFS_ASYNC_QUEUE_DEPTH];
+}
+
+static char *copyString(const char *str)
+{
+    if (!str) {
+        return nullptr;
+    }
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)malloc(len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+static void releaseSlot(AsyncSlot &slot)
+{
+    free(slot.path);
+    free(slot.newPath);
+    free(slot.data);
+    slot.path = nullptr;
+    slot.newPath = nullptr;
+    slot.data = nullptr;
+}
+
+bool LoFS::wakeAsync()
+{
+#if LOFS_ASYNC_WORKER
+#ifdef ARCH_ESP32
+    TaskHandle_t task;
+    {
+        LoFS::Lock::Guard g(asyncStartLock);
+        if (!asyncTask) {
+            xTaskCreate([](void *) {
+                for (;;) {
+                    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                    LoFS::processAsync();
+                }
+            }, "lofs", LOFS_ASYNC_STACK_SIZE, nullptr, LOFS_ASYNC_PRIORITY, &asyncTask);
+        }
+        task = asyncTask;
+    }
+    if (!task) {
+        return false;
+    }
+    xTaskNotifyGive(task);
+    return true;
+#else
+    std::lock_guard<std::mutex> g(*asyncWakeMutex);
+    if (!asyncThreadStarted) {
+        asyncThreadStarted = true;
+        std::thread([]() {
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lk(*asyncWakeMutex);
+                    asyncWake->wait(lk, []() { return asyncWakePending; });
+                    asyncWakePending = false;
+                }
+                LoFS::processAsync();
+            }
+        }).detach();
+    }
+    asyncWakePending = true;
+    asyncWake->notify_one();
+    return true;
+#endif
+#else
+    return false;
+#endif
+}
+
+LoFS::AsyncHandle LoFS::submit(const AsyncOp &op)
+{
+    bool needsData = (op.type == AsyncOp::Type::WRITE || op.type == AsyncOp::Type::APPEND);
+    char *path = copyString(op.path);
+    char *newPath = copyString(op.newPath);
+    uint8_t *data = nullptr;
+    if (needsData && op.len > 0) {
+        data = (uint8_t *)malloc(op.len);
+        if (data) {
+            memcpy(data, op.data, op.len);
+        }
+    }
+
+    bool valid = path && (op.type != AsyncOp::Type::RENAME || newPath) && (!needsData || op.len == 0 || data);
+    AsyncHandle id = 0;
+    {
+        LoFS::Lock::Guard g(asyncLock);
+        if (valid && nextId - tailId < LOFS_ASYNC_QUEUE_DEPTH) {
+            id = nextId++;
+            AsyncSlot &slot = slotFor(id);
+            slot.id = id;
+            slot.status = AsyncStatus::PENDING;
+            slot.type = op.type;
+            slot.path = path;
+            slot.newPath = newPath;
+            slot.data = data;
+            slot.len = op.len;
+            slot.callback = op.callback;
+            slot.context = op.context;
+            slot.submitMs = millis();
+
+            asyncCounters.submitted++;
+            uint16_t depth = (uint16_t)(nextId - tailId);
+            if (depth > asyncCounters.maxDepth) {
+                asyncCounters.maxDepth = depth;
+            }
+        } else {
+            asyncCounters.rejected++;
+        }
+    }
+
+    if (!id) {
+        free(path);
+        free(newPath);
+        free(data);
+        return 0;
+    }
+
+    wakeAsync();
+    return id;
+}
+
+LoFS::AsyncStatus LoFS::poll(AsyncHandle handle)
+{
+    if (!handle) {
+        return AsyncStatus::UNKNOWN;
+    }
+    LoFS::Lock::Guard g(asyncLock);
+    const AsyncSlot &slot = slotFor(handle);
+    return (slot.id == handle) ? slot.status : AsyncStatus::UNKNOWN;
+}
+
+// Write one or more queued WRITE/APPEND requests to the same file with a single open
+static bool runWrite(LoFS::LockDomain &domain, AsyncSlot **batch, size_t count)
+{
+    const char *path = batch[0]->path;
+    if (batch[0]->type == LoFS::AsyncOp::Type::WRITE) {
+        // Remove first: on STM32WL/NRF52 write mode appends instead of truncating
+        LoFS::remove(path);
+    }
+    File file = LoFS::open(path, batch[0]->type == LoFS::AsyncOp::Type::WRITE ? "w" : "a");
+    if (!file) {
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; i < count && result; i++) {
+        if (batch[i]->len > 0) {
+            LoFS::LockDomain::Guard g(domain);
+            result = (file.write(batch[i]->data, batch[i]->len) == batch[i]->len);
+        }
+    }
+
+    LoFS::LockDomain::Guard g(domain);
+    file.flush();
+    file.close();
+    return result;
+}
+
+void LoFS::processAsync()
+{
+    // Queued requests go first each time, so they never wait behind more than
+    // one maintenance job (a compaction or a tier move can take seconds)
+    drainAsync();
+    // Space figures flagged by spaceInfo() are re-measured here, off the caller's path
+    resyncSpace();
+    drainAsync();
+    // Tier scans of /auto/ files flagged by resolve() or rebalanceAuto()
+    scanAuto();
+    drainAsync();
+    // Hint files and compaction of KV stores that filled or sealed segments
+    compactKV();
+    drainAsync();
+}
+
+void LoFS::drainAsync()
+{
+    {
+        LoFS::Lock::Guard g(asyncLock);
+        if (asyncProcessing) {
+            return; // Another thread is draining the queue
+        }
+        asyncProcessing = true;
+    }
+
+    while (true) {
+        AsyncSlot *batch[LOFS_ASYNC_QUEUE_DEPTH];
+        size_t count = 0;
+        {
+            LoFS::Lock::Guard g(asyncLock);
+            if (tailId == nextId) {
+                asyncProcessing = false;
+                break;
+            }
+            batch[count++] = &slotFor(tailId);
+
+            // Coalesce following appends to the same file into this open
+            AsyncOp::Type type = batch[0]->type;
+            if (type == AsyncOp::Type::WRITE || type == AsyncOp::Type::APPEND) {
+                for (AsyncHandle id = tailId + 1; id != nextId && count < LOFS_ASYNC_QUEUE_DEPTH; id++) {
+                    AsyncSlot &next = slotFor(id);
+                    if (next.type != AsyncOp::Type::APPEND || strcmp(next.path, batch[0]->path) != 0) {
+                        break;
+                    }
+                    batch[count++] = &next;
+                }
+            }
+        }
+
+        // Run without holding the queue lock so submit() never waits on I/O
+        bool ok = false;
+        AsyncSlot &first = *batch[0];
+        switch (first.type) {
+        case AsyncOp::Type::WRITE:
+        case AsyncOp::Type::APPEND:
+            ok = runWrite(lockDomain(first.path), batch, count);
+            if (ok) {
+                size_t written = 0;
+                for (size_t i = 0; i < count; i++) {
+                    written += batch[i]->len;
+                }
+                spaceAdjust(first.path, (int64_t)written);
+            }
+            break;
+        case AsyncOp::Type::REMOVE:
+            ok = LoFS::remove(first.path);
+            break;
+        case AsyncOp::Type::RENAME:
+            ok = LoFS::rename(first.path, first.newPath);
+            break;
+        case AsyncOp::Type::RMDIR:
+            ok = LoFS::rmdir(first.path, true);
+            break;
+        }
+
+        uint32_t now = millis();
+        for (size_t i = 0; i < count; i++) {
+            AsyncSlot &slot = *batch[i];
+            AsyncCallback callback = slot.callback;
+            void *context = slot.context;
+            AsyncHandle id = slot.id;
+            {
+                LoFS::Lock::Guard g(asyncLock);
+                uint32_t latency = now - slot.submitMs;
+                asyncLatencyTotalMs += latency;
+                if (latency > asyncCounters.maxLatencyMs) {
+                    asyncCounters.maxLatencyMs = latency;
+                }
+                asyncCounters.completed++;
+                if (!ok) {
+                    asyncCounters.failed++;
+                }
+                if (i > 0) {
+                    asyncCounters.coalesced++;
+                }
+                releaseSlot(slot);
+                slot.status = ok ? AsyncStatus::DONE : AsyncStatus::FAILED;
+                tailId++;
+            }
+            if (callback) {
+                callback(id, ok, context);
+            }
+        }
+    }
+}
+
+LoFS::AsyncStats LoFS::asyncStats()
+{
+    LoFS::Lock::Guard g(asyncLock);
+    AsyncStats stats = asyncCounters;
+    stats.depth = (uint16_t)(nextId - tailId);
+    stats.avgLatencyMs = stats.completed ? (uint32_t)(asyncLatencyTotalMs / stats.completed) : 0;
+    return stats;
+}
@@ -0,0 +1,265 @@
+#include <lofs/AtomicWriter.h>
+#include <lofs/LockDomain.h>
+#include <lofs/DirIterator.h>
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Chunk used to compare against / copy from the existing file
+#define LOFS_ATOMIC_CHUNK 128
+
+static bool endsWith(const char *str, const char *suffix)
+{
+    size_t len = strlen(str);
+    size_t suffixLen = strlen(suffix);
+    return len >= suffixLen && strcmp(str + len - suffixLen, suffix) == 0;
+}
+
+// Rename a complete temp file over the target
+static bool commitRename(const char *tmpPath, const char *path)
+{
+    // LittleFS replaces the target atomically
+    if (LoFS::rename(tmpPath, path)) {
+        return true;
+    }
+
+    // FAT refuses to rename over an existing file. Mark the temp file complete
+    // first so recoverAtomic() can finish the job after a power loss.
+    char newPath[LOFS_PATH_MAX];
+    snprintf(newPath, sizeof(newPath), "%s" LOFS_ATOMIC_NEW_SUFFIX, path);
+    if (!LoFS::rename(tmpPath, newPath)) {
+        return false;
+    }
+    LoFS::remove(path);
+    return LoFS::rename(newPath, path);
+}
+
+LoFS::AtomicWriter::AtomicWriter(const char *filepath)
+    : domain(&LockDomain::spi()), existingSize(0), matched(0), diverged(false), failed(false), done(false)
+{
+    if (!filepath || strlen(filepath) + sizeof(LOFS_ATOMIC_TMP_SUFFIX) > sizeof(path)) {
+        path[0] = '\0';
+        tmpPath[0] = '\0';
+        failed = true;
+        return;
+    }
+    strcpy(path, filepath);
+    snprintf(tmpPath, sizeof(tmpPath), "%s" LOFS_ATOMIC_TMP_SUFFIX, filepath);
+    domain = &lockDomain(path);
+
+    if (LoFS::exists(path)) {
+        existing = LoFS::open(path, FILE_O_READ);
+        if (existing) {
+            existingSize = existing.size();
+        }
+    }
+}
+
+LoFS::AtomicWriter::~AtomicWriter()
+{
+    if (!done) {
+        abort();
+    }
+}
+
+size_t LoFS::AtomicWriter::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t LoFS::AtomicWriter::write(const uint8_t *buf, size_t size)
+{
+    if (failed || done) {
+        return 0;
+    }
+
+    if (!diverged && existing && matched + size <= existingSize) {
+        // Still identical so far? Compare against the next bytes of the existing file
+        uint8_t chunk[LOFS_ATOMIC_CHUNK];
+        size_t compared = 0;
+        while (compared < size) {
+            size_t n = size - compared;
+            if (n > sizeof(chunk)) {
+                n = sizeof(chunk);
+            }
+            size_t got;
+            {
+                LockDomain::SharedGuard g(*domain);
+                got = existing.read(chunk, n);
+            }
+            if (got != n || memcmp(chunk, buf + compared, n) != 0) {
+                break;
+            }
+            compared += n;
+        }
+        if (compared == size) {
+            matched += size;
+            return size;
+        }
+    }
+
+    if (!diverged && !diverge()) {
+        return 0;
+    }
+
+    size_t written;
+    {
+        LockDomain::Guard g(*domain);
+        written = tmp.write(buf, size);
+    }
+    if (written != size) {
+        failed = true;
+    }
+    return written;
+}
+
+// Start the temp file and carry over the prefix that matched the existing file
+bool LoFS::AtomicWriter::diverge()
+{
+    diverged = true;
+
+    // Remove first: on STM32WL/NRF52 write mode appends instead of truncating
+    LoFS::remove(tmpPath);
+    tmp = LoFS::open(tmpPath, "w");
+    if (!tmp) {
+        failed = true;
+        return false;
+    }
+
+    if (matched > 0) {
+        uint8_t chunk[LOFS_ATOMIC_CHUNK];
+        uint32_t copied = 0;
+        LockDomain::Guard g(*domain);
+        existing.seek(0);
+        while (copied < matched) {
+            size_t n = matched - copied;
+            if (n > sizeof(chunk)) {
+                n = sizeof(chunk);
+            }
+            if (existing.read(chunk, n) != n || tmp.write(chunk, n) != n) {
+                failed = true;
+                return false;
+            }
+            copied += n;
+        }
+    }
+    return true;
+}
+
+bool LoFS::AtomicWriter::commit()
+{
+    if (done) {
+        return !failed;
+    }
+
+    // Same bytes and same length: nothing to do
+    if (!failed && !diverged && existing && matched == existingSize) {
+        done = true;
+        LockDomain::Guard g(*domain);
+        existing.close();
+        return true;
+    }
+
+    // New file, or new data is a shorter prefix of the old one
+    if (!failed && !diverged) {
+        diverge();
+    }
+
+    if (existing) {
+        LockDomain::Guard g(*domain);
+        existing.close();
+    }
+    if (tmp) {
+        uint32_t tmpSize;
+        {
+            LockDomain::Guard g(*domain);
+            tmp.flush();
+            tmpSize = tmp.size();
+            tmp.close();
+        }
+        LoFS::spaceAdjust(tmpPath, tmpSize); // The rename then frees the replaced file
+    }
+
+    if (failed || !commitRename(tmpPath, path)) {
+        failed = true;
+        abort();
+        return false;
+    }
+    done = true;
+    return true;
+}
+
+void LoFS::AtomicWriter::abort()
+{
+    done = true;
+    uint32_t tmpSize = 0;
+    {
+        LockDomain::Guard g(*domain);
+        if (existing) {
+            existing.close();
+        }
+        if (tmp) {
+            tmpSize = tmp.size();
+            tmp.close();
+        }
+    }
+    // Balances the remove() below, which subtracts the temp file's size
+    LoFS::spaceAdjust(tmpPath, tmpSize);
+    if (diverged && tmpPath[0]) {
+        LoFS::remove(tmpPath);
+    }
+}
+
+bool LoFS::writeAtomic(const char *filepath, const void *data, size_t len, bool *changed)
+{
+    AtomicWriter writer(filepath);
+    if (len > 0 && writer.write((const uint8_t *)data, len) != len) {
+        writer.abort();
+        return false;
+    }
+    bool result = writer.commit();
+    if (changed) {
+        *changed = writer.changed();
+    }
+    return result;
+}
+
+int LoFS::recoverAtomic(const char *dirpath)
+{
+    // One pass, acting on each leftover as it is found: like removeTree(),
+    // this relies on the filesystem tolerating changes to the directory being
+    // listed. Every entry is tried once, so one that cannot be removed or
+    // renamed stays for the next call instead of being retried here.
+    int handled = 0;
+    int dirLen = (int)strlen(dirpath);
+    while (dirLen > 0 && dirpath[dirLen - 1] == '/') {
+        dirLen--;
+    }
+
+    DirIterator it(dirpath);
+    while (it.next()) {
+        bool tmp = endsWith(it.name(), LOFS_ATOMIC_TMP_SUFFIX);
+        if (!tmp && !endsWith(it.name(), LOFS_ATOMIC_NEW_SUFFIX)) {
+            continue;
+        }
+        char leftover[LOFS_PATH_MAX];
+        int len = snprintf(leftover, sizeof(leftover), "%.*s/%s", dirLen, dirpath, it.name());
+        if (len < 0 || (size_t)len >= sizeof(leftover)) {
+            continue;
+        }
+        if (tmp) {
+            // Interrupted before the data was complete: the target still holds the old contents
+            handled += remove(leftover) ? 1 : 0;
+        } else {
+            // Complete data whose final rename was interrupted
+            char target[LOFS_PATH_MAX];
+            size_t targetLen = len - strlen(LOFS_ATOMIC_NEW_SUFFIX);
+            memcpy(target, leftover, targetLen);
+            target[targetLen] = '\0';
+            remove(target);
+            handled += rename(leftover, target) ? 1 : 0;
+        }
+    }
+    return handled;
+}
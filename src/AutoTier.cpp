@@ -0,0 +1,695 @@
+#include <lofs/Backend.h>
+#include <lofs/DirIterator.h>
+#include <lofs/Lock.h>
+#include "PathHash.h"
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+// Open /auto/ files are wrapped in an fs::FileImpl to count them, so scans
+// leave them in place. Other targets have no such hook and rely on the idle
+// time alone (see wantsMove()).
+#if LOFS_AUTO_TIER && (defined(ARCH_ESP32) || defined(ARCH_PORTDUINO))
+#include <FSImpl.h>
+#define LOFS_AUTO_TRACK_OPEN 1
+#else
+#define LOFS_AUTO_TRACK_OPEN 0
+#endif
+
+// Directory holding /auto/ files on each tier
+#ifndef LOFS_AUTO_DIR
+#define LOFS_AUTO_DIR "/.auto"
+#endif
+
+// Persistent index of file locations
+#ifndef LOFS_AUTO_INDEX_PATH
+#define LOFS_AUTO_INDEX_PATH "/internal/.auto.idx"
+#endif
+
+// Files whose location is remembered; others are found by probing both tiers
+#ifndef LOFS_AUTO_INDEX_ENTRIES
+#define LOFS_AUTO_INDEX_ENTRIES 64
+#endif
+
+// Files larger than this are demoted to SD by the next scan
+#ifndef LOFS_AUTO_DEMOTE_BYTES
+#define LOFS_AUTO_DEMOTE_BYTES 32768
+#endif
+
+// Files not accessed for this long are demoted to SD
+#ifndef LOFS_AUTO_DEMOTE_AGE_MS
+#define LOFS_AUTO_DEMOTE_AGE_MS (6UL * 60 * 60 * 1000)
+#endif
+
+// Internal flash kept free: below this new files go to SD and idle files are demoted
+#ifndef LOFS_AUTO_HOT_RESERVE
+#define LOFS_AUTO_HOT_RESERVE 65536
+#endif
+
+// Accesses between two scans that bring a small SD file back to internal flash
+#ifndef LOFS_AUTO_PROMOTE_HITS
+#define LOFS_AUTO_PROMOTE_HITS 4
+#endif
+
+// Interval between background scans; files accessed more recently are never moved
+#ifndef LOFS_AUTO_SCAN_MS
+#define LOFS_AUTO_SCAN_MS 60000
+#endif
+
+// Deepest directory level below /auto/ visited by scans
+#ifndef LOFS_AUTO_MAX_DEPTH
+#define LOFS_AUTO_MAX_DEPTH 8
+#endif
+
+#if LOFS_AUTO_TIER
+#define LOFS_AUTO_MAGIC 0x58494c4cu // "LLIX"
+
+static const uint8_t TIER_HOT = (uint8_t)LoFS::FSType::INTERNAL;
+static const uint8_t TIER_COLD = (uint8_t)LoFS::FSType::SD;
+
+enum AutoFlags : uint8_t {
+    AUTO_MIGRATING = 1, ///< Move between tiers in progress; persisted so a power loss forces a probe
+    AUTO_SEEN = 2,      ///< Found by the running scan
+    AUTO_USED = 4,      ///< Accessed while AUTO_MIGRATING: the move is abandoned
+};
+
+// Identity of a path below /auto/ ("/dir/file")
+struct AutoKey {
+    uint32_t hash;  ///< FNV-1a; never 0
+    uint16_t check; ///< Independent of hash, so two paths only share an entry if both match
+};
+
+struct AutoEntry {
+    uint32_t hash;      ///< AutoKey::hash; 0 = free slot
+    uint16_t check;     ///< AutoKey::check
+    uint32_t size;      ///< Bytes at the last scan
+    uint32_t lastUseMs; ///< millis() of the last access (load time after a reboot)
+    uint8_t tier;       ///< TIER_HOT or TIER_COLD
+    uint8_t hits;       ///< Accesses since the last scan
+    uint8_t flags;
+    uint8_t opens;      ///< Open Files (LOFS_AUTO_TRACK_OPEN)
+};
+
+// Index file: header followed by one record per entry
+struct AutoHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct AutoRecord {
+    uint32_t hash;
+    uint32_t size;
+    uint8_t tier;
+    uint8_t flags;
+    uint16_t check;
+};
+
+static AutoEntry autoEntries[LOFS_AUTO_INDEX_ENTRIES];
+static bool autoLoaded = false;
+static bool autoDirty = false;
+static bool autoScanPending = false;
+static uint32_t autoLastScanMs = 0;
+
+// autoLock guards the table and is never held across I/O. autoMigrateLock
+// serializes scans, migrations and index saves.
+static LoFS::Lock *const autoLock = new LoFS::Lock();
+static LoFS::Lock *const autoMigrateLock = new LoFS::Lock();
+
+static const char *tierRoot(uint8_t tier)
+{
+    return (tier == TIER_COLD) ? "/sd" LOFS_AUTO_DIR : "/internal" LOFS_AUTO_DIR;
+}
+
+// Key of the path below /auto/ ("/dir/file"), ignoring trailing slashes
+static AutoKey autoKey(const char *rel)
+{
+    size_t len = strlen(rel);
+    while (len > 1 && rel[len - 1] == '/') {
+        len--;
+    }
+    uint32_t hash = LOFS_FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash = lofsHashStep(hash, rel[i]);
+    }
+    uint32_t crc = LoFS::crc32(rel, len);
+    AutoKey key = {hash ? hash : 1, (uint16_t)(crc ^ (crc >> 16))};
+    return key;
+}
+
+static bool tierPath(uint8_t tier, const char *rel, char *out, size_t size)
+{
+    int len = snprintf(out, size, "%s%s%s", tierRoot(tier), (rel[0] == '/') ? "" : "/", rel);
+    return len >= 0 && (size_t)len < size;
+}
+
+static AutoEntry *findAuto(const AutoKey &key)
+{
+    for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+        if (autoEntries[i].hash == key.hash && autoEntries[i].check == key.check) {
+            return &autoEntries[i];
+        }
+    }
+    return nullptr;
+}
+
+// Find or add an entry; a full table gives up the idle one accessed longest ago (caller holds autoLock)
+static AutoEntry *claimAuto(const AutoKey &key, uint8_t tier)
+{
+    AutoEntry *entry = findAuto(key);
+    if (entry) {
+        return entry;
+    }
+    entry = &autoEntries[0];
+    for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+        AutoEntry &candidate = autoEntries[i];
+        if (!candidate.hash) {
+            entry = &candidate;
+            break;
+        }
+        bool candidateOpen = candidate.opens > 0 || (candidate.flags & AUTO_MIGRATING);
+        bool entryOpen = entry->opens > 0 || (entry->flags & AUTO_MIGRATING);
+        if ((candidateOpen != entryOpen) ? entryOpen : (int32_t)(candidate.lastUseMs - entry->lastUseMs) < 0) {
+            entry = &candidate;
+        }
+    }
+    entry->hash = key.hash;
+    entry->check = key.check;
+    entry->size = 0;
+    entry->lastUseMs = millis();
+    entry->tier = tier;
+    entry->hits = 0;
+    entry->flags = 0;
+    entry->opens = 0;
+    autoDirty = true;
+    return entry;
+}
+
+// Note an access, which a move in progress must not cut off (caller holds autoLock)
+static void useAuto(AutoEntry *entry)
+{
+    if (entry->flags & AUTO_MIGRATING) {
+        entry->flags |= AUTO_USED;
+    }
+}
+
+static void rememberAuto(const AutoKey &key, uint8_t tier)
+{
+    LoFS::Lock::Guard g(autoLock);
+    AutoEntry *entry = claimAuto(key, tier);
+    if (entry->tier != tier) {
+        entry->tier = tier;
+        autoDirty = true;
+    }
+}
+
+static void loadAutoIndex()
+{
+    if (autoLoaded) {
+        return;
+    }
+    LoFS::Lock::Guard m(autoMigrateLock);
+    if (autoLoaded) {
+        return;
+    }
+
+    LoFS::mkdir(tierRoot(TIER_HOT));
+
+    char stripped[LOFS_PATH_MAX];
+    LoFS::Backend *backend = LoFS::resolve(LOFS_AUTO_INDEX_PATH, stripped, sizeof(stripped));
+    if (backend) {
+        LoFS::LockDomain::SharedGuard g(backend->lockDomain());
+        File file = backend->open(stripped, "r");
+        AutoHeader header;
+        if (file && file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == LOFS_AUTO_MAGIC &&
+            header.count <= LOFS_AUTO_INDEX_ENTRIES) {
+            uint32_t now = millis();
+            LoFS::Lock::Guard t(autoLock);
+            for (uint32_t i = 0; i < header.count; i++) {
+                AutoRecord record;
+                if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record)) {
+                    break;
+                }
+                if (!record.hash || (record.flags & AUTO_MIGRATING)) {
+                    continue; // Interrupted move: the file may be on either tier, so probe it
+                }
+                AutoKey key = {record.hash, record.check};
+                AutoEntry *entry = claimAuto(key, record.tier);
+                entry->size = record.size;
+                entry->lastUseMs = now; // Ages restart at boot
+            }
+            autoDirty = false;
+        }
+        if (file) {
+            file.close();
+        }
+    }
+    autoLoaded = true;
+}
+
+// Write the table if it changed (caller holds autoMigrateLock)
+static void saveAutoIndex()
+{
+    static uint8_t buffer[sizeof(AutoHeader) + LOFS_AUTO_INDEX_ENTRIES * sizeof(AutoRecord)];
+    AutoHeader header = {LOFS_AUTO_MAGIC, 0};
+    {
+        LoFS::Lock::Guard g(autoLock);
+        if (!autoDirty) {
+            return;
+        }
+        for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+            const AutoEntry &entry = autoEntries[i];
+            if (!entry.hash) {
+                continue;
+            }
+            AutoRecord record = {entry.hash, entry.size, entry.tier, (uint8_t)(entry.flags & AUTO_MIGRATING),
+                                 entry.check};
+            memcpy(buffer + sizeof(header) + header.count * sizeof(record), &record, sizeof(record));
+            header.count++;
+        }
+        autoDirty = false;
+    }
+    memcpy(buffer, &header, sizeof(header));
+    if (!LoFS::writeAtomic(LOFS_AUTO_INDEX_PATH, buffer, sizeof(header) + header.count * sizeof(AutoRecord))) {
+        LoFS::Lock::Guard g(autoLock);
+        autoDirty = true; // Retry at the next scan
+    }
+}
+
+// Internal flash is short of space (unknown capacity counts as plenty)
+static bool hotPressure(uint64_t extra)
+{
+    LoFS::SpaceInfo info = LoFS::spaceInfo(tierRoot(TIER_HOT));
+    return info.totalBytes > 0 && info.freeBytes < extra + LOFS_AUTO_HOT_RESERVE;
+}
+
+// Create every missing parent directory of a full path
+static void makeParents(char *path, size_t from)
+{
+    for (char *p = path + from + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (!LoFS::exists(path)) {
+                LoFS::mkdir(path);
+            }
+            *p = '/';
+        }
+    }
+}
+
+// Move one file between tiers (caller holds autoMigrateLock)
+static bool migrateFile(const char *rel, uint8_t from, uint8_t to)
+{
+    char src[LOFS_PATH_MAX];
+    char dst[LOFS_PATH_MAX];
+    if (!tierPath(from, rel, src, sizeof(src)) || !tierPath(to, rel, dst, sizeof(dst))) {
+        return false;
+    }
+    AutoKey key = autoKey(rel);
+
+    // Persist the in-progress mark first, so a power loss mid-copy is resolved by probing
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = claimAuto(key, from);
+        if (entry->opens > 0) {
+            return false; // Moving would leave the open File on the old copy
+        }
+        entry->tier = from;
+        entry->flags = (uint8_t)((entry->flags | AUTO_MIGRATING) & ~AUTO_USED);
+        autoDirty = true;
+    }
+    saveAutoIndex();
+
+    // Accesses keep going to the source during the copy. The index switches
+    // to the copy only if none happened; otherwise the copy is dropped.
+    makeParents(dst, strlen(tierRoot(to)) - strlen(LOFS_AUTO_DIR));
+    bool ok = LoFS::copy(src, dst);
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = claimAuto(key, from);
+        ok = ok && entry->opens == 0 && !(entry->flags & AUTO_USED);
+        entry->tier = ok ? to : from;
+        entry->hits = 0;
+        entry->flags &= ~(AUTO_MIGRATING | AUTO_USED);
+        autoDirty = true;
+    }
+    LoFS::remove(ok ? src : dst);
+    saveAutoIndex();
+    return ok;
+}
+
+// Record a file found by a scan and decide whether it should change tier
+static bool wantsMove(uint8_t tier, const char *rel, uint32_t size)
+{
+    uint32_t now = millis();
+    uint32_t idleMs;
+    uint8_t hits;
+    bool open;
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = claimAuto(autoKey(rel), tier);
+        if (entry->tier != tier || entry->size != size) {
+            autoDirty = true;
+        }
+        entry->tier = tier;
+        entry->size = size;
+        entry->flags |= AUTO_SEEN;
+        idleMs = now - entry->lastUseMs;
+        hits = entry->hits;
+        open = entry->opens > 0;
+    }
+    if (open || idleMs < LOFS_AUTO_SCAN_MS) {
+        return false; // Recently used files may be open where opens cannot be counted
+    }
+    if (tier == TIER_HOT) {
+        return size > LOFS_AUTO_DEMOTE_BYTES || idleMs >= LOFS_AUTO_DEMOTE_AGE_MS || hotPressure(0);
+    }
+    return hits >= LOFS_AUTO_PROMOTE_HITS && size <= LOFS_AUTO_DEMOTE_BYTES && !hotPressure(size);
+}
+
+// Visit every file below one tier's /auto/ directory and move those that
+// belong on the other tier. Like removeTree() only one directory is open at
+// a time; instead of a stack of iterators each level keeps the number of
+// entries already handled, and a directory is re-opened after each move.
+static void scanTier(uint8_t tier)
+{
+    static char path[LOFS_PATH_MAX]; // Scans are serialized by autoMigrateLock
+    uint16_t skip[LOFS_AUTO_MAX_DEPTH + 1];
+    strcpy(path, tierRoot(tier));
+    size_t rootLen = strlen(path);
+    size_t depth = 0;
+    skip[0] = 0;
+
+    while (true) {
+        size_t len = strlen(path);
+        bool descended = false;
+        bool moved = false;
+        {
+            LoFS::DirIterator it(path);
+            uint16_t index = 0;
+            while (it.next()) {
+                if (index++ < skip[depth]) {
+                    continue;
+                }
+                skip[depth]++;
+                size_t nameLen = strlen(it.name());
+                if (len + 1 + nameLen + 1 > sizeof(path)) {
+                    continue; // Too long to address
+                }
+                path[len] = '/';
+                memcpy(path + len + 1, it.name(), nameLen + 1);
+
+                if (it.isDirectory()) {
+                    if (depth < LOFS_AUTO_MAX_DEPTH) {
+                        descended = true;
+                        break;
+                    }
+                } else if (wantsMove(tier, path + rootLen, it.size())) {
+                    it.close(); // Nothing open in this directory while the file moves
+                    if (migrateFile(path + rootLen, tier, (tier == TIER_HOT) ? TIER_COLD : TIER_HOT)) {
+                        skip[depth]--; // The entry left this directory
+                    }
+                    moved = true;
+                    path[len] = '\0';
+                    break;
+                }
+                path[len] = '\0';
+            }
+        }
+
+        if (descended) {
+            skip[++depth] = 0;
+            continue;
+        }
+        if (moved) {
+            continue;
+        }
+        if (depth == 0) {
+            return;
+        }
+        // Back up to the parent
+        depth--;
+        *strrchr(path, '/') = '\0';
+    }
+}
+#endif
+
+LoFS::Backend *LoFS::resolveAuto(const char *rel, char *strippedPath, size_t bufferSize)
+{
+#if LOFS_AUTO_TIER
+    loadAutoIndex();
+
+    // A lookup only: accesses are counted by touchAuto(), since LoFS resolves
+    // a path again internally (lock domain, space accounting)
+    AutoKey key = autoKey(rel);
+    int indexed = -1;
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = findAuto(key);
+        if (entry) {
+            indexed = entry->tier;
+            useAuto(entry);
+        }
+    }
+
+    char full[LOFS_PATH_MAX];
+    int tier = indexed;
+    if (tier < 0 || !tierPath((uint8_t)tier, rel, full, sizeof(full)) || !exists(full)) {
+        // Not indexed, or not where the index says: look on the other tiers
+        bool sd = isSDCardAvailable();
+        tier = -1;
+        if (indexed != TIER_HOT && tierPath(TIER_HOT, rel, full, sizeof(full)) && exists(full)) {
+            tier = TIER_HOT;
+        } else if (indexed != TIER_COLD && sd && tierPath(TIER_COLD, rel, full, sizeof(full)) && exists(full)) {
+            tier = TIER_COLD;
+        }
+        if (tier >= 0) {
+            rememberAuto(key, (uint8_t)tier);
+        } else if (indexed >= 0) {
+            tier = indexed; // Not there yet: created where it was indexed
+        } else {
+            tier = (sd && hotPressure(0)) ? TIER_COLD : TIER_HOT; // New files go to internal flash
+        }
+    }
+
+    if (!tierPath((uint8_t)tier, rel, full, sizeof(full))) {
+        return nullptr;
+    }
+    return resolve(full, strippedPath, bufferSize);
+#else
+    return nullptr;
+#endif
+}
+
+void LoFS::touchAuto(const char *filepath)
+{
+#if LOFS_AUTO_TIER
+    static const char prefix[] = "/auto/";
+    if (!filepath || strncmp(filepath, prefix, sizeof(prefix) - 1) != 0) {
+        return;
+    }
+    AutoKey key = autoKey(filepath + sizeof(prefix) - 2); // Keep the '/'
+    bool scanDue = false;
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = findAuto(key);
+        if (entry) {
+            entry->lastUseMs = millis();
+            if (entry->hits < 255) {
+                entry->hits++;
+            }
+            useAuto(entry);
+        }
+        if (!autoScanPending && millis() - autoLastScanMs >= LOFS_AUTO_SCAN_MS) {
+            autoScanPending = true;
+            scanDue = true;
+        }
+    }
+    if (scanDue) {
+        wakeAsync(); // Without a worker the scan runs from the next processAsync()
+    }
+#endif
+}
+
+#if LOFS_AUTO_TRACK_OPEN
+/**
+ * @brief Open /auto/ file, counted in its index entry until closed
+ */
+class AutoHandle : public fs::FileImpl
+{
+  public:
+    AutoHandle(const AutoKey &key, const File &inner) : key(key), inner(inner), held(true) {}
+    ~AutoHandle() override { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override { return inner.write(buf, size); }
+    size_t read(uint8_t *buf, size_t size) override { return inner.read(buf, size); }
+    void flush() override { inner.flush(); }
+    bool seek(uint32_t offset, fs::SeekMode mode) override { return inner.seek(offset, mode); }
+    size_t position() const override { return inner.position(); }
+    size_t size() const override { return inner.size(); }
+
+    void close() override
+    {
+        if (inner) {
+            inner.close();
+        }
+        if (held) {
+            held = false;
+            LoFS::Lock::Guard g(autoLock);
+            AutoEntry *entry = findAuto(key);
+            if (entry && entry->opens > 0) {
+                entry->opens--;
+            }
+        }
+    }
+
+    time_t getLastWrite() override { return inner.getLastWrite(); }
+    const char *path() const override { return inner.path(); }
+    const char *name() const override { return inner.name(); }
+    boolean isDirectory(void) override { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) override { return fs::FileImplPtr(); }
+    void rewindDirectory(void) override {}
+    operator bool() override { return (bool)inner; }
+
+  private:
+    AutoKey key;
+    File inner;
+    bool held; ///< Still counted in the entry's opens
+};
+#endif
+
+File LoFS::holdAuto(const char *filepath, Backend *backend, File file)
+{
+#if LOFS_AUTO_TRACK_OPEN
+    static const char prefix[] = "/auto/";
+    if (!file || !filepath || strncmp(filepath, prefix, sizeof(prefix) - 1) != 0 || file.isDirectory()) {
+        return file;
+    }
+    AutoKey key = autoKey(filepath + sizeof(prefix) - 2);
+    {
+        LoFS::Lock::Guard g(autoLock);
+        // A file just created is not indexed yet
+        AutoEntry *entry = claimAuto(key, (backend == builtinBackend(FSType::SD)) ? TIER_COLD : TIER_HOT);
+        useAuto(entry);
+        if (entry->opens == 255) {
+            return file; // Too many to count
+        }
+        entry->opens++;
+    }
+    return File(std::make_shared<AutoHandle>(key, file));
+#else
+    (void)backend;
+    return file;
+#endif
+}
+
+void LoFS::scanAuto()
+{
+#if LOFS_AUTO_TIER
+    {
+        LoFS::Lock::Guard g(autoLock);
+        if (!autoScanPending) {
+            return;
+        }
+        autoScanPending = false;
+        autoLastScanMs = millis();
+    }
+
+    loadAutoIndex();
+    LoFS::Lock::Guard m(autoMigrateLock);
+
+    if (isSDCardAvailable()) {
+        scanTier(TIER_HOT);
+
+        bool promote = false;
+        {
+            LoFS::Lock::Guard g(autoLock);
+            for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+                const AutoEntry &entry = autoEntries[i];
+                if (entry.hash && entry.tier == TIER_COLD && entry.hits >= LOFS_AUTO_PROMOTE_HITS) {
+                    promote = true;
+                }
+            }
+        }
+        if (promote) {
+            scanTier(TIER_COLD);
+        }
+
+        // Forget files the scan did not find (removed through LoFS or not files at all)
+        LoFS::Lock::Guard g(autoLock);
+        for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+            AutoEntry &entry = autoEntries[i];
+            bool scanned = (entry.tier == TIER_HOT) || promote;
+            if (entry.hash && scanned && !(entry.flags & AUTO_SEEN)) {
+                entry.hash = 0;
+                autoDirty = true;
+            }
+        }
+    }
+
+    {
+        LoFS::Lock::Guard g(autoLock);
+        for (size_t i = 0; i < LOFS_AUTO_INDEX_ENTRIES; i++) {
+            autoEntries[i].hits = 0;
+            autoEntries[i].flags &= ~AUTO_SEEN;
+        }
+    }
+    saveAutoIndex();
+#endif
+}
+
+void LoFS::rebalanceAuto()
+{
+#if LOFS_AUTO_TIER
+    {
+        LoFS::Lock::Guard g(autoLock);
+        autoScanPending = true;
+    }
+    wakeAsync();
+#endif
+}
+
+bool LoFS::migrate(const char *filepath, FSType tier)
+{
+#if LOFS_AUTO_TIER
+    static const char prefix[] = "/auto/";
+    if (!filepath || strncmp(filepath, prefix, sizeof(prefix) - 1) != 0 ||
+        (tier != FSType::INTERNAL && tier != FSType::SD) || (tier == FSType::SD && !isSDCardAvailable())) {
+        return false;
+    }
+    const char *rel = filepath + sizeof(prefix) - 2; // Keep the '/'
+    AutoKey key = autoKey(rel);
+
+    loadAutoIndex();
+    LoFS::Lock::Guard m(autoMigrateLock);
+
+    int from = -1;
+    {
+        LoFS::Lock::Guard g(autoLock);
+        AutoEntry *entry = findAuto(key);
+        if (entry) {
+            from = entry->tier;
+        }
+    }
+    bool sd = isSDCardAvailable();
+    char full[LOFS_PATH_MAX];
+    if (from < 0 || !tierPath((uint8_t)from, rel, full, sizeof(full)) || !exists(full)) {
+        // Unknown or stale: find it on either tier
+        from = -1;
+        if (tierPath(TIER_HOT, rel, full, sizeof(full)) && exists(full)) {
+            from = TIER_HOT;
+        } else if (sd && tierPath(TIER_COLD, rel, full, sizeof(full)) && exists(full)) {
+            from = TIER_COLD;
+        }
+        if (from < 0) {
+            return false;
+        }
+        rememberAuto(key, (uint8_t)from);
+    }
+    if (from == (int)tier) {
+        return true;
+    }
+    return migrateFile(rel, (uint8_t)from, (uint8_t)tier);
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,453 @@
+#include "Backends.h"
+#include "SPILock.h"
+#include <lofs/Lock.h>
+#include "StatTimer.h"
+#include "configuration.h"
+#include <string.h>
+
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+#include <SD.h>
+#include <SPI.h>
+
+// Use the same SPI handler setup as FSCommon.cpp
+#ifdef SDCARD_USE_SPI1
+extern SPIClass SPI_HSPI;
+#define SDHandler SPI_HSPI
+#else
+#define SDHandler SPI
+#endif
+
+#ifndef SD_SPI_FREQUENCY
+#define SD_SPI_FREQUENCY 4000000U
+#endif
+
+// Where the card's files appear to POSIX calls the SD library has no wrapper
+// for (truncate): its VFS mount point on ESP32 (SD.begin() default). Define
+// it on Portduino as the host directory backing the card.
+#if !defined(LOFS_SD_VFS_ROOT) && defined(ARCH_ESP32)
+#define LOFS_SD_VFS_ROOT "/sd"
+#endif
+#ifdef LOFS_SD_VFS_ROOT
+#include <stdio.h>
+#include <unistd.h>
+#endif
+#endif
+
+// Backoff between init attempts while no card is found
+#ifndef LOFS_SD_RETRY_MIN_MS
+#define LOFS_SD_RETRY_MIN_MS 500
+#endif
+
+#ifndef LOFS_SD_RETRY_MAX_MS
+#define LOFS_SD_RETRY_MAX_MS 30000
+#endif
+
+// Optional card-detect switch; define LOFS_SD_DETECT_PIN per target to enable
+#ifndef LOFS_SD_DETECT_ACTIVE
+#define LOFS_SD_DETECT_ACTIVE LOW ///< Pin level when a card is inserted
+#endif
+
+// Internal flash lock domain: 1 = dedicated lock, 0 = share spiLock. Only
+// safe where the flash filesystem serializes its own calls, because
+// firmware code outside LoFS keeps using spiLock for FSCom.
+#ifndef LOFS_INTERNAL_OWN_LOCK
+#if defined(ARCH_ESP32) || defined(ARCH_NRF52) || defined(ARCH_PORTDUINO)
+#define LOFS_INTERNAL_OWN_LOCK 1
+#else
+#define LOFS_INTERNAL_OWN_LOCK 0
+#endif
+#endif
+
+// Let internal flash readers run concurrently (needs a dedicated lock)
+#ifndef LOFS_INTERNAL_SHARED_READS
+#define LOFS_INTERNAL_SHARED_READS LOFS_INTERNAL_OWN_LOCK
+#endif
+
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+static LoFS::SDState sdCardState = LoFS::SDState::RETRYING;
+static uint32_t sdLastProbeMs = 0;
+static uint32_t sdBackoffMs = 0; // 0 = probe on first use
+#ifdef LOFS_SD_DETECT_PIN
+static bool sdDetectConfigured = false;
+#endif
+#else
+static LoFS::SDState sdCardState = LoFS::SDState::ABSENT;
+#endif
+static LoFS::SDStateCallback sdStateCallback = nullptr;
+
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+// Serializes probes and state changes; never held while listeners run, as they may use the card
+static LoFS::Lock *const sdProbeLock = new LoFS::Lock();
+
+// Update the cached state (caller holds sdProbeLock); true if listeners must be told
+static bool setSDState(LoFS::SDState state)
+{
+    if (state == sdCardState) {
+        return false;
+    }
+    bool wasPresent = (sdCardState == LoFS::SDState::PRESENT);
+    sdCardState = state;
+    // Only insert/remove transitions are interesting to listeners
+    return wasPresent != (state == LoFS::SDState::PRESENT);
+}
+
+// Tell listeners about an insert or removal (without sdProbeLock)
+static void announceSDState(LoFS::SDState state)
+{
+    // A different card (or none) may be in the slot now
+    LoFS::flushExistsCache();
+    LoFS::invalidateSpaceInfo();
+    if (state == LoFS::SDState::PRESENT) {
+        LoFS::rebalanceAuto(); // Catch up on demotions held back while the card was out
+    }
+    if (sdStateCallback) {
+        sdStateCallback(state);
+    }
+}
+
+// The mounted card still answers: its type is known and the root opens
+static bool sdCardResponds()
+{
+    if (SD.cardType() == CARD_NONE) {
+        return false;
+    }
+    File root = SD.open("/");
+    bool ok = (bool)root;
+    if (root) {
+        root.close();
+    }
+    return ok;
+}
+
+/**
+ * @brief Initialize the card over SPI and update the cached state (caller holds sdProbeLock)
+ * @param forceReinit Drop any earlier mount first, e.g. after the detect pin reported a removal
+ * @param changed Set if listeners must be told about the new state
+ *
+ * A card that was present is only re-checked. SD.end() would invalidate every
+ * open SD File (logs, KV writers, copies in flight), so the mount is only torn
+ * down once the card stops answering.
+ */
+static bool probeSDCard(bool forceReinit, bool *changed)
+{
+    bool present;
+    uint32_t startUs = micros();
+    {
+        LoFS::LockDomain::Guard g(LoFS::LockDomain::spi());
+        bool mounted = (sdCardState == LoFS::SDState::PRESENT);
+        present = mounted && sdCardResponds();
+        if (!present) {
+#ifdef ARCH_ESP32
+            // SD.begin() does nothing while an earlier mount is still registered
+            if (forceReinit || mounted) {
+                SD.end();
+            }
+#endif
+            // The firmware may already have mounted the card (FSCommon setupSDCard)
+            present = (SD.cardType() != CARD_NONE);
+            if (!present) {
+                SDHandler.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
+                present = SD.begin(SDCARD_CS, SDHandler, SD_SPI_FREQUENCY) && SD.cardType() != CARD_NONE;
+            }
+        }
+    }
+
+    lofsRecordSDProbe(present, micros() - startUs);
+    sdLastProbeMs = millis();
+    if (present) {
+        sdBackoffMs = LOFS_SD_RETRY_MIN_MS;
+        *changed = setSDState(LoFS::SDState::PRESENT);
+    } else {
+        sdBackoffMs = (sdBackoffMs == 0) ? LOFS_SD_RETRY_MIN_MS : sdBackoffMs * 2;
+        if (sdBackoffMs > LOFS_SD_RETRY_MAX_MS) {
+            sdBackoffMs = LOFS_SD_RETRY_MAX_MS;
+        }
+        *changed = setSDState(LoFS::SDState::RETRYING);
+    }
+    return present;
+}
+
+#ifdef LOFS_SD_DETECT_PIN
+// Returns false when the detect switch reports an empty slot
+static bool sdCardInserted()
+{
+    if (!sdDetectConfigured) {
+        pinMode(LOFS_SD_DETECT_PIN, INPUT_PULLUP);
+        sdDetectConfigured = true;
+    }
+    return digitalRead(LOFS_SD_DETECT_PIN) == LOFS_SD_DETECT_ACTIVE;
+}
+#endif
+
+// Probe if due, or now for refresh (caller holds sdProbeLock)
+static bool updateSDState(bool refresh, bool *changed)
+{
+#ifdef LOFS_SD_DETECT_PIN
+    // A GPIO read is cheap enough for every call and catches removal immediately
+    if (!sdCardInserted()) {
+        *changed = setSDState(LoFS::SDState::ABSENT);
+        return false;
+    }
+    if (sdCardState == LoFS::SDState::ABSENT) {
+        // Card was just inserted: probe now instead of waiting out the backoff
+        return probeSDCard(true, changed);
+    }
+#endif
+    if (refresh) {
+        return probeSDCard(true, changed);
+    }
+    if (sdCardState == LoFS::SDState::PRESENT) {
+        return true; // Probed by another task meanwhile, or still in according to the detect pin
+    }
+    // Retrying: only touch the bus once the backoff has elapsed
+    if (sdBackoffMs != 0 && (uint32_t)(millis() - sdLastProbeMs) < sdBackoffMs) {
+        return false;
+    }
+    return probeSDCard(false, changed);
+}
+
+static bool checkSDCard(bool refresh)
+{
+    bool present;
+    bool changed = false;
+    LoFS::SDState state;
+    {
+        LoFS::Lock::Guard g(sdProbeLock);
+        present = updateSDState(refresh, &changed);
+        state = sdCardState;
+    }
+    if (changed) {
+        announceSDState(state);
+    }
+    return present;
+}
+#endif
+
+bool LoFS::isSDCardAvailable()
+{
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+#ifndef LOFS_SD_DETECT_PIN
+    // Once the card is present this is a flag read with no lock
+    if (sdCardState == SDState::PRESENT) {
+        return true;
+    }
+#endif
+    return checkSDCard(false);
+#else
+    return false; // SD card support not compiled in or disabled
+#endif
+}
+
+LoFS::SDState LoFS::sdState()
+{
+    return sdCardState;
+}
+
+bool LoFS::refreshSD()
+{
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+    return checkSDCard(true);
+#else
+    return false;
+#endif
+}
+
+void LoFS::onSDStateChange(SDStateCallback callback)
+{
+    sdStateCallback = callback;
+}
+
+// Helper to convert mode to SD library mode
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+// ESP32/RP2040: SD library uses string modes
+#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
+static const char *convertToSDMode(const char *modeStr)
+{
+    // Already a string, return as-is
+    return modeStr;
+}
+#else
+// STM32WL/NRF52: SD library uses uint8_t modes
+static uint8_t convertToSDMode(const char *modeStr)
+{
+    if (strcmp(modeStr, "r") == 0) {
+        return FILE_READ;
+    }
+    return FILE_WRITE;
+}
+#endif
+#endif
+
+// ---------------------------------------------------------------------------
+// InternalBackend
+// ---------------------------------------------------------------------------
+
+LoFS::LockDomain &InternalBackend::lockDomain()
+{
+#if LOFS_INTERNAL_OWN_LOCK
+    static LoFS::LockDomain domain(LoFS::LockDomain::Kind::OWN, LOFS_INTERNAL_SHARED_READS);
+    return domain;
+#else
+    return LoFS::LockDomain::spi();
+#endif
+}
+
+File InternalBackend::open(const char *path, const char *mode)
+{
+#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
+    // ESP32/RP2040: Use string mode directly
+    return FSCom.open(path, mode);
+#else
+    // STM32WL/NRF52: Convert string mode to uint8_t
+    // "r" -> 0 (FILE_O_READ), "w" -> 1 (FILE_O_WRITE)
+    uint8_t modeInt = (strcmp(mode, "r") == 0) ? FILE_O_READ : FILE_O_WRITE;
+    return FSCom.open(path, modeInt);
+#endif
+}
+
+bool InternalBackend::exists(const char *path)
+{
+    return FSCom.exists(path);
+}
+
+bool InternalBackend::mkdir(const char *path)
+{
+    return FSCom.mkdir(path);
+}
+
+bool InternalBackend::remove(const char *path)
+{
+    return FSCom.remove(path);
+}
+
+bool InternalBackend::rename(const char *oldpath, const char *newpath)
+{
+    return FSCom.rename(oldpath, newpath);
+}
+
+bool InternalBackend::rmdir(const char *path)
+{
+    return FSCom.rmdir(path);
+}
+
+uint64_t InternalBackend::totalBytes()
+{
+    return FSCom.totalBytes();
+}
+
+uint64_t InternalBackend::usedBytes()
+{
+    return FSCom.usedBytes();
+}
+
+// ---------------------------------------------------------------------------
+// SDBackend
+// ---------------------------------------------------------------------------
+
+bool SDBackend::isAvailable()
+{
+    return LoFS::isSDCardAvailable();
+}
+
+#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
+
+File SDBackend::open(const char *path, const char *mode)
+{
+    return SD.open(path, convertToSDMode(mode));
+}
+
+bool SDBackend::exists(const char *path)
+{
+    return SD.exists(path);
+}
+
+bool SDBackend::mkdir(const char *path)
+{
+    return SD.mkdir(path);
+}
+
+bool SDBackend::remove(const char *path)
+{
+    return SD.remove(path);
+}
+
+bool SDBackend::rename(const char *oldpath, const char *newpath)
+{
+    return SD.rename(oldpath, newpath);
+}
+
+bool SDBackend::rmdir(const char *path)
+{
+    return SD.rmdir(path);
+}
+
+bool SDBackend::truncate(const char *path, uint32_t size)
+{
+#ifdef LOFS_SD_VFS_ROOT
+    char full[LOFS_PATH_MAX];
+    int len = snprintf(full, sizeof(full), "%s/%s", LOFS_SD_VFS_ROOT, (path[0] == '/') ? path + 1 : path);
+    return len > 0 && (size_t)len < sizeof(full) && ::truncate(full, (off_t)size) == 0;
+#else
+    return false;
+#endif
+}
+
+uint64_t SDBackend::totalBytes()
+{
+    return SD.totalBytes();
+}
+
+uint64_t SDBackend::usedBytes()
+{
+    return SD.usedBytes();
+}
+
+#else
+
+// SD support not compiled in: isAvailable() is always false, so these are never reached
+File SDBackend::open(const char *, const char *)
+{
+    return File();
+}
+
+bool SDBackend::exists(const char *)
+{
+    return false;
+}
+
+bool SDBackend::mkdir(const char *)
+{
+    return false;
+}
+
+bool SDBackend::remove(const char *)
+{
+    return false;
+}
+
+bool SDBackend::rename(const char *, const char *)
+{
+    return false;
+}
+
+bool SDBackend::rmdir(const char *)
+{
+    return false;
+}
+
+bool SDBackend::truncate(const char *, uint32_t)
+{
+    return false;
+}
+
+uint64_t SDBackend::totalBytes()
+{
+    return 0;
+}
+
+uint64_t SDBackend::usedBytes()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+/**
+ * @brief Internal flash backend (FSCom from FSCommon.h), mounted at /internal/
+ */
+class InternalBackend : public LoFS::Backend
+{
+  public:
+    LoFS::LockDomain &lockDomain() override;
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *oldpath, const char *newpath) override;
+    bool rmdir(const char *path) override;
+    uint64_t totalBytes() override;
+    uint64_t usedBytes() override;
+};
+
+/**
+ * @brief SD card backend (Arduino SD library), mounted at /sd/
+ *
+ * Always mounted so that /sd/ paths fail cleanly when SD support is not
+ * compiled in, instead of falling through to internal flash.
+ */
+class SDBackend : public LoFS::Backend
+{
+  public:
+    bool isAvailable() override;
+    bool leadingSlash() const override { return false; }
+    File open(const char *path, const char *mode) override;
+    bool exists(const char *path) override;
+    bool mkdir(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *oldpath, const char *newpath) override;
+    bool rmdir(const char *path) override;
+    bool truncate(const char *path, uint32_t size) override;
+    uint64_t totalBytes() override;
+    uint64_t usedBytes() override;
+};
@@ -0,0 +1,233 @@
+#include <lofs/Batch.h>
+#include <lofs/Backend.h>
+#include <lofs/LockDomain.h>
+#include "StatTimer.h"
+#include "configuration.h"
+#include <stdlib.h>
+#include <string.h>
+
+LoFS::Batch::Batch(size_t maxOps, size_t pathBytes)
+    : ops(nullptr), paths(nullptr), maxOps(maxOps), pathBytes(pathBytes), count(0), pathsUsed(0)
+{
+    ops = (Op *)malloc(maxOps * sizeof(Op));
+    paths = (char *)malloc(pathBytes);
+    if (!ops || !paths) {
+        // Out of memory: every add() reports a full batch
+        free(ops);
+        free(paths);
+        ops = nullptr;
+        paths = nullptr;
+        this->maxOps = 0;
+        this->pathBytes = 0;
+    }
+}
+
+LoFS::Batch::~Batch()
+{
+    free(ops);
+    free(paths);
+}
+
+int LoFS::Batch::exists(const char *filepath)
+{
+    return add(Kind::EXISTS, filepath);
+}
+
+int LoFS::Batch::mkdir(const char *filepath)
+{
+    return add(Kind::MKDIR, filepath);
+}
+
+int LoFS::Batch::remove(const char *filepath)
+{
+    return add(Kind::REMOVE, filepath);
+}
+
+int LoFS::Batch::rmdir(const char *filepath)
+{
+    return add(Kind::RMDIR, filepath);
+}
+
+int LoFS::Batch::add(Kind kind, const char *filepath)
+{
+    if (count == maxOps) {
+        return -1;
+    }
+    Op &op = ops[count];
+    op.kind = kind;
+    op.result = false;
+    op.pathOffset = pathsUsed;
+    op.backend = LoFS::resolve(filepath, paths + pathsUsed, pathBytes - pathsUsed);
+    LoFS::touchAuto(filepath);
+    if (op.backend) {
+        op.status = Status::PENDING;
+        pathsUsed += strlen(paths + pathsUsed) + 1;
+    } else {
+        op.status = Status::INVALID;
+    }
+    return (int)count++;
+}
+
+size_t LoFS::Batch::failures() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].status == Status::FAILED || ops[i].status == Status::INVALID) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void LoFS::Batch::clear()
+{
+    count = 0;
+    pathsUsed = 0;
+}
+
+bool LoFS::Batch::run(Policy policy)
+{
+    bool stopOnError = (policy == Policy::STOP_ON_ERROR);
+    bool ok = (failures() == 0);
+    bool stop = stopOnError && !ok; // Invalid paths were found up front: run nothing
+
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].status != Status::PENDING) {
+            continue;
+        }
+        if (stop) {
+            ops[i].status = Status::SKIPPED;
+            continue;
+        }
+        if (!runGroup(i, stopOnError)) {
+            ok = false;
+            stop = stopOnError;
+        }
+    }
+    return ok;
+}
+
+// Run every pending operation on ops[first].backend under one lock hold
+bool LoFS::Batch::runGroup(size_t first, bool stopOnError)
+{
+    Backend *backend = ops[first].backend;
+
+    // Cached blocks are dropped up front, outside the backend lock; a shared
+    // lock is enough when the group only queries
+    bool readOnly = true;
+    for (size_t i = first; i < count; i++) {
+        Op &op = ops[i];
+        if (op.backend != backend || op.status != Status::PENDING) {
+            continue;
+        }
+        if (op.kind == Kind::REMOVE) {
+            LoFS::invalidateCache(backend, paths + op.pathOffset);
+        }
+        if (op.kind != Kind::EXISTS) {
+            readOnly = false;
+        }
+    }
+
+    // Checked before locking: for /sd/ it may probe the card, which takes
+    // spiLock itself (non-recursive) and can run onSDStateChange callbacks
+    bool available = backend->isAvailable();
+    bool tracked = !readOnly && LoFS::spaceTracked(backend);
+    uint64_t freed = 0;
+    bool ok;
+    if (readOnly) {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        ok = execute(first, stopOnError, available, tracked, &freed);
+    } else {
+        LockDomain::Guard g(backend->lockDomain());
+        ok = execute(first, stopOnError, available, tracked, &freed);
+    }
+
+    if (freed > 0) {
+        LoFS::spaceAdjust(backend, -(int64_t)freed);
+    }
+    return ok;
+}
+
+// Body of runGroup(); the caller holds the backend's lock
+bool LoFS::Batch::execute(size_t first, bool stopOnError, bool available, bool tracked, uint64_t *freed)
+{
+    Backend *backend = ops[first].backend;
+    bool ok = true;
+    bool stop = false;
+
+    for (size_t i = first; i < count; i++) {
+        Op &op = ops[i];
+        if (op.backend != backend || op.status != Status::PENDING) {
+            continue;
+        }
+        if (stop) {
+            op.status = Status::SKIPPED;
+            continue;
+        }
+        const char *path = paths + op.pathOffset;
+        if (!available) {
+            op.status = Status::INVALID;
+            ok = false;
+            stop = stopOnError;
+            continue;
+        }
+
+        uint32_t generation = 0;
+        switch (op.kind) {
+        case Kind::EXISTS: {
+            StatTimer t(backend, Stats::Op::EXISTS);
+            if (!LoFS::dentryLookup(backend, path, &op.result, &generation)) {
+                op.result = backend->exists(path);
+                LoFS::dentryStore(backend, path, op.result, generation);
+            }
+            t.result(true); // false means absent, as in LoFS::exists()
+            break;
+        }
+        case Kind::MKDIR: {
+            StatTimer t(backend, Stats::Op::MKDIR);
+            op.result = t.result(backend->mkdir(path));
+            if (op.result) {
+                LoFS::dentrySet(backend, path, true);
+            } else {
+                LoFS::dentryForget(backend, path, false);
+            }
+            break;
+        }
+        case Kind::REMOVE: {
+            StatTimer t(backend, Stats::Op::REMOVE);
+            uint64_t size = tracked ? LoFS::fileLength(backend, path) : 0;
+            op.result = t.result(backend->remove(path));
+            if (op.result) {
+                *freed += size;
+                LoFS::dentrySet(backend, path, false);
+            } else {
+                LoFS::dentryForget(backend, path, false);
+            }
+            break;
+        }
+        case Kind::RMDIR: {
+            StatTimer t(backend, Stats::Op::RMDIR);
+            op.result = !backend->exists(path);
+            if (!op.result) {
+                // Some backends' rmdir also deletes regular files; LoFS::rmdir only removes directories
+                File dir = backend->open(path, "r");
+                bool isDir = dir && dir.isDirectory();
+                dir.close();
+                op.result = isDir && backend->rmdir(path);
+            }
+            t.result(op.result);
+            LoFS::dentryForget(backend, path, false);
+            break;
+        }
+        }
+
+        if (op.result || op.kind == Kind::EXISTS) {
+            op.status = Status::DONE;
+        } else {
+            op.status = Status::FAILED;
+            ok = false;
+            stop = stopOnError;
+        }
+    }
+    return ok;
+}
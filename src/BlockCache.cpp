@@ -0,0 +1,476 @@
+#include <lofs/Backend.h>
+#include <lofs/CachedFile.h>
+#include <lofs/Lock.h>
+#include "PathHash.h"
+#include "configuration.h"
+#include <string.h>
+#include <stdlib.h>
+
+// openCachedFile() hands the reader out through the ESP32-style fs::FileImpl
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#include <FSImpl.h>
+#endif
+
+// Set LOFS_BLOCK_CACHE_BLOCKS to 0 to compile the cache out (openCached() reads straight through)
+#ifndef LOFS_BLOCK_CACHE_BLOCKS
+#define LOFS_BLOCK_CACHE_BLOCKS 8
+#endif
+
+// One SD sector by default; must be a power of two
+#ifndef LOFS_BLOCK_CACHE_BLOCK_SIZE
+#define LOFS_BLOCK_CACHE_BLOCK_SIZE 512
+#endif
+
+static_assert((LOFS_BLOCK_CACHE_BLOCK_SIZE & (LOFS_BLOCK_CACHE_BLOCK_SIZE - 1)) == 0,
+              "LOFS_BLOCK_CACHE_BLOCK_SIZE must be a power of two");
+
+// Files known to the cache: open CachedFiles plus files that still have blocks
+#ifndef LOFS_BLOCK_CACHE_FILES
+#define LOFS_BLOCK_CACHE_FILES (LOFS_BLOCK_CACHE_BLOCKS + 4)
+#endif
+
+struct CacheBlock {
+    uint32_t fileId;   ///< CacheFile::id of the owner
+    uint32_t index;    ///< Block number within the file
+    uint32_t lastUse;  ///< LRU tick
+    uint16_t len;      ///< Valid bytes (short for the last block of a file)
+    bool valid;
+    bool loading; ///< Being read outside cacheLock: neither a hit nor a victim
+    bool stale;   ///< Invalidated while loading, so not published
+};
+
+/// A file's identity, interned so blocks compare one id rather than a path
+struct CacheFile {
+    LoFS::Backend *backend;
+    char *path;    ///< Stripped path (heap); nullptr = free slot
+    uint32_t hash; ///< lofsPathHash() of backend + path, to skip most strcmp()s
+    uint32_t id;   ///< Never reused, so a stale id cannot match another file
+    uint16_t refs; ///< Open CachedFiles using this entry
+};
+
+static LoFS::CacheStats cacheCounters;
+
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+static CacheBlock cacheBlocks[LOFS_BLOCK_CACHE_BLOCKS];
+static CacheFile cacheFiles[LOFS_BLOCK_CACHE_FILES];
+static uint8_t *cacheData = nullptr; // LOFS_BLOCK_CACHE_BLOCKS * LOFS_BLOCK_CACHE_BLOCK_SIZE, allocated on first use
+static uint32_t cacheTick = 0;
+static uint32_t cacheNextId = 0;
+static LoFS::Lock *const cacheLock = new LoFS::Lock();
+
+// Callers hold cacheLock
+static CacheFile *findCacheFile(LoFS::Backend *backend, const char *strippedPath, uint32_t hash)
+{
+    for (size_t i = 0; i < LOFS_BLOCK_CACHE_FILES; i++) {
+        CacheFile &f = cacheFiles[i];
+        if (f.path && f.hash == hash && f.backend == backend && strcmp(f.path, strippedPath) == 0) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+static CacheFile *findCacheFile(uint32_t id)
+{
+    for (size_t i = 0; i < LOFS_BLOCK_CACHE_FILES; i++) {
+        if (cacheFiles[i].path && cacheFiles[i].id == id) {
+            return &cacheFiles[i];
+        }
+    }
+    return nullptr;
+}
+
+static void dropBlocks(uint32_t id, uint32_t &counter)
+{
+    for (size_t i = 0; i < LOFS_BLOCK_CACHE_BLOCKS; i++) {
+        CacheBlock &block = cacheBlocks[i];
+        if ((block.valid || block.loading) && block.fileId == id) {
+            block.valid = false;
+            block.stale = block.loading;
+            counter++;
+        }
+    }
+}
+
+// Copy from a block to the caller and mark it used (caller holds cacheLock)
+static size_t copyFromBlock(CacheBlock *block, uint32_t offset, uint8_t *buf, size_t want)
+{
+    block->lastUse = ++cacheTick;
+    size_t chunk = block->len - offset;
+    if (chunk > want) {
+        chunk = want;
+    }
+    memcpy(buf, cacheData + (block - cacheBlocks) * LOFS_BLOCK_CACHE_BLOCK_SIZE + offset, chunk);
+    return chunk;
+}
+
+/**
+ * @brief Id for backend + path, taking a reference on it
+ * @return 0 if every entry is in use by an open CachedFile (the file is then read uncached)
+ */
+static uint32_t retainCacheFile(LoFS::Backend *backend, const char *strippedPath)
+{
+    uint32_t hash = lofsPathHash(backend, strippedPath);
+    LoFS::Lock::Guard g(cacheLock);
+    CacheFile *f = findCacheFile(backend, strippedPath, hash);
+    if (!f) {
+        // Reuse a free entry, else one no open file needs, with its blocks
+        for (size_t i = 0; i < LOFS_BLOCK_CACHE_FILES && !f; i++) {
+            if (!cacheFiles[i].path) {
+                f = &cacheFiles[i];
+            }
+        }
+        for (size_t i = 0; i < LOFS_BLOCK_CACHE_FILES && !f; i++) {
+            if (cacheFiles[i].refs == 0) {
+                f = &cacheFiles[i];
+                dropBlocks(f->id, cacheCounters.evictions);
+                free(f->path);
+                f->path = nullptr;
+            }
+        }
+        if (!f) {
+            return 0;
+        }
+        f->path = strdup(strippedPath);
+        if (!f->path) {
+            return 0;
+        }
+        f->backend = backend;
+        f->hash = hash;
+        f->id = ++cacheNextId ? cacheNextId : ++cacheNextId;
+        f->refs = 0;
+    }
+    f->refs++;
+    return f->id;
+}
+
+static void retainCacheFile(uint32_t id)
+{
+    if (id == 0) {
+        return;
+    }
+    LoFS::Lock::Guard g(cacheLock);
+    CacheFile *f = findCacheFile(id);
+    if (f) {
+        f->refs++;
+    }
+}
+
+static void releaseCacheFile(uint32_t id)
+{
+    if (id == 0) {
+        return;
+    }
+    LoFS::Lock::Guard g(cacheLock);
+    CacheFile *f = findCacheFile(id);
+    if (f && f->refs > 0) {
+        f->refs--; // The entry and its blocks stay for the next open of the file
+    }
+}
+#endif
+
+void LoFS::invalidateCache(Backend *backend, const char *strippedPath, bool subtree)
+{
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    if (subtree) {
+        // Files below a renamed or removed directory: compare path prefixes
+        size_t len = strlen(strippedPath);
+        while (len > 0 && strippedPath[len - 1] == '/') {
+            len--;
+        }
+        LoFS::Lock::Guard g(cacheLock);
+        for (size_t i = 0; i < LOFS_BLOCK_CACHE_FILES; i++) {
+            CacheFile &f = cacheFiles[i];
+            if (f.path && f.backend == backend && strncmp(f.path, strippedPath, len) == 0 &&
+                (f.path[len] == '\0' || f.path[len] == '/' || len == 0)) {
+                dropBlocks(f.id, cacheCounters.invalidations);
+            }
+        }
+        return;
+    }
+    uint32_t hash = lofsPathHash(backend, strippedPath);
+    LoFS::Lock::Guard g(cacheLock);
+    CacheFile *f = findCacheFile(backend, strippedPath, hash);
+    if (f) {
+        dropBlocks(f->id, cacheCounters.invalidations);
+    }
+#else
+    (void)subtree;
+#endif
+}
+
+LoFS::CachedFile LoFS::openCached(const char *filepath)
+{
+    CachedFile result;
+    char *strippedPath = nullptr;
+    Backend *backend = parsePath(filepath, &strippedPath);
+
+    if (!strippedPath || !backend) {
+        if (strippedPath) {
+            free(strippedPath);
+        }
+        return result;
+    }
+
+    result.backend = backend;
+    {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        result.file = backend->open(strippedPath, "r");
+        if (result.file) {
+            result.fileSize = result.file.size();
+        }
+    }
+    result.file = holdAuto(filepath, backend, result.file);
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    if (result.file) {
+        result.fileId = retainCacheFile(backend, strippedPath);
+    }
+#endif
+
+    free(strippedPath);
+    return result;
+}
+
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+/**
+ * @brief CachedFile as the implementation of a read-only File
+ */
+class LoFS::CachedFile::Handle : public fs::FileImpl
+{
+  public:
+    explicit Handle(const CachedFile &cached) : cached(cached) {}
+    ~Handle() override { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override { return 0; }
+    size_t read(uint8_t *buf, size_t size) override { return cached.read(buf, size); }
+    void flush() override {}
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override
+    {
+        size_t base = (mode == fs::SeekCur) ? cached.position() : (mode == fs::SeekEnd) ? cached.size() : 0;
+        return cached.seek(base + offset);
+    }
+
+    size_t position() const override { return cached.position(); }
+    size_t size() const override { return cached.size(); }
+    void close() override { cached.close(); }
+
+    time_t getLastWrite() override { return cached.file ? cached.file.getLastWrite() : 0; }
+    const char *path() const override { return cached.file ? cached.file.path() : ""; }
+    const char *name() const override { return cached.file ? cached.file.name() : ""; }
+    boolean isDirectory(void) override { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) override { return fs::FileImplPtr(); }
+    void rewindDirectory(void) override {}
+    operator bool() override { return (bool)cached; }
+
+  private:
+    CachedFile cached;
+};
+
+File LoFS::openCachedFile(const char *filepath)
+{
+    CachedFile cached = openCached(filepath);
+    if (!cached) {
+        return File();
+    }
+    return File(std::make_shared<CachedFile::Handle>(cached));
+}
+#endif
+
+LoFS::CacheStats LoFS::cacheStats()
+{
+    CacheStats stats = cacheCounters;
+    stats.blocks = LOFS_BLOCK_CACHE_BLOCKS;
+    stats.blockSize = LOFS_BLOCK_CACHE_BLOCK_SIZE;
+    return stats;
+}
+
+void LoFS::resetCacheStats()
+{
+    memset(&cacheCounters, 0, sizeof(cacheCounters));
+}
+
+LoFS::CachedFile::CachedFile(const CachedFile &other)
+    : backend(other.backend), file(other.file), fileId(other.fileId), pos(other.pos), fileSize(other.fileSize)
+{
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    retainCacheFile(fileId);
+#endif
+}
+
+LoFS::CachedFile &LoFS::CachedFile::operator=(const CachedFile &other)
+{
+    if (this != &other) {
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+        retainCacheFile(other.fileId);
+        releaseCacheFile(fileId);
+#endif
+        backend = other.backend;
+        file = other.file;
+        fileId = other.fileId;
+        pos = other.pos;
+        fileSize = other.fileSize;
+    }
+    return *this;
+}
+
+LoFS::CachedFile::~CachedFile()
+{
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    releaseCacheFile(fileId);
+#endif
+}
+
+size_t LoFS::CachedFile::read(uint8_t *buf, size_t size)
+{
+    if (!file || pos >= fileSize) {
+        return 0;
+    }
+    if (size > fileSize - pos) {
+        size = fileSize - pos;
+    }
+
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    size_t done = 0;
+    bool cached = fileId != 0;
+    while (cached && done < size) {
+        uint32_t index = pos / LOFS_BLOCK_CACHE_BLOCK_SIZE;
+        uint32_t offset = pos % LOFS_BLOCK_CACHE_BLOCK_SIZE;
+        size_t chunk = 0;
+        CacheBlock *block = nullptr;
+        bool load = false;
+        {
+            LoFS::Lock::Guard g(cacheLock);
+            if (!cacheData) {
+                cacheData = (uint8_t *)malloc(LOFS_BLOCK_CACHE_BLOCKS * LOFS_BLOCK_CACHE_BLOCK_SIZE);
+                if (!cacheData) {
+                    cached = false; // No memory for the cache: fall back to direct reads below
+                    break;
+                }
+            }
+
+            // Look up the block, remembering the least recently used idle slot as the victim
+            CacheBlock *victim = nullptr;
+            for (size_t i = 0; i < LOFS_BLOCK_CACHE_BLOCKS; i++) {
+                CacheBlock &candidate = cacheBlocks[i];
+                if (candidate.valid && candidate.fileId == fileId && candidate.index == index) {
+                    block = &candidate;
+                    break;
+                }
+                if (!candidate.loading &&
+                    (!victim || (victim->valid && (!candidate.valid || candidate.lastUse < victim->lastUse)))) {
+                    victim = &candidate;
+                }
+            }
+
+            if (block) {
+                cacheCounters.hits++;
+                chunk = copyFromBlock(block, offset, buf + done, size - done);
+            } else if (!victim) {
+                cached = false; // Every slot is being loaded: read directly
+                break;
+            } else {
+                cacheCounters.misses++;
+                if (victim->valid) {
+                    cacheCounters.evictions++;
+                }
+                block = victim;
+                block->valid = false;
+                block->loading = true;
+                block->stale = false;
+                block->fileId = fileId;
+                block->index = index;
+                load = true;
+            }
+        }
+
+        if (load) {
+            // Only the backend's lock is held for the read, so other files go on hitting the cache
+            uint8_t *data = cacheData + (block - cacheBlocks) * LOFS_BLOCK_CACHE_BLOCK_SIZE;
+            size_t got;
+            {
+                LockDomain::SharedGuard io(backend->lockDomain());
+                got = file.seek(index * LOFS_BLOCK_CACHE_BLOCK_SIZE) ? file.read(data, LOFS_BLOCK_CACHE_BLOCK_SIZE) : 0;
+            }
+            LoFS::Lock::Guard g(cacheLock);
+            block->loading = false;
+            if (got <= offset) {
+                break; // File shrank underneath us
+            }
+            // Another reader may have loaded the same block meanwhile
+            for (size_t i = 0; i < LOFS_BLOCK_CACHE_BLOCKS && !block->stale; i++) {
+                const CacheBlock &other = cacheBlocks[i];
+                block->stale = other.valid && other.fileId == fileId && other.index == index;
+            }
+            block->len = (uint16_t)got;
+            block->valid = !block->stale;
+            chunk = copyFromBlock(block, offset, buf + done, size - done);
+        }
+        if (chunk == 0) {
+            break; // A cached block ends before pos: the file was truncated since it was opened
+        }
+        done += chunk;
+        pos += chunk;
+    }
+    if (done == size || cached) {
+        return done;
+    }
+    // No cache entry for this file, or no memory for the cache: read the remainder directly
+    buf += done;
+    size -= done;
+#else
+    size_t done = 0;
+#endif
+
+    size_t got;
+    {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        got = file.seek(pos) ? file.read(buf, size) : 0;
+    }
+    pos += got;
+    return done + got;
+}
+
+int LoFS::CachedFile::read()
+{
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+}
+
+int LoFS::CachedFile::peek()
+{
+    uint8_t c;
+    if (read(&c, 1) != 1) {
+        return -1;
+    }
+    pos--;
+    return c;
+}
+
+int LoFS::CachedFile::available()
+{
+    return (file && pos < fileSize) ? (int)(fileSize - pos) : 0;
+}
+
+bool LoFS::CachedFile::seek(uint32_t newPos)
+{
+    if (!file || newPos > fileSize) {
+        return false;
+    }
+    pos = newPos;
+    return true;
+}
+
+void LoFS::CachedFile::close()
+{
+    if (file) {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        file.close();
+    }
+#if LOFS_BLOCK_CACHE_BLOCKS > 0
+    releaseCacheFile(fileId);
+#endif
+    fileId = 0;
+    pos = 0;
+    fileSize = 0;
+}
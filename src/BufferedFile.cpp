@@ -0,0 +1,208 @@
+#include <lofs/BufferedFile.h>
+#include <lofs/LockDomain.h>
+#include "configuration.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Flash program unit assumed for alignment and for the amplification estimate
+#ifndef LOFS_WRITE_PAGE_SIZE
+#define LOFS_WRITE_PAGE_SIZE 256
+#endif
+
+static LoFS::WriteStats writeCounters;
+
+// Whole pages a write of len bytes at offset touches; a partial page costs a full program
+static uint64_t pagesTouched(size_t offset, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    return (uint64_t)((offset + len - 1) / LOFS_WRITE_PAGE_SIZE - offset / LOFS_WRITE_PAGE_SIZE + 1) *
+           LOFS_WRITE_PAGE_SIZE;
+}
+
+LoFS::BufferedFile LoFS::open(const char *filepath, const char *mode, const Buffered &options)
+{
+    BufferedFile result;
+    if (!mode || (mode[0] != 'w' && mode[0] != 'a')) {
+        return result; // Write-only
+    }
+    result.file = open(filepath, mode);
+    if (!result.file) {
+        return result;
+    }
+    result.domain = &lockDomain(filepath);
+    if (mode[0] == 'a') {
+        LockDomain::SharedGuard g(*result.domain);
+        result.fileOffset = result.file.size();
+    }
+
+    // Whole pages, so a full buffer always ends on a page boundary once aligned
+    size_t pages = (options.size + LOFS_WRITE_PAGE_SIZE - 1) / LOFS_WRITE_PAGE_SIZE;
+    result.capacity = (pages ? pages : 1) * LOFS_WRITE_PAGE_SIZE;
+    result.buffer = (uint8_t *)malloc(result.capacity);
+    if (!result.buffer) {
+        result.capacity = 0;
+    }
+    result.flushMs = options.flushMs;
+    return result;
+}
+
+LoFS::WriteStats LoFS::writeStats()
+{
+    return writeCounters;
+}
+
+void LoFS::resetWriteStats()
+{
+    memset(&writeCounters, 0, sizeof(writeCounters));
+}
+
+LoFS::BufferedFile::BufferedFile()
+    : domain(nullptr), buffer(nullptr), capacity(0), used(0), fileOffset(0), flushMs(0), bufferedSinceMs(0)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+LoFS::BufferedFile::BufferedFile(BufferedFile &&other) : BufferedFile()
+{
+    *this = static_cast<BufferedFile &&>(other);
+}
+
+LoFS::BufferedFile &LoFS::BufferedFile::operator=(BufferedFile &&other)
+{
+    if (this != &other) {
+        close();
+        domain = other.domain;
+        file = other.file;
+        buffer = other.buffer;
+        capacity = other.capacity;
+        used = other.used;
+        fileOffset = other.fileOffset;
+        flushMs = other.flushMs;
+        bufferedSinceMs = other.bufferedSinceMs;
+        counters = other.counters;
+        other.file = File();
+        other.buffer = nullptr;
+        other.capacity = 0;
+        other.used = 0;
+    }
+    return *this;
+}
+
+// Hand buffered bytes to the filesystem: all of them, or up to the last page boundary
+bool LoFS::BufferedFile::drain(bool all)
+{
+    size_t n = used;
+    if (!all) {
+        n -= (fileOffset + used) % LOFS_WRITE_PAGE_SIZE;
+    }
+    if (n == 0) {
+        return true;
+    }
+
+    size_t written;
+    {
+        LockDomain::Guard g(*domain);
+        written = file.write(buffer, n);
+    }
+    uint64_t programmed = pagesTouched(fileOffset, written);
+    counters.writtenBytes += written;
+    counters.backendWrites++;
+    counters.programmedBytes += programmed;
+    writeCounters.writtenBytes += written;
+    writeCounters.backendWrites++;
+    writeCounters.programmedBytes += programmed;
+
+    fileOffset += written;
+    used -= written;
+    memmove(buffer, buffer + written, used);
+    return written == n;
+}
+
+size_t LoFS::BufferedFile::write(const uint8_t *buf, size_t size)
+{
+    if (!file || size == 0) {
+        return 0;
+    }
+
+    // What the same call would have cost without the buffer
+    uint64_t unbuffered = pagesTouched(position(), size);
+    counters.requestedBytes += size;
+    counters.requestedWrites++;
+    counters.unbufferedProgrammedBytes += unbuffered;
+    writeCounters.requestedBytes += size;
+    writeCounters.requestedWrites++;
+    writeCounters.unbufferedProgrammedBytes += unbuffered;
+
+    if (capacity == 0) {
+        // No buffer could be allocated: behave like a plain File
+        size_t written;
+        {
+            LockDomain::Guard g(*domain);
+            written = file.write(buf, size);
+        }
+        uint64_t programmed = pagesTouched(fileOffset, written);
+        counters.writtenBytes += written;
+        counters.backendWrites++;
+        counters.programmedBytes += programmed;
+        writeCounters.writtenBytes += written;
+        writeCounters.backendWrites++;
+        writeCounters.programmedBytes += programmed;
+        fileOffset += written;
+        return written;
+    }
+
+    flushIfDue();
+
+    size_t done = 0;
+    while (done < size) {
+        if (used == capacity && (!drain(false) || used == capacity)) {
+            break; // Filesystem full or failing
+        }
+        size_t n = size - done;
+        if (n > capacity - used) {
+            n = capacity - used;
+        }
+        if (used == 0) {
+            bufferedSinceMs = millis();
+        }
+        memcpy(buffer + used, buf + done, n);
+        used += n;
+        done += n;
+    }
+    return done;
+}
+
+bool LoFS::BufferedFile::sync()
+{
+    if (!file) {
+        return false;
+    }
+    bool ok = drain(true);
+    LockDomain::Guard g(*domain);
+    file.flush();
+    return ok;
+}
+
+bool LoFS::BufferedFile::flushIfDue()
+{
+    if (!file || used == 0 || flushMs == 0 || millis() - bufferedSinceMs < flushMs) {
+        return true;
+    }
+    return sync();
+}
+
+void LoFS::BufferedFile::close()
+{
+    if (file) {
+        drain(true);
+        LockDomain::Guard g(*domain);
+        file.flush();
+        file.close();
+    }
+    free(buffer);
+    buffer = nullptr;
+    capacity = 0;
+    used = 0;
+}
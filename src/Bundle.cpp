@@ -0,0 +1,515 @@
+#include <lofs/Bundle.h>
+#include <lofs/Lock.h>
+#include <lofs/LockDomain.h>
+#include "LittleEndian.h"
+#include "configuration.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOFS_BUNDLE_HEADER 16 // "LoFB", version, 3 reserved, entry count, name table size
+#define LOFS_BUNDLE_ENTRY 16  // Name offset, data offset, size, CRC32
+#define LOFS_BUNDLE_VERSION 1
+
+// Assets open as Files through the ESP32-style fs::FileImpl, which exists on ESP32 and Portduino only
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#include <FSImpl.h>
+#define LOFS_BUNDLE_FILES 1
+#else
+#define LOFS_BUNDLE_FILES 0
+#endif
+
+#define LOFS_BUNDLE_VERIFY_CHUNK 256
+
+// Asset names are stored without the leading '/' of LoFS paths
+static const char *relative(const char *path)
+{
+    while (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+#if LOFS_BUNDLE_FILES
+/**
+ * @brief An asset or a directory of a mounted bundle, returned through File
+ *
+ * Directories are the name prefixes up to a '/': their children are a
+ * contiguous run of the sorted index, which the handle walks with a cursor.
+ */
+class LoFS::Bundle::Handle : public fs::FileImpl
+{
+  public:
+    Handle(Bundle *bundle, int index, const char *path)
+        : bundle(bundle), index(index), prefix(nullptr), pos(0), prefixLen(0), cursor(0), isOpen(true)
+    {
+        fullPath = (char *)malloc(strlen(path) + 1);
+        if (fullPath) {
+            strcpy(fullPath, path);
+        }
+        if (index < 0) {
+            // Directory: children are the entries starting with "<path>/" (all of them for the root)
+            const char *rel = relative(path);
+            size_t len = strlen(rel);
+            while (len > 0 && rel[len - 1] == '/') {
+                len--;
+            }
+            prefix = (char *)malloc(len + 2);
+            if (prefix) {
+                memcpy(prefix, rel, len);
+                prefix[len] = '/';
+                prefix[len + 1] = '\0';
+                prefixLen = len ? len + 1 : 0;
+            }
+            rewindDirectory();
+        }
+        LoFS::Lock::Guard g(bundle->readLock);
+        bundle->openHandles++;
+    }
+
+    ~Handle() override
+    {
+        close();
+        free(fullPath);
+        free(prefix);
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override { return 0; }
+
+    size_t read(uint8_t *buf, size_t size) override
+    {
+        if (!isOpen || index < 0) {
+            return 0;
+        }
+        size_t n = bundle->readAt(index, pos, buf, size);
+        pos += n;
+        return n;
+    }
+
+    void flush() override {}
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override
+    {
+        if (!isOpen || index < 0) {
+            return false;
+        }
+        uint32_t base = (mode == fs::SeekCur) ? pos : (mode == fs::SeekEnd) ? bundle->size(index) : 0;
+        if ((uint64_t)base + offset > bundle->size(index)) {
+            return false;
+        }
+        pos = base + offset;
+        return true;
+    }
+
+    size_t position() const override { return pos; }
+    size_t size() const override { return (!isOpen || index < 0) ? 0 : bundle->size(index); }
+
+    void close() override
+    {
+        if (isOpen) {
+            isOpen = false;
+            LoFS::Lock::Guard g(bundle->readLock);
+            bundle->openHandles--;
+        }
+    }
+
+    time_t getLastWrite() override { return 0; }
+    const char *path() const override { return fullPath ? fullPath : ""; }
+
+    const char *name() const override
+    {
+        const char *p = path();
+        const char *slash = strrchr(p, '/');
+        return slash ? slash + 1 : p;
+    }
+
+    boolean isDirectory(void) override { return isOpen && index < 0; }
+
+    fs::FileImplPtr openNextFile(const char *mode) override
+    {
+        bool isDir;
+        char childPath[LOFS_PATH_MAX];
+        int child = nextChild(childPath, sizeof(childPath), &isDir);
+        if (child < 0) {
+            return fs::FileImplPtr();
+        }
+        return std::make_shared<Handle>(bundle, isDir ? -1 : child, childPath);
+    }
+
+    void rewindDirectory(void) override
+    {
+        cursor = (prefix && prefixLen > 0) ? bundle->lowerBound(prefix, prefixLen) : 0;
+    }
+
+    operator bool() override { return isOpen; }
+
+#ifdef ARCH_ESP32
+    // Directory name iteration of newer arduino-esp32 cores
+    String getNextFileName(void)
+    {
+        bool isDir;
+        return getNextFileName(&isDir);
+    }
+
+    String getNextFileName(bool *isDir)
+    {
+        char childPath[LOFS_PATH_MAX];
+        return (nextChild(childPath, sizeof(childPath), isDir) < 0) ? String() : String(childPath);
+    }
+#endif
+
+  private:
+    /**
+     * @brief Next file or subdirectory of this directory
+     * @return Index of the entry it came from, -1 at the end
+     */
+    int nextChild(char *childPath, size_t size, bool *isDir)
+    {
+        if (!isOpen || index >= 0 || !prefix) {
+            return -1;
+        }
+        while ((size_t)cursor < bundle->count()) {
+            int current = cursor++;
+            const char *entryName = bundle->name(current);
+            if (strncmp(entryName, prefix, prefixLen) != 0) {
+                cursor = (int)bundle->count(); // Past the run of this directory's entries
+                break;
+            }
+            const char *rest = entryName + prefixLen;
+            const char *slash = strchr(rest, '/');
+            size_t len = slash ? (size_t)(slash - rest) : strlen(rest);
+            *isDir = (slash != nullptr);
+            if (*isDir) {
+                // Skip the rest of the subdirectory's run
+                while ((size_t)cursor < bundle->count() &&
+                       strncmp(bundle->name(cursor), entryName, prefixLen + len + 1) == 0) {
+                    cursor++;
+                }
+            }
+            size_t pathLen = strlen(path());
+            bool needsSlash = (pathLen > 0 && path()[pathLen - 1] != '/');
+            if (pathLen + needsSlash + len + 1 > size) {
+                continue;
+            }
+            memcpy(childPath, path(), pathLen);
+            if (needsSlash) {
+                childPath[pathLen++] = '/';
+            }
+            memcpy(childPath + pathLen, rest, len);
+            childPath[pathLen + len] = '\0';
+            return current;
+        }
+        return -1;
+    }
+
+    Bundle *bundle;
+    int index; ///< Asset, or -1 for a directory
+    char *fullPath;
+    char *prefix;     ///< Directory name as stored in names, with a trailing '/'
+    uint32_t pos;
+    size_t prefixLen; ///< Length of "<dir>/" as stored in names (0: root)
+    int cursor;       ///< Next index entry to list
+    bool isOpen;
+};
+#endif
+
+LoFS::Bundle::Bundle()
+    : image(nullptr), table(nullptr), entries(nullptr), names(nullptr), entryCount(0), namesSize(0), imageSize(0),
+      fileBackend(nullptr), readLock(new LoFS::Lock()), openHandles(0)
+{
+}
+
+LoFS::Bundle::~Bundle()
+{
+    end();
+    delete readLock;
+}
+
+// Check the header and index; entries and names must already be in place
+bool LoFS::Bundle::load(const uint8_t *header, uint32_t totalSize)
+{
+    if (memcmp(header, "LoFB", 4) != 0 || header[4] != LOFS_BUNDLE_VERSION) {
+        return false;
+    }
+    imageSize = totalSize;
+    for (uint32_t i = 0; i < entryCount; i++) {
+        const uint8_t *e = entries + (size_t)i * LOFS_BUNDLE_ENTRY;
+        uint32_t nameOffset = lofsGetLE32(e);
+        if (nameOffset >= namesSize || (uint64_t)lofsGetLE32(e + 4) + lofsGetLE32(e + 8) > totalSize) {
+            return false;
+        }
+        // Binary search relies on byte-wise order
+        if (i > 0 && strcmp(names + lofsGetLE32(e - LOFS_BUNDLE_ENTRY), names + nameOffset) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoFS::Bundle::begin(const char *filepath)
+{
+    if (!end()) {
+        return false;
+    }
+    char path[LOFS_PATH_MAX];
+    fileBackend = resolve(filepath, path, sizeof(path));
+    if (!fileBackend) {
+        return false;
+    }
+    file = LoFS::open(filepath, "r");
+    if (!file) {
+        end();
+        return false;
+    }
+
+    uint8_t header[LOFS_BUNDLE_HEADER];
+    bool ok;
+    uint32_t fileSize;
+    {
+        LockDomain::SharedGuard g(fileBackend->lockDomain());
+        fileSize = file.size();
+        ok = file.read(header, sizeof(header)) == sizeof(header);
+    }
+    if (ok) {
+        entryCount = lofsGetLE32(header + 8);
+        namesSize = lofsGetLE32(header + 12);
+        uint64_t tableSize = (uint64_t)entryCount * LOFS_BUNDLE_ENTRY + namesSize;
+        ok = (namesSize > 0 && LOFS_BUNDLE_HEADER + tableSize <= fileSize);
+        table = ok ? (uint8_t *)malloc((size_t)tableSize) : nullptr;
+        if (table) {
+            LockDomain::SharedGuard g(fileBackend->lockDomain());
+            ok = file.read(table, (size_t)tableSize) == tableSize;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok) {
+        entries = table;
+        names = (const char *)table + (size_t)entryCount * LOFS_BUNDLE_ENTRY;
+        ok = names[namesSize - 1] == '\0' && load(header, fileSize);
+    }
+    if (!ok) {
+        end();
+    }
+    return ok;
+}
+
+bool LoFS::Bundle::begin(const uint8_t *image, size_t len)
+{
+    if (!end()) {
+        return false;
+    }
+    if (!image || len < LOFS_BUNDLE_HEADER) {
+        return false;
+    }
+    entryCount = lofsGetLE32(image + 8);
+    namesSize = lofsGetLE32(image + 12);
+    uint64_t tableEnd = LOFS_BUNDLE_HEADER + (uint64_t)entryCount * LOFS_BUNDLE_ENTRY + namesSize;
+    if (namesSize == 0 || tableEnd > len) {
+        end();
+        return false;
+    }
+    entries = image + LOFS_BUNDLE_HEADER;
+    names = (const char *)entries + (size_t)entryCount * LOFS_BUNDLE_ENTRY;
+    if (names[namesSize - 1] != '\0' || !load(image, (uint32_t)len)) {
+        end();
+        return false;
+    }
+    this->image = image;
+    return true;
+}
+
+bool LoFS::Bundle::end()
+{
+    {
+        // Open Handles still read entries and names
+        LoFS::Lock::Guard g(readLock);
+        if (openHandles > 0) {
+            return false;
+        }
+    }
+    if (file) {
+        LockDomain::SharedGuard g(fileBackend->lockDomain());
+        file.close();
+    }
+    file = File();
+    free(table);
+    table = nullptr;
+    image = nullptr;
+    entries = nullptr;
+    names = nullptr;
+    entryCount = 0;
+    namesSize = 0;
+    imageSize = 0;
+    fileBackend = nullptr;
+    return true;
+}
+
+const uint8_t *LoFS::Bundle::entry(int index) const
+{
+    return (index >= 0 && (uint32_t)index < entryCount) ? entries + (size_t)index * LOFS_BUNDLE_ENTRY : nullptr;
+}
+
+// First entry whose name is not less than the first len bytes of prefix
+int LoFS::Bundle::lowerBound(const char *prefix, size_t len) const
+{
+    int lo = 0;
+    int hi = (int)entryCount;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(name(mid), prefix, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int LoFS::Bundle::find(const char *name) const
+{
+    if (!name || !entries) {
+        return -1;
+    }
+    name = relative(name);
+    int lo = 0;
+    int hi = (int)entryCount - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(this->name(mid), name);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// A directory is any name prefix ending at a '/'; the root always exists
+bool LoFS::Bundle::isDir(const char *path) const
+{
+    path = relative(path);
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0) {
+        return entries != nullptr;
+    }
+    char prefix[LOFS_PATH_MAX];
+    if (len + 2 > sizeof(prefix)) {
+        return false;
+    }
+    memcpy(prefix, path, len);
+    prefix[len++] = '/';
+    int i = lowerBound(prefix, len);
+    return i < (int)entryCount && strncmp(name(i), prefix, len) == 0;
+}
+
+const char *LoFS::Bundle::name(int index) const
+{
+    const uint8_t *e = entry(index);
+    return e ? names + lofsGetLE32(e) : nullptr;
+}
+
+uint32_t LoFS::Bundle::size(int index) const
+{
+    const uint8_t *e = entry(index);
+    return e ? lofsGetLE32(e + 8) : 0;
+}
+
+uint32_t LoFS::Bundle::crc(int index) const
+{
+    const uint8_t *e = entry(index);
+    return e ? lofsGetLE32(e + 12) : 0;
+}
+
+const uint8_t *LoFS::Bundle::view(int index) const
+{
+    const uint8_t *e = entry(index);
+    return (e && image) ? image + lofsGetLE32(e + 4) : nullptr;
+}
+
+// Read under the caller's lock of the bundle file's backend
+size_t LoFS::Bundle::readAt(int index, uint32_t offset, void *buf, size_t len)
+{
+    const uint8_t *e = entry(index);
+    if (!e || offset >= lofsGetLE32(e + 8)) {
+        return 0;
+    }
+    if (len > lofsGetLE32(e + 8) - offset) {
+        len = lofsGetLE32(e + 8) - offset;
+    }
+    if (image) {
+        memcpy(buf, image + lofsGetLE32(e + 4) + offset, len);
+        return len;
+    }
+    // Readers of other assets may share the domain lock; the file position is not shared
+    LoFS::Lock::Guard g(readLock);
+    if (!file.seek(lofsGetLE32(e + 4) + offset)) {
+        return 0;
+    }
+    return file.read((uint8_t *)buf, len);
+}
+
+size_t LoFS::Bundle::read(int index, uint32_t offset, void *buf, size_t len)
+{
+    if (image || !fileBackend) {
+        return readAt(index, offset, buf, len);
+    }
+    LockDomain::SharedGuard g(fileBackend->lockDomain());
+    return readAt(index, offset, buf, len);
+}
+
+bool LoFS::Bundle::verify(int index)
+{
+    if (!entry(index)) {
+        return false;
+    }
+    if (image) {
+        return crc32(view(index), size(index)) == crc(index);
+    }
+    uint8_t chunk[LOFS_BUNDLE_VERIFY_CHUNK];
+    uint32_t sum = 0;
+    for (uint32_t offset = 0; offset < size(index);) {
+        size_t n = read(index, offset, chunk, sizeof(chunk));
+        if (n == 0) {
+            return false;
+        }
+        sum = crc32(chunk, n, sum);
+        offset += n;
+    }
+    return sum == crc(index);
+}
+
+LoFS::LockDomain &LoFS::Bundle::lockDomain()
+{
+    if (fileBackend) {
+        return fileBackend->lockDomain();
+    }
+    // Memory images are never written, so readers never wait on each other
+    static LockDomain memoryDomain(LockDomain::Kind::OWN, true);
+    return memoryDomain;
+}
+
+File LoFS::Bundle::open(const char *path, const char *mode)
+{
+#if LOFS_BUNDLE_FILES
+    if (!entries || !mode || strcmp(mode, "r") != 0) {
+        return File(); // Read-only
+    }
+    int index = find(path);
+    if (index >= 0 || isDir(path)) {
+        return File(std::make_shared<Handle>(this, index, path));
+    }
+#endif
+    return File();
+}
+
+bool LoFS::Bundle::exists(const char *path)
+{
+    return find(path) >= 0 || isDir(path);
+}
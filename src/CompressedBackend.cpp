@@ -0,0 +1,432 @@
+#include <lofs/CompressedBackend.h>
+#include "Lz.h"
+#include "LittleEndian.h"
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+#if LOFS_COMPRESS
+#include <FSImpl.h>
+
+// Frame layout: header, LZ stream ending in its end marker, trailer
+#define LOFS_Z_HEADER 4  // 'L', 'Z', version, log2(window)
+#define LOFS_Z_TRAILER 8 // Plain length, frame length (both little-endian uint32)
+#define LOFS_Z_VERSION 1
+
+// Suffix of the copy made while dropping a torn frame
+#define LOFS_Z_REPAIR_SUFFIX ".lofs-z"
+
+static uint8_t windowBits()
+{
+    uint8_t bits = 0;
+    while ((1u << bits) < LOFS_LZ_WINDOW) {
+        bits++;
+    }
+    return bits;
+}
+
+static bool validHeader(const uint8_t *h)
+{
+    return h[0] == 'L' && h[1] == 'Z' && h[2] == LOFS_Z_VERSION && h[3] <= windowBits();
+}
+
+/**
+ * @brief Stored bytes of one file, read up to a limit
+ */
+struct FrameSource {
+    File *file;
+    uint32_t end;
+};
+
+static size_t readFrames(uint8_t *data, size_t len, void *context)
+{
+    FrameSource *src = (FrameSource *)context;
+    size_t pos = src->file->position();
+    if (pos >= src->end) {
+        return 0;
+    }
+    if (len > src->end - pos) {
+        len = src->end - pos;
+    }
+    return src->file->read(data, len);
+}
+
+/**
+ * @brief Walk the frames of a stored file
+ * @param raw Receives the plain length of all complete frames
+ * @return Stored length covered by complete frames
+ *
+ * Trailers are followed back from the end of the file, one read per frame.
+ * If that fails (a frame was cut short), frames are decoded from the start
+ * instead and the walk stops at the first incomplete one.
+ */
+static uint32_t scanFrames(File &f, uint64_t *raw)
+{
+    uint32_t size = f.size();
+    uint32_t pos = size;
+    uint64_t total = 0;
+    uint8_t buf[LOFS_Z_TRAILER];
+    while (pos > 0) {
+        if (pos < LOFS_Z_HEADER + LOFS_Z_TRAILER || !f.seek(pos - LOFS_Z_TRAILER) ||
+            f.read(buf, LOFS_Z_TRAILER) != LOFS_Z_TRAILER) {
+            break;
+        }
+        uint32_t rawLen = lofsGetLE32(buf);
+        uint32_t frameLen = lofsGetLE32(buf + 4);
+        if (frameLen < LOFS_Z_HEADER + LOFS_Z_TRAILER || frameLen > pos || !f.seek(pos - frameLen) ||
+            f.read(buf, LOFS_Z_HEADER) != LOFS_Z_HEADER || !validHeader(buf)) {
+            break;
+        }
+        total += rawLen;
+        pos -= frameLen;
+    }
+    if (pos == 0) {
+        *raw = total;
+        return size;
+    }
+
+    // Slow path: decode forward, counting plain bytes
+    LzDecoder dec;
+    FrameSource src = {&f, size};
+    uint8_t scratch[64];
+    pos = 0;
+    total = 0;
+    while (pos + LOFS_Z_HEADER + LOFS_Z_TRAILER <= size) {
+        if (!f.seek(pos) || f.read(buf, LOFS_Z_HEADER) != LOFS_Z_HEADER || !validHeader(buf) ||
+            !dec.begin(readFrames, &src)) {
+            break;
+        }
+        uint64_t frameRaw = 0;
+        size_t n;
+        while ((n = dec.read(scratch, sizeof(scratch))) > 0) {
+            frameRaw += n;
+        }
+        uint32_t frameLen = LOFS_Z_HEADER + dec.consumed() + LOFS_Z_TRAILER;
+        if (!dec.finished() || pos + frameLen > size) {
+            break;
+        }
+        total += frameRaw;
+        pos += frameLen;
+    }
+    *raw = total;
+    return pos;
+}
+
+/**
+ * @brief Plain-data view of one stored file
+ *
+ * Runs under the caller's lock like any other File I/O (the target's lock
+ * domain), so it uses the inner File directly.
+ */
+class LoFS::CompressedBackend::Handle : public fs::FileImpl
+{
+  public:
+    Handle(CompressedBackend *owner, File inner, bool writing, uint64_t rawSize, uint32_t dataEnd)
+        : owner(owner), inner(inner), writing(writing), rawSize(rawSize), pos(writing ? rawSize : 0),
+          dataEnd(dataEnd), frameStart(0), frameRaw(0), frameStored(0), frameOpen(false)
+    {
+        source.file = &this->inner;
+        source.end = dataEnd;
+    }
+
+    ~Handle() override { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!writing || !inner || size == 0) {
+            return 0;
+        }
+        if (!frameOpen) {
+            uint8_t header[LOFS_Z_HEADER] = {'L', 'Z', LOFS_Z_VERSION, windowBits()};
+            if (!enc.begin(sink, this) || inner.write(header, sizeof(header)) != sizeof(header)) {
+                return 0;
+            }
+            frameOpen = true;
+            frameRaw = 0;
+            frameStored = sizeof(header);
+        }
+        if (!enc.write(buf, size)) {
+            return 0;
+        }
+        frameRaw += size;
+        rawSize += size;
+        pos = rawSize;
+        return size;
+    }
+
+    size_t read(uint8_t *buf, size_t size) override
+    {
+        if (writing || !inner) {
+            return 0;
+        }
+        if (size > rawSize - pos) {
+            size = rawSize - pos;
+        }
+        size_t n = 0;
+        while (n < size) {
+            if (!frameOpen && !startFrame()) {
+                break;
+            }
+            size_t got = dec.read(buf + n, size - n);
+            n += got;
+            pos += got;
+            if (dec.finished()) {
+                frameStart += LOFS_Z_HEADER + dec.consumed() + LOFS_Z_TRAILER;
+                frameOpen = false;
+            } else if (got == 0) {
+                break; // Damaged frame
+            }
+        }
+        return n;
+    }
+
+    /// Ends the current frame so everything written so far is readable
+    void flush() override
+    {
+        if (writing && frameOpen) {
+            endFrame();
+        }
+        inner.flush();
+    }
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override
+    {
+        uint64_t base = (mode == fs::SeekCur) ? pos : (mode == fs::SeekEnd) ? rawSize : 0;
+        uint64_t target = base + offset;
+        if (writing || target > rawSize) {
+            return writing && target == pos;
+        }
+        if (target < pos) {
+            // No index into the stream: decode from the start again
+            pos = 0;
+            frameStart = 0;
+            frameOpen = false;
+        }
+        uint8_t scratch[64];
+        while (pos < target) {
+            size_t n = target - pos;
+            if (read(scratch, n < sizeof(scratch) ? n : sizeof(scratch)) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t position() const override { return pos; }
+    size_t size() const override { return rawSize; }
+
+    void close() override
+    {
+        if (!inner) {
+            return;
+        }
+        if (writing && frameOpen) {
+            endFrame();
+        }
+        inner.close();
+        enc.release();
+        dec.release();
+    }
+
+    time_t getLastWrite() override { return inner.getLastWrite(); }
+    const char *path() const override { return inner.path(); }
+    const char *name() const override { return inner.name(); }
+    boolean isDirectory(void) override { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) override { return fs::FileImplPtr(); }
+    void rewindDirectory(void) override {}
+    operator bool() override { return (bool)inner; }
+
+  private:
+    static bool sink(const uint8_t *data, size_t len, void *context)
+    {
+        Handle *h = (Handle *)context;
+        h->frameStored += len;
+        return h->inner.write(data, len) == len;
+    }
+
+    bool startFrame()
+    {
+        uint8_t header[LOFS_Z_HEADER];
+        if (frameStart + LOFS_Z_HEADER + LOFS_Z_TRAILER > dataEnd || !inner.seek(frameStart) ||
+            inner.read(header, sizeof(header)) != sizeof(header) || !validHeader(header) ||
+            !dec.begin(readFrames, &source)) {
+            return false;
+        }
+        frameOpen = true;
+        return true;
+    }
+
+    void endFrame()
+    {
+        frameOpen = false;
+        if (!enc.finish()) {
+            return;
+        }
+        uint8_t trailer[LOFS_Z_TRAILER];
+        lofsPutLE32(trailer, frameRaw);
+        lofsPutLE32(trailer + 4, frameStored + LOFS_Z_TRAILER);
+        if (inner.write(trailer, sizeof(trailer)) == sizeof(trailer)) {
+            owner->counters.rawBytes += frameRaw;
+            owner->counters.storedBytes += frameStored + LOFS_Z_TRAILER;
+        }
+    }
+
+    CompressedBackend *owner;
+    File inner;
+    LzEncoder enc;
+    LzDecoder dec;
+    FrameSource source;
+    bool writing;
+    uint64_t rawSize;
+    uint64_t pos;         ///< Plain position
+    uint32_t dataEnd;     ///< Stored bytes in complete frames
+    uint32_t frameStart;  ///< Stored offset of the frame being read
+    uint32_t frameRaw;    ///< Plain bytes in the frame being written
+    uint32_t frameStored; ///< Stored bytes of the frame being written, header included
+    bool frameOpen;
+};
+
+// Rewrite a stored file without its torn last frame, so appended frames stay reachable
+static bool dropTornFrame(LoFS::Backend *inner, const char *path, uint32_t dataEnd)
+{
+    char tmpPath[LOFS_PATH_MAX];
+    if (strlen(path) + sizeof(LOFS_Z_REPAIR_SUFFIX) > sizeof(tmpPath)) {
+        return false;
+    }
+    snprintf(tmpPath, sizeof(tmpPath), "%s" LOFS_Z_REPAIR_SUFFIX, path);
+    inner->remove(tmpPath);
+    if (!inner->rename(path, tmpPath)) {
+        return false;
+    }
+    File src = inner->open(tmpPath, "r");
+    File dst = inner->open(path, "w");
+    bool result = src && dst;
+    uint8_t chunk[256];
+    uint32_t left = dataEnd;
+    while (result && left > 0) {
+        size_t n = src.read(chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+        result = (n > 0 && dst.write(chunk, n) == n);
+        left -= n;
+    }
+    src.close();
+    dst.close();
+    if (result) {
+        inner->remove(tmpPath);
+    }
+    return result;
+}
+
+LoFS::CompressedBackend::CompressedBackend(const char *target) : rootReady(false), counters()
+{
+    setTarget(this->target, target);
+}
+
+// Translate a path of this mount to the target backend's stripped path
+LoFS::Backend *LoFS::CompressedBackend::map(const char *path, char *buf, size_t size)
+{
+    return mapTarget(target, path, buf, size);
+}
+
+bool LoFS::CompressedBackend::isAvailable()
+{
+    return targetAvailable(target);
+}
+
+LoFS::LockDomain &LoFS::CompressedBackend::lockDomain()
+{
+    return targetLockDomain(target);
+}
+
+File LoFS::CompressedBackend::open(const char *path, const char *mode)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    if (!inner || !mode || strchr(mode, '+')) {
+        return File(); // Streams are either read or written
+    }
+
+    if (mode[0] == 'r') {
+        File f = inner->open(buf, "r");
+        if (!f || f.isDirectory()) {
+            return f;
+        }
+        uint64_t raw = 0;
+        uint32_t dataEnd = scanFrames(f, &raw);
+        return File(std::make_shared<Handle>(this, f, false, raw, dataEnd));
+    }
+
+    if (!rootReady) {
+        // The target directory is created on first use
+        char root[LOFS_PATH_MAX];
+        Backend *rootBackend = resolveRoute(target, root, sizeof(root), false);
+        rootReady = rootBackend && (rootBackend->exists(root) || rootBackend->mkdir(root));
+    }
+
+    uint64_t raw = 0;
+    if (mode[0] == 'a' && inner->exists(buf)) {
+        File f = inner->open(buf, "r");
+        uint32_t size = f ? f.size() : 0;
+        uint32_t dataEnd = f ? scanFrames(f, &raw) : 0;
+        f.close();
+        if (dataEnd < size && !dropTornFrame(inner, buf, dataEnd)) {
+            return File();
+        }
+    }
+    File f = inner->open(buf, mode[0] == 'a' ? "a" : "w");
+    if (!f) {
+        return f;
+    }
+    return File(std::make_shared<Handle>(this, f, true, raw, 0));
+}
+
+bool LoFS::CompressedBackend::exists(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    return inner && inner->exists(buf);
+}
+
+bool LoFS::CompressedBackend::mkdir(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    return inner && inner->mkdir(buf);
+}
+
+bool LoFS::CompressedBackend::remove(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    return inner && inner->remove(buf);
+}
+
+bool LoFS::CompressedBackend::rename(const char *oldpath, const char *newpath)
+{
+    char oldBuf[LOFS_PATH_MAX];
+    char newBuf[LOFS_PATH_MAX];
+    Backend *inner = map(oldpath, oldBuf, sizeof(oldBuf));
+    Backend *newInner = map(newpath, newBuf, sizeof(newBuf));
+    return inner && inner == newInner && inner->rename(oldBuf, newBuf);
+}
+
+bool LoFS::CompressedBackend::rmdir(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    return inner && inner->rmdir(buf);
+}
+
+uint64_t LoFS::CompressedBackend::totalBytes()
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map("/", buf, sizeof(buf));
+    return inner ? inner->totalBytes() : 0;
+}
+
+uint64_t LoFS::CompressedBackend::usedBytes()
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map("/", buf, sizeof(buf));
+    return inner ? inner->usedBytes() : 0;
+}
+#endif
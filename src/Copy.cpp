@@ -0,0 +1,318 @@
+#include <lofs/Backend.h>
+#include "StatTimer.h"
+#include "configuration.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Copy buffers are whole SD sectors so every SPI transfer is sector-aligned
+#define LOFS_COPY_SECTOR 512
+
+#ifndef LOFS_COPY_BUFFER_MAX
+#define LOFS_COPY_BUFFER_MAX 8192
+#endif
+
+static size_t copyBufferSize(size_t requested)
+{
+    size_t size = (requested + LOFS_COPY_SECTOR - 1) & ~(size_t)(LOFS_COPY_SECTOR - 1);
+    if (size < LOFS_COPY_SECTOR) {
+        size = LOFS_COPY_SECTOR;
+    }
+    if (size > LOFS_COPY_BUFFER_MAX) {
+        size = LOFS_COPY_BUFFER_MAX;
+    }
+    return size;
+}
+
+bool LoFS::copyFile(Backend *srcBackend, const char *srcPath, Backend *dstBackend, const char *dstPath,
+                    const CopyOptions &options, CopyStats *stats)
+{
+    uint32_t startMs = millis();
+    uint64_t resumeOffset = 0;
+    uint64_t total = 0;
+    uint64_t replacedSize = 0;
+    bool tracked = spaceTracked(dstBackend);
+    File srcFile;
+    File dstFile;
+
+    invalidateCache(dstBackend, dstPath);
+
+    {
+        // Both backends at once, in a fixed order (see LockDomain::PairGuard)
+        LockDomain::PairGuard g(srcBackend->lockDomain(), dstBackend->lockDomain());
+
+        srcFile = srcBackend->open(srcPath, "r");
+        if (!srcFile) {
+            return false;
+        }
+        total = srcFile.size();
+
+        if (options.resume && dstBackend->exists(dstPath)) {
+            File partial = dstBackend->open(dstPath, "r");
+            if (partial) {
+                resumeOffset = partial.size();
+                partial.close();
+            }
+            // A destination longer than the source is not a prefix of it; start over
+            if (resumeOffset > total) {
+                resumeOffset = 0;
+            }
+        }
+
+        if (resumeOffset > 0) {
+            // Verification reads the prefix through the checksum instead of seeking past it
+            if (!options.verify && !srcFile.seek((uint32_t)resumeOffset)) {
+                srcFile.close();
+                return false;
+            }
+            dstFile = dstBackend->open(dstPath, "a");
+        } else {
+            // Remove destination first: on STM32WL/NRF52 write mode appends instead of truncating
+            if (dstBackend->exists(dstPath)) {
+                replacedSize = tracked ? fileLength(dstBackend, dstPath) : 0;
+                dstBackend->remove(dstPath);
+            }
+            dstFile = dstBackend->open(dstPath, "w");
+        }
+
+        if (!dstFile) {
+            srcFile.close();
+            return false;
+        }
+    }
+
+    size_t bufferSize = copyBufferSize(options.bufferSize);
+    uint8_t *buffer = (uint8_t *)malloc(bufferSize);
+    while (!buffer && bufferSize > LOFS_COPY_SECTOR) {
+        // Low on heap: fall back to smaller chunks rather than failing
+        bufferSize /= 2;
+        buffer = (uint8_t *)malloc(bufferSize);
+    }
+
+    bool result = (buffer != nullptr);
+    uint64_t copied = resumeOffset;
+    uint32_t chunks = 0;
+    uint32_t srcCrc = 0;
+
+    if (options.verify) {
+        for (uint64_t prefix = 0; result && prefix < resumeOffset;) {
+            size_t want = (resumeOffset - prefix < bufferSize) ? (size_t)(resumeOffset - prefix) : bufferSize;
+            size_t bytesRead;
+            {
+                LockDomain::SharedGuard g(srcBackend->lockDomain());
+                bytesRead = srcFile.read(buffer, want);
+            }
+            if (bytesRead == 0) {
+                result = false;
+                break;
+            }
+            srcCrc = crc32(buffer, bytesRead, srcCrc);
+            prefix += bytesRead;
+        }
+    }
+
+    while (result) {
+        // Each chunk takes the locks separately so other users of either backend can run in between
+        size_t bytesRead;
+        {
+            LockDomain::SharedGuard g(srcBackend->lockDomain());
+            bytesRead = srcFile.read(buffer, bufferSize);
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+
+        size_t bytesWritten;
+        {
+            LockDomain::Guard g(dstBackend->lockDomain());
+            bytesWritten = dstFile.write(buffer, bytesRead);
+        }
+        if (bytesWritten != bytesRead) {
+            result = false;
+            break;
+        }
+        if (options.verify) {
+            srcCrc = crc32(buffer, bytesRead, srcCrc);
+        }
+
+        copied += bytesRead;
+        chunks++;
+        if (options.progress && !options.progress(copied, total, options.context)) {
+            result = false; // Cancelled
+            break;
+        }
+    }
+
+    bool kept;
+    {
+        LockDomain::PairGuard g(srcBackend->lockDomain(), dstBackend->lockDomain());
+        dstFile.flush();
+        dstFile.close();
+        srcFile.close();
+
+        if (result && copied != total) {
+            result = false; // Source changed size underneath us or short read
+        }
+        kept = result || options.resume;
+        if (!kept) {
+            // Copy failed, try to clean up destination (kept when resuming later)
+            dstBackend->remove(dstPath);
+        }
+    }
+
+    uint32_t verifyMs = 0;
+    if (result && options.verify) {
+        uint32_t verifyStartMs = millis();
+        uint32_t dstCrc = 0;
+        uint64_t readBack = 0;
+        File check;
+        {
+            LockDomain::SharedGuard g(dstBackend->lockDomain());
+            check = dstBackend->open(dstPath, "r");
+        }
+        while (check) {
+            size_t bytesRead;
+            {
+                LockDomain::SharedGuard g(dstBackend->lockDomain());
+                bytesRead = check.read(buffer, bufferSize);
+            }
+            if (bytesRead == 0) {
+                break;
+            }
+            dstCrc = crc32(buffer, bytesRead, dstCrc);
+            readBack += bytesRead;
+        }
+        lofsRecordBytes(dstBackend, readBack, 0);
+
+        LockDomain::Guard g(dstBackend->lockDomain());
+        if (check) {
+            check.close();
+        }
+        if (readBack != total || dstCrc != srcCrc) {
+            // What landed is not what was sent; a corrupt prefix is no use for resuming either
+            result = false;
+            kept = false;
+            dstBackend->remove(dstPath);
+        }
+        verifyMs = millis() - verifyStartMs;
+    }
+
+    free(buffer);
+
+    // A failed copy's partial destination is removed above unless resuming
+    spaceAdjust(dstBackend, kept ? (int64_t)(copied - resumeOffset) - (int64_t)replacedSize : -(int64_t)replacedSize);
+
+    lofsRecordBytes(srcBackend, copied - resumeOffset, 0);
+    lofsRecordBytes(dstBackend, 0, copied - resumeOffset);
+
+    if (stats) {
+        stats->bytesCopied = copied - resumeOffset;
+        stats->elapsedMs = millis() - startMs;
+        stats->chunks = chunks;
+        stats->verifyMs = verifyMs;
+        stats->crc = options.verify ? srcCrc : 0;
+    }
+    return result;
+}
+
+bool LoFS::copy(const char *srcpath, const char *dstpath, const CopyOptions &options, CopyStats *stats)
+{
+    char *srcStripped = nullptr;
+    char *dstStripped = nullptr;
+    Backend *srcBackend = parsePath(srcpath, &srcStripped);
+    Backend *dstBackend = parsePath(dstpath, &dstStripped);
+
+    if (!srcStripped || !dstStripped || !srcBackend || !dstBackend ||
+        (srcBackend == dstBackend && strcmp(srcStripped, dstStripped) == 0)) {
+        if (srcStripped) {
+            free(srcStripped);
+        }
+        if (dstStripped) {
+            free(dstStripped);
+        }
+        return false;
+    }
+
+    StatTimer t(srcBackend, Stats::Op::COPY);
+    bool result = copyFile(srcBackend, srcStripped, dstBackend, dstStripped, options, stats);
+    if (result) {
+        dentrySet(dstBackend, dstStripped, true);
+    } else {
+        dentryForget(dstBackend, dstStripped, false);
+    }
+
+    free(srcStripped);
+    free(dstStripped);
+    return t.result(result);
+}
+
+bool LoFS::move(const char *srcpath, const char *dstpath, const CopyOptions &options, CopyStats *stats)
+{
+    char *srcStripped = nullptr;
+    char *dstStripped = nullptr;
+    Backend *srcBackend = parsePath(srcpath, &srcStripped);
+    Backend *dstBackend = parsePath(dstpath, &dstStripped);
+
+    if (!srcStripped || !dstStripped || !srcBackend || !dstBackend) {
+        if (srcStripped) {
+            free(srcStripped);
+        }
+        if (dstStripped) {
+            free(dstStripped);
+        }
+        return false;
+    }
+
+    StatTimer t(srcBackend, Stats::Op::RENAME);
+    bool result = false;
+
+    // Either path may be a directory with cached files below it
+    invalidateCache(srcBackend, srcStripped, true);
+    invalidateCache(dstBackend, dstStripped, true);
+
+    // If both paths are on the same backend, use simple rename
+    if (srcBackend == dstBackend) {
+        // Renaming over an existing file frees that file's space
+        bool tracked = spaceTracked(dstBackend);
+        uint64_t replacedSize = 0;
+        {
+            LockDomain::Guard g(srcBackend->lockDomain());
+            if (tracked) {
+                replacedSize = fileLength(dstBackend, dstStripped);
+            }
+            result = srcBackend->rename(srcStripped, dstStripped);
+        }
+        if (result) {
+            spaceAdjust(dstBackend, -(int64_t)replacedSize);
+        }
+    } else {
+        // Cross-filesystem move: copy + delete source only if copy succeeded
+        result = copyFile(srcBackend, srcStripped, dstBackend, dstStripped, options, stats);
+        if (result) {
+            bool tracked = spaceTracked(srcBackend);
+            uint64_t srcSize = 0;
+            {
+                LockDomain::Guard g(srcBackend->lockDomain());
+                if (tracked) {
+                    srcSize = fileLength(srcBackend, srcStripped);
+                }
+                result = srcBackend->remove(srcStripped);
+            }
+            if (result) {
+                spaceAdjust(srcBackend, -(int64_t)srcSize);
+            }
+        }
+    }
+
+    // A renamed directory takes its children along
+    dentryForget(srcBackend, srcStripped, true);
+    if (result) {
+        dentrySet(dstBackend, dstStripped, true);
+        dentrySet(srcBackend, srcStripped, false);
+    } else {
+        dentryForget(dstBackend, dstStripped, true);
+    }
+
+    free(srcStripped);
+    free(dstStripped);
+    return t.result(result);
+}
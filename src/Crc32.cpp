@@ -0,0 +1,122 @@
+#include <lofs/Backend.h>
+#include "LittleEndian.h"
+#include "StatTimer.h"
+#include <string.h>
+
+// Table slices for crc32(): 8 processes eight bytes per step from 8 KB of
+// tables, 4 uses 4 KB, 1 is the classic bytewise loop over 1 KB
+#ifndef LOFS_CRC32_SLICES
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO) || defined(ARCH_RP2040)
+#define LOFS_CRC32_SLICES 8
+#else
+#define LOFS_CRC32_SLICES 1
+#endif
+#endif
+static_assert(LOFS_CRC32_SLICES == 1 || LOFS_CRC32_SLICES == 4 || LOFS_CRC32_SLICES == 8,
+              "LOFS_CRC32_SLICES must be 1, 4 or 8");
+
+#define LOFS_CRC32_CHUNK 512
+
+namespace
+{
+struct Crc32Tables {
+    uint32_t t[LOFS_CRC32_SLICES][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        // t[k][i]: CRC of byte i followed by k zero bytes
+        for (int k = 1; k < LOFS_CRC32_SLICES; k++) {
+            for (int i = 0; i < 256; i++) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables &tables()
+{
+    static const Crc32Tables instance;
+    return instance;
+}
+} // namespace
+
+uint32_t LoFS::crc32(const void *data, size_t len, uint32_t crc)
+{
+    const uint32_t(*t)[256] = tables().t;
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+#if LOFS_CRC32_SLICES == 8
+    while (len >= 8) {
+        uint32_t lo = lofsGetLE32(p) ^ crc;
+        uint32_t hi = lofsGetLE32(p + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^ t[3][hi & 0xFF] ^
+              t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+#elif LOFS_CRC32_SLICES == 4
+    while (len >= 4) {
+        uint32_t v = lofsGetLE32(p) ^ crc;
+        crc = t[3][v & 0xFF] ^ t[2][(v >> 8) & 0xFF] ^ t[1][(v >> 16) & 0xFF] ^ t[0][v >> 24];
+        p += 4;
+        len -= 4;
+    }
+#endif
+    while (len-- > 0) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool LoFS::checksum(const char *filepath, uint32_t *crc)
+{
+    char path[LOFS_PATH_MAX];
+    Backend *backend = resolve(filepath, path, sizeof(path));
+    if (!backend || !crc) {
+        return false;
+    }
+
+    File f;
+    {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        f = backend->open(path, "r");
+        if (f && f.isDirectory()) {
+            f.close();
+            return false;
+        }
+    }
+    if (!f) {
+        return false;
+    }
+
+    uint8_t chunk[LOFS_CRC32_CHUNK];
+    uint32_t result = 0;
+    uint64_t total = 0;
+    while (true) {
+        // One chunk per lock hold so other users of the backend can run in between
+        size_t n;
+        {
+            LockDomain::SharedGuard g(backend->lockDomain());
+            n = f.read(chunk, sizeof(chunk));
+        }
+        if (n == 0) {
+            break;
+        }
+        result = crc32(chunk, n, result);
+        total += n;
+    }
+    {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        f.close();
+    }
+    lofsRecordBytes(backend, total, 0);
+    *crc = result;
+    return true;
+}
@@ -0,0 +1,184 @@
+#include <lofs/Backend.h>
+#include <lofs/Lock.h>
+#include "PathHash.h"
+#include "configuration.h"
+#include <string.h>
+
+// Set LOFS_DENTRY_CACHE_ENTRIES to 0 to compile the cache out (exists() always asks the backend)
+#ifndef LOFS_DENTRY_CACHE_ENTRIES
+#define LOFS_DENTRY_CACHE_ENTRIES 32
+#endif
+
+static_assert((LOFS_DENTRY_CACHE_ENTRIES & (LOFS_DENTRY_CACHE_ENTRIES - 1)) == 0,
+              "LOFS_DENTRY_CACHE_ENTRIES must be a power of two");
+
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+enum DentryState : uint8_t { DENTRY_EMPTY, DENTRY_EXISTS, DENTRY_MISSING };
+
+struct Dentry {
+    uint32_t hash;
+    LoFS::Backend *backend;
+    uint16_t len;   ///< Path length, as a second check against hash collisions
+    uint16_t check; ///< CRC of the path folded to 16 bits, independent of hash
+    DentryState state;
+};
+
+// Direct-mapped: one slot per hash, a colliding path simply replaces the old entry.
+// Hits must match hash, length and check, so two paths with the same FNV hash are
+// only confused if their CRCs also collide.
+static Dentry dentries[LOFS_DENTRY_CACHE_ENTRIES];
+static LoFS::Lock *const dentryLock = new LoFS::Lock();
+
+// Bumped by every mutation. A lookup that missed only stores its result if
+// nothing changed while it was asking the backend, so a concurrent remove()
+// cannot be overwritten by the stale answer.
+static uint32_t dentryGeneration = 0;
+
+// Path length without trailing slashes, so "dir/" and "dir" share an entry
+static size_t keyLength(const char *strippedPath)
+{
+    size_t len = strlen(strippedPath);
+    while (len > 1 && strippedPath[len - 1] == '/') {
+        len--;
+    }
+    return len;
+}
+
+static uint32_t keyHash(LoFS::Backend *backend, const char *strippedPath, size_t len)
+{
+    uint32_t hash = lofsBackendHash(backend);
+    for (size_t i = 0; i < len; i++) {
+        hash = lofsHashStep(hash, strippedPath[i]);
+    }
+    return hash;
+}
+
+// Same fold as KV's key check; crc is the CRC32 of the path's first len bytes
+static uint16_t keyCheck(uint32_t crc)
+{
+    return (uint16_t)(crc ^ (crc >> 16));
+}
+
+static Dentry *findEntry(LoFS::Backend *backend, uint32_t hash, size_t len, uint16_t check)
+{
+    Dentry &entry = dentries[hash & (LOFS_DENTRY_CACHE_ENTRIES - 1)];
+    if (entry.state != DENTRY_EMPTY && entry.hash == hash && entry.len == len && entry.check == check &&
+        entry.backend == backend) {
+        return &entry;
+    }
+    return nullptr;
+}
+
+// Drop entries of one backend (all backends if nullptr) with paths longer than minLen
+static void dropEntries(LoFS::Backend *backend, size_t minLen)
+{
+    for (size_t i = 0; i < LOFS_DENTRY_CACHE_ENTRIES; i++) {
+        Dentry &entry = dentries[i];
+        if (entry.state != DENTRY_EMPTY && (!backend || entry.backend == backend) && entry.len > minLen) {
+            entry.state = DENTRY_EMPTY;
+        }
+    }
+}
+#endif
+
+bool LoFS::dentryLookup(Backend *backend, const char *strippedPath, bool *exists, uint32_t *generation)
+{
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+    size_t len = keyLength(strippedPath);
+    uint32_t hash = keyHash(backend, strippedPath, len);
+    uint16_t check = keyCheck(LoFS::crc32(strippedPath, len));
+    LoFS::Lock::Guard g(dentryLock);
+    *generation = dentryGeneration;
+    Dentry *entry = findEntry(backend, hash, len, check);
+    if (entry) {
+        *exists = (entry->state == DENTRY_EXISTS);
+        return true;
+    }
+#endif
+    return false;
+}
+
+void LoFS::dentryStore(Backend *backend, const char *strippedPath, bool exists, uint32_t generation)
+{
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+    size_t len = keyLength(strippedPath);
+    if (len > UINT16_MAX) {
+        return;
+    }
+    uint32_t hash = keyHash(backend, strippedPath, len);
+    uint16_t check = keyCheck(LoFS::crc32(strippedPath, len));
+    LoFS::Lock::Guard g(dentryLock);
+    if (generation != dentryGeneration) {
+        return; // Raced with a mutation; the answer may already be stale
+    }
+    Dentry &entry = dentries[hash & (LOFS_DENTRY_CACHE_ENTRIES - 1)];
+    entry.hash = hash;
+    entry.backend = backend;
+    entry.len = (uint16_t)len;
+    entry.check = check;
+    entry.state = exists ? DENTRY_EXISTS : DENTRY_MISSING;
+#endif
+}
+
+uint32_t LoFS::dentryForget(Backend *backend, const char *strippedPath, bool subtree)
+{
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+    // Forget the path and every ancestor: creating a file may create missing
+    // parent directories, and a cached "missing" for them would then be wrong.
+    // FNV and CRC32 are both computed left to right, so each ancestor's key
+    // is the running value at the '/' that ends it.
+    size_t len = keyLength(strippedPath);
+    LoFS::Lock::Guard g(dentryLock);
+    uint32_t hash = lofsBackendHash(backend);
+    uint32_t crc = 0;
+    size_t crcLen = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (strippedPath[i] == '/' && i > 0) {
+            crc = LoFS::crc32(strippedPath + crcLen, i - crcLen, crc);
+            crcLen = i;
+            Dentry *entry = findEntry(backend, hash, i, keyCheck(crc));
+            if (entry) {
+                entry->state = DENTRY_EMPTY;
+            }
+        }
+        hash = lofsHashStep(hash, strippedPath[i]);
+    }
+    crc = LoFS::crc32(strippedPath + crcLen, len - crcLen, crc);
+    Dentry *entry = findEntry(backend, hash, len, keyCheck(crc));
+    if (entry) {
+        entry->state = DENTRY_EMPTY;
+    }
+
+    // Entries below a removed or renamed directory cannot be found by hash;
+    // anything longer than the directory's path might be one of them
+    if (subtree) {
+        dropEntries(backend, len);
+    }
+    return ++dentryGeneration;
+#else
+    return 0;
+#endif
+}
+
+void LoFS::dentrySet(Backend *backend, const char *strippedPath, bool exists)
+{
+    dentryStore(backend, strippedPath, exists, dentryForget(backend, strippedPath, false));
+}
+
+void LoFS::flushExistsCache()
+{
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+    LoFS::Lock::Guard g(dentryLock);
+    dropEntries(nullptr, 0);
+    dentryGeneration++;
+#endif
+}
+
+void LoFS::flushExistsCache(Backend *backend)
+{
+#if LOFS_DENTRY_CACHE_ENTRIES > 0
+    LoFS::Lock::Guard g(dentryLock);
+    dropEntries(backend, 0);
+    dentryGeneration++;
+#endif
+}
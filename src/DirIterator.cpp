@@ -0,0 +1,198 @@
+#include <lofs/Backend.h>
+#include <lofs/DirIterator.h>
+#include <lofs/Path.h>
+#include "configuration.h"
+#include <string.h>
+
+LoFS::DirIterator::DirIterator(const char *dirpath) : backend(nullptr), entrySize(0), entryIsDir(false), open(false)
+{
+    entryName[0] = '\0';
+    char path[LOFS_PATH_MAX];
+    Backend *dirBackend = resolve(dirpath, path, sizeof(path));
+    if (dirBackend) {
+        attach(dirBackend, path);
+    }
+}
+
+LoFS::DirIterator::DirIterator(const Path &dirpath) : backend(nullptr), entrySize(0), entryIsDir(false), open(false)
+{
+    entryName[0] = '\0';
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *dirBackend = dirpath.route(buf, sizeof(buf), &strippedPath);
+    if (dirBackend) {
+        attach(dirBackend, strippedPath);
+    }
+}
+
+void LoFS::DirIterator::attach(Backend *dirBackend, const char *strippedPath)
+{
+    close();
+    backend = dirBackend;
+    LockDomain::SharedGuard g(backend->lockDomain());
+    dir = backend->open(strippedPath, "r");
+    if (!dir) {
+        return;
+    }
+    if (!dir.isDirectory()) {
+        dir.close();
+        return;
+    }
+    open = true;
+}
+
+bool LoFS::DirIterator::next()
+{
+    while (open) {
+        File entry;
+        {
+            LockDomain::SharedGuard g(backend->lockDomain());
+            entry = dir.openNextFile();
+        }
+        if (!entry) {
+            close();
+            return false;
+        }
+
+        // name() is a full path on some cores and a bare name on others
+        const char *name = entry.name();
+        const char *slash = strrchr(name, '/');
+        if (slash) {
+            name = slash + 1;
+        }
+        bool skip = (strcmp(name, ".") == 0 || strcmp(name, "..") == 0);
+        if (!skip) {
+            strncpy(entryName, name, sizeof(entryName) - 1);
+            entryName[sizeof(entryName) - 1] = '\0';
+            entryIsDir = entry.isDirectory();
+            entrySize = entryIsDir ? 0 : entry.size();
+        }
+
+        {
+            LockDomain::SharedGuard g(backend->lockDomain());
+            entry.close();
+        }
+        if (!skip) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LoFS::DirIterator::close()
+{
+    if (open) {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        dir.close();
+    }
+    open = false;
+}
+
+static bool listEntries(LoFS::DirIterator &it, LoFS::ListCallback callback, void *context)
+{
+    if (!it) {
+        return false;
+    }
+    while (it.next()) {
+        if (callback && !callback(it.name(), it.size(), it.isDirectory(), context)) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool LoFS::list(const char *dirpath, ListCallback callback, void *context)
+{
+    DirIterator it(dirpath);
+    return listEntries(it, callback, context);
+}
+
+bool LoFS::list(const Path &dirpath, ListCallback callback, void *context)
+{
+    DirIterator it(dirpath);
+    return listEntries(it, callback, context);
+}
+
+bool LoFS::removeTree(Backend *backend, char *path)
+{
+    // Depth-first without recursion: descend into the first subdirectory found,
+    // delete files on the way, and when a directory is empty remove it and
+    // continue with its parent. Only one directory is open at a time and the
+    // path buffer is the only per-level state, so deep trees cannot overflow
+    // the stack. Parents are re-opened on the way back up; their files are
+    // already gone by then, so only the remaining subdirectories are walked.
+    size_t rootLen = strlen(path);
+    while (rootLen > 1 && path[rootLen - 1] == '/') {
+        path[--rootLen] = '\0'; // "dir/" -> "dir" so walking back up finds the root
+    }
+    bool result = true;
+
+    while (true) {
+        size_t len = strlen(path);
+        bool descended = false;
+        DirIterator it;
+        it.attach(backend, path);
+        if (!it) {
+            return false;
+        }
+
+        while (it.next()) {
+            size_t nameLen = strlen(it.name());
+            bool needsSlash = (len > 0 && path[len - 1] != '/');
+            if (len + needsSlash + nameLen + 1 > LOFS_PATH_MAX) {
+                result = false; // Path too long to address; leave it
+                continue;
+            }
+            if (needsSlash) {
+                path[len] = '/';
+            }
+            memcpy(path + len + needsSlash, it.name(), nameLen + 1);
+
+            if (it.isDirectory()) {
+                descended = true;
+                break;
+            }
+
+            invalidateCache(backend, path);
+            {
+                LockDomain::Guard g(backend->lockDomain());
+                if (!backend->remove(path)) {
+                    result = false;
+                }
+            }
+            path[len] = '\0';
+        }
+        it.close();
+
+        if (descended) {
+            continue;
+        }
+
+        if (!result) {
+            // Something could not be deleted; stop instead of looping on it
+            return false;
+        }
+
+        // Directory is empty now
+        {
+            LockDomain::Guard g(backend->lockDomain());
+            if (!backend->rmdir(path)) {
+                return false;
+            }
+        }
+        if (len <= rootLen) {
+            return true;
+        }
+
+        // Back up to the parent
+        char *slash = strrchr(path, '/');
+        if (!slash) {
+            return true;
+        }
+        size_t parentLen = (slash == path) ? 1 : (size_t)(slash - path);
+        if (parentLen < rootLen) {
+            return true;
+        }
+        path[parentLen] = '\0';
+    }
+}
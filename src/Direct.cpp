@@ -0,0 +1,62 @@
+#include <lofs/Direct.h>
+#include <lofs/Backend.h>
+#include <string.h>
+
+template <LoFS::FSType T>
+LoFS::Backend *LoFS::Direct<T>::route(const char *path, char *buf, size_t size, const char **routed)
+{
+    if (!path || (T == FSType::SD && !isSDCardAvailable())) {
+        return nullptr;
+    }
+    Backend *backend = builtinBackend(T);
+    if (T == FSType::SD) {
+        // SD library style: no leading slash
+        *routed = (path[0] == '/') ? path + 1 : path;
+    } else if (path[0] == '/') {
+        *routed = path;
+    } else {
+        size_t len = strlen(path);
+        if (len + 2 > size) {
+            return nullptr;
+        }
+        buf[0] = '/';
+        memcpy(buf + 1, path, len + 1);
+        *routed = buf;
+    }
+    return backend;
+}
+
+template <LoFS::FSType T> File LoFS::Direct<T>::open(const char *mode) const
+{
+    char buf[LOFS_PATH_MAX];
+    const char *routed = nullptr;
+    Backend *backend = route(path, buf, sizeof(buf), &routed);
+    return (backend && mode) ? openResolved(backend, routed, mode) : File();
+}
+
+template <LoFS::FSType T> bool LoFS::Direct<T>::exists() const
+{
+    char buf[LOFS_PATH_MAX];
+    const char *routed = nullptr;
+    Backend *backend = route(path, buf, sizeof(buf), &routed);
+    return backend && existsResolved(backend, routed);
+}
+
+template <LoFS::FSType T> bool LoFS::Direct<T>::mkdir() const
+{
+    char buf[LOFS_PATH_MAX];
+    const char *routed = nullptr;
+    Backend *backend = route(path, buf, sizeof(buf), &routed);
+    return backend && mkdirResolved(backend, routed);
+}
+
+template <LoFS::FSType T> bool LoFS::Direct<T>::remove() const
+{
+    char buf[LOFS_PATH_MAX];
+    const char *routed = nullptr;
+    Backend *backend = route(path, buf, sizeof(buf), &routed);
+    return backend && removeResolved(backend, routed);
+}
+
+template class LoFS::Direct<LoFS::FSType::INTERNAL>;
+template class LoFS::Direct<LoFS::FSType::SD>;
@@ -0,0 +1,1039 @@
+#include <lofs/KV.h>
+#include <lofs/Lock.h>
+#include <lofs/LockDomain.h>
+#include "LittleEndian.h"
+#include "PathHash.h"
+#include "configuration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOFS_KV_VERSION 1
+#define LOFS_KV_SEGMENT_HEADER 8 // "LoKV", version, 3 reserved
+#define LOFS_KV_RECORD_HEADER 8  // CRC32 of the rest of the record, key length, flags, value length
+#define LOFS_KV_HINT_HEADER 16   // "LoKH", version, 3 reserved, segment length, entry count
+#define LOFS_KV_HINT_ENTRY 12    // Hash, offset | flags << 24, record length, check
+#define LOFS_KV_MAX_RECORD 0xFFFF
+#define LOFS_KV_MAX_OFFSET 0xFFFFFF // Offsets share a 32-bit index word with the segment slot
+#define LOFS_KV_TOMBSTONE 0x01
+
+#define LOFS_KV_CHUNK 256
+
+/**
+ * @brief Where a record is and which key it belongs to
+ */
+struct LoFS::KV::Record {
+    uint32_t hash;
+    uint16_t check;
+    uint8_t flags;
+    int seg;
+    uint32_t offset;
+    uint16_t length;
+};
+
+// Stores with background work, visited by compactKV() on the async worker
+static LoFS::KV *kvStores = nullptr;
+static LoFS::Lock *const kvListLock = new LoFS::Lock();
+
+// FNV-1a, never 0 (an empty index slot)
+static uint32_t keyHash(const void *key, size_t len)
+{
+    uint32_t hash = LOFS_FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash = lofsHashStep(hash, ((const char *)key)[i]);
+    }
+    return hash ? hash : 1;
+}
+
+// Independent of keyHash(), so two keys only collide if both match
+static uint16_t keyCheck(const void *key, size_t len)
+{
+    uint32_t crc = LoFS::crc32(key, len);
+    return (uint16_t)(crc ^ (crc >> 16));
+}
+
+static uint32_t makeLoc(int seg, uint32_t offset)
+{
+    return ((uint32_t)seg << 24) | offset;
+}
+
+// Create a directory and any missing parents
+static bool makeDirs(const char *dirpath)
+{
+    char path[LOFS_PATH_MAX];
+    strcpy(path, dirpath);
+    for (char *p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (!LoFS::exists(path)) {
+                LoFS::mkdir(path);
+            }
+            *p = '/';
+        }
+    }
+    return LoFS::exists(path) || LoFS::mkdir(path);
+}
+
+/**
+ * @brief Segment files found by begin()
+ */
+struct KVListing {
+    uint32_t ids[LOFS_KV_MAX_SEGMENTS];
+    bool hints[LOFS_KV_MAX_SEGMENTS];
+    size_t count;
+    bool overflow;
+};
+
+static bool parseId(const char *name, const char *ext, uint32_t *id)
+{
+    char *end = nullptr;
+    unsigned long v = strtoul(name, &end, 16);
+    if (end != name + 8 || strcmp(end, ext) != 0 || v == 0) {
+        return false;
+    }
+    *id = (uint32_t)v;
+    return true;
+}
+
+static bool listSegment(const char *name, uint32_t size, bool isDirectory, void *context)
+{
+    KVListing *listing = (KVListing *)context;
+    uint32_t id;
+    if (isDirectory || !parseId(name, ".kvs", &id)) {
+        return true;
+    }
+    if (listing->count == LOFS_KV_MAX_SEGMENTS) {
+        listing->overflow = true;
+        return false;
+    }
+    // Insertion sort: segments are replayed oldest first
+    size_t i = listing->count++;
+    while (i > 0 && listing->ids[i - 1] > id) {
+        listing->ids[i] = listing->ids[i - 1];
+        i--;
+    }
+    listing->ids[i] = id;
+    return true;
+}
+
+static bool listHint(const char *name, uint32_t size, bool isDirectory, void *context)
+{
+    KVListing *listing = (KVListing *)context;
+    uint32_t id;
+    if (!isDirectory && parseId(name, ".kvh", &id)) {
+        for (size_t i = 0; i < listing->count; i++) {
+            if (listing->ids[i] == id) {
+                listing->hints[i] = true;
+            }
+        }
+    }
+    return true;
+}
+
+LoFS::KV::KV(const char *dirpath, const Options &options)
+    : options(options), domain(nullptr), lock(new LoFS::Lock()), compactLock(new LoFS::Lock()), slots(nullptr),
+      mask(0), keys(0), active(-1), unsynced(false), readerSeg(-1), readerStale(false), pending(false), compactions(0),
+      hinted(0), scanned(0), beginMs(0), next(nullptr)
+{
+    dir[0] = '\0';
+    if (dirpath && strlen(dirpath) < sizeof(dir)) {
+        strcpy(dir, dirpath);
+        size_t len = strlen(dir);
+        while (len > 1 && dir[len - 1] == '/') {
+            dir[--len] = '\0';
+        }
+    }
+    if (this->options.segmentBytes > LOFS_KV_MAX_OFFSET) {
+        this->options.segmentBytes = LOFS_KV_MAX_OFFSET;
+    }
+    memset(segments, 0, sizeof(segments));
+}
+
+LoFS::KV::~KV()
+{
+    end();
+    delete lock;
+    delete compactLock;
+}
+
+bool LoFS::KV::segmentPath(char *buf, size_t size, uint32_t id, bool hint) const
+{
+    return snprintf(buf, size, "%s/%08lx.%s", dir, (unsigned long)id, hint ? "kvh" : "kvs") < (int)size;
+}
+
+bool LoFS::KV::begin()
+{
+    if (!dir[0]) {
+        return false;
+    }
+    uint32_t start = millis();
+    {
+        LoFS::Lock::Guard g(lock);
+        if (slots) {
+            return true;
+        }
+    }
+    if (!makeDirs(dir)) {
+        return false;
+    }
+
+    KVListing listing;
+    memset(&listing, 0, sizeof(listing));
+    if (!LoFS::list(dir, listSegment, &listing) || listing.overflow) {
+        return false; // More segments than this build allows (LOFS_KV_MAX_SEGMENTS)
+    }
+    LoFS::list(dir, listHint, &listing);
+
+    // Power-of-two table at most 3/4 full, so probe runs stay short
+    uint32_t count = 4;
+    while (count < options.maxKeys + options.maxKeys / 3 + 1) {
+        count <<= 1;
+    }
+
+    LoFS::Lock::Guard g(lock);
+    domain = &lockDomain(dir);
+    slots = (Slot *)calloc(count, sizeof(Slot));
+    if (!slots) {
+        return false;
+    }
+    mask = count - 1;
+    keys = 0;
+    hinted = scanned = 0;
+    compactions = 0;
+    memset(segments, 0, sizeof(segments));
+
+    // Replay oldest first: a later record for a key replaces an earlier one
+    bool resume = false;
+    for (size_t i = 0; i < listing.count; i++) {
+        segments[i].id = listing.ids[i];
+        bool last = (i + 1 == listing.count);
+        if (!last && listing.hints[i] && loadHint(i)) {
+            segments[i].hinted = true;
+            hinted++;
+            continue;
+        }
+        // No hint (or the active segment): read it record by record
+        char path[LOFS_PATH_MAX];
+        segmentPath(path, sizeof(path), segments[i].id, false);
+        File file = LoFS::open(path, "r");
+        bool clean = false;
+        segments[i].bytes = file ? scanSegment(i, file, &clean, nullptr, nullptr) : 0;
+        {
+            LockDomain::Guard d(*domain);
+            file.close();
+        }
+        scanned++;
+        // Carry on appending unless a torn record ends it
+        resume = last && clean;
+    }
+    if (resume) {
+        active = (int)listing.count - 1;
+        char path[LOFS_PATH_MAX];
+        if (listing.hints[active]) {
+            // Stale: the segment is about to grow past what the hint covers
+            segmentPath(path, sizeof(path), segments[active].id, true);
+            LoFS::remove(path);
+        }
+        segmentPath(path, sizeof(path), segments[active].id, false);
+        writer = LoFS::open(path, "a");
+        if (!writer) {
+            active = -1;
+        }
+    }
+    if (active < 0 && !openSegment()) {
+        free(slots);
+        slots = nullptr;
+        return false;
+    }
+    beginMs = millis() - start;
+
+    {
+        LoFS::Lock::Guard l(kvListLock);
+        next = kvStores;
+        kvStores = this;
+    }
+    for (size_t i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        if (segments[i].id && (int)i != active && !segments[i].hinted) {
+            schedule();
+        }
+    }
+    if (pickVictim(false) >= 0) {
+        schedule();
+    }
+    return true;
+}
+
+void LoFS::KV::end()
+{
+    {
+        LoFS::Lock::Guard l(kvListLock);
+        for (KV **p = &kvStores; *p; p = &(*p)->next) {
+            if (*p == this) {
+                *p = next;
+                break;
+            }
+        }
+        next = nullptr;
+    }
+    LoFS::Lock::Guard c(compactLock);
+    LoFS::Lock::Guard g(lock);
+    if (!slots) {
+        return;
+    }
+    {
+        LockDomain::Guard d(*domain);
+        if (writer) {
+            writer.flush();
+            writer.close();
+        }
+        if (reader) {
+            reader.close();
+        }
+    }
+    writer = File();
+    reader = File();
+    readerSeg = -1;
+    unsynced = false;
+    free(slots);
+    slots = nullptr;
+    keys = 0;
+    active = -1;
+    pending = false;
+    memset(segments, 0, sizeof(segments));
+}
+
+int LoFS::KV::oldestSegment() const
+{
+    int oldest = -1;
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        if (segments[i].id && (oldest < 0 || segments[i].id < segments[oldest].id)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+int LoFS::KV::findSlot(uint32_t hash, uint16_t check) const
+{
+    for (uint32_t i = hash & mask; slots[i].hash; i = (i + 1) & mask) {
+        if (slots[i].hash == hash && slots[i].check == check) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool LoFS::KV::indexPut(const Record &record)
+{
+    int found = findSlot(record.hash, record.check);
+    uint32_t i;
+    if (found >= 0) {
+        i = (uint32_t)found;
+        segments[slots[i].loc >> 24].dead += slots[i].length;
+    } else {
+        if (keys >= options.maxKeys) {
+            return false;
+        }
+        for (i = record.hash & mask; slots[i].hash; i = (i + 1) & mask) {
+        }
+        keys++;
+    }
+    slots[i].hash = record.hash;
+    slots[i].check = record.check;
+    slots[i].loc = makeLoc(record.seg, record.offset);
+    slots[i].length = record.length;
+    return true;
+}
+
+void LoFS::KV::indexRemove(const Record &record)
+{
+    int found = findSlot(record.hash, record.check);
+    if (found < 0) {
+        return;
+    }
+    uint32_t i = (uint32_t)found;
+    segments[slots[i].loc >> 24].dead += slots[i].length;
+    keys--;
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole, no tombstones needed
+    for (uint32_t j = (i + 1) & mask; slots[j].hash; j = (j + 1) & mask) {
+        uint32_t home = slots[j].hash & mask;
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].hash = 0;
+}
+
+bool LoFS::KV::apply(const Record &record)
+{
+    if (record.flags & LOFS_KV_TOMBSTONE) {
+        segments[record.seg].tombs += record.length;
+        indexRemove(record);
+        return true;
+    }
+    if (!indexPut(record)) {
+        segments[record.seg].dead += record.length; // Over maxKeys: the record cannot be reached
+        return false;
+    }
+    return true;
+}
+
+bool LoFS::KV::readAt(int seg, uint32_t offset, void *buf, size_t len)
+{
+    if (seg == active && unsynced) {
+        LockDomain::Guard d(*domain);
+        writer.flush();
+        unsynced = false;
+        readerStale = true;
+    }
+    if (readerSeg != seg || (seg == active && readerStale)) {
+        {
+            LockDomain::Guard d(*domain);
+            if (reader) {
+                reader.close();
+            }
+        }
+        char path[LOFS_PATH_MAX];
+        segmentPath(path, sizeof(path), segments[seg].id, false);
+        reader = LoFS::open(path, "r");
+        readerSeg = reader ? seg : -1;
+        readerStale = false;
+        if (!reader) {
+            return false;
+        }
+    }
+    LockDomain::SharedGuard g(*domain);
+    return reader.seek(offset) && reader.read((uint8_t *)buf, len) == len;
+}
+
+uint32_t LoFS::KV::scanSegment(int seg, File &file, bool *clean, ScanVisitor visit, void *context)
+{
+    uint8_t header[LOFS_KV_RECORD_HEADER];
+    uint8_t key[255];
+    uint8_t chunk[LOFS_KV_CHUNK];
+    *clean = false;
+    {
+        LockDomain::SharedGuard g(*domain);
+        if (file.read(header, LOFS_KV_SEGMENT_HEADER) != LOFS_KV_SEGMENT_HEADER || memcmp(header, "LoKV", 4) != 0 ||
+            header[4] != LOFS_KV_VERSION) {
+            return 0;
+        }
+    }
+
+    uint32_t offset = LOFS_KV_SEGMENT_HEADER;
+    while (true) {
+        LockDomain::SharedGuard g(*domain);
+        size_t n = file.read(header, sizeof(header));
+        if (n == 0) {
+            *clean = true; // End of file on a record boundary
+            return offset;
+        }
+        uint8_t keyLen = header[4];
+        uint16_t valueLen = lofsGetLE16(header + 6);
+        uint32_t length = LOFS_KV_RECORD_HEADER + keyLen + valueLen;
+        if (n != sizeof(header) || keyLen == 0 || length > LOFS_KV_MAX_RECORD || offset + length > LOFS_KV_MAX_OFFSET ||
+            file.read(key, keyLen) != keyLen) {
+            return offset;
+        }
+        uint32_t crc = LoFS::crc32(header + 4, 4);
+        crc = LoFS::crc32(key, keyLen, crc);
+        for (uint32_t left = valueLen; left > 0;) {
+            size_t want = (left < sizeof(chunk)) ? left : sizeof(chunk);
+            if (file.read(chunk, want) != want) {
+                return offset;
+            }
+            crc = LoFS::crc32(chunk, want, crc);
+            left -= want;
+        }
+        if (crc != lofsGetLE32(header)) {
+            return offset; // Torn or damaged: nothing after it can be trusted
+        }
+
+        Record record;
+        record.hash = keyHash(key, keyLen);
+        record.check = keyCheck(key, keyLen);
+        record.flags = header[5];
+        record.seg = seg;
+        record.offset = offset;
+        record.length = (uint16_t)length;
+        if (visit) {
+            visit(this, record, context);
+        } else {
+            apply(record);
+        }
+        offset += length;
+    }
+}
+
+bool LoFS::KV::loadHint(int seg)
+{
+    char path[LOFS_PATH_MAX];
+    segmentPath(path, sizeof(path), segments[seg].id, true);
+    File file = LoFS::open(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t header[LOFS_KV_HINT_HEADER];
+    uint8_t *entries = nullptr;
+    uint32_t count = 0;
+    uint32_t bytes = 0;
+    bool ok;
+    {
+        // Read and check the whole hint before touching the index
+        LockDomain::SharedGuard g(*domain);
+        ok = file.read(header, sizeof(header)) == sizeof(header) && memcmp(header, "LoKH", 4) == 0 &&
+             header[4] == LOFS_KV_VERSION;
+        if (ok) {
+            bytes = lofsGetLE32(header + 8);
+            count = lofsGetLE32(header + 12);
+            ok = bytes <= LOFS_KV_MAX_OFFSET && count <= bytes / LOFS_KV_RECORD_HEADER;
+        }
+        if (ok && count > 0) {
+            entries = (uint8_t *)malloc(count * LOFS_KV_HINT_ENTRY);
+            ok = entries && file.read(entries, count * LOFS_KV_HINT_ENTRY) == count * LOFS_KV_HINT_ENTRY;
+        }
+        uint8_t stored[4];
+        if (ok) {
+            uint32_t crc = LoFS::crc32(header, sizeof(header));
+            if (count > 0) {
+                crc = LoFS::crc32(entries, count * LOFS_KV_HINT_ENTRY, crc);
+            }
+            ok = file.read(stored, sizeof(stored)) == sizeof(stored) && lofsGetLE32(stored) == crc;
+        }
+        file.close();
+    }
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        const uint8_t *e = entries + i * LOFS_KV_HINT_ENTRY;
+        uint32_t word = lofsGetLE32(e + 4);
+        Record record;
+        record.hash = lofsGetLE32(e);
+        record.offset = word & LOFS_KV_MAX_OFFSET;
+        record.flags = (uint8_t)(word >> 24);
+        record.length = lofsGetLE16(e + 8);
+        record.check = lofsGetLE16(e + 10);
+        record.seg = seg;
+        apply(record);
+    }
+    free(entries);
+    if (ok) {
+        segments[seg].bytes = bytes;
+    }
+    return ok;
+}
+
+/**
+ * @brief Hint entries gathered while scanning a sealed segment
+ */
+struct KVHint {
+    uint8_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+    bool failed;
+};
+
+bool LoFS::KV::writeHint(int seg)
+{
+    char path[LOFS_PATH_MAX];
+    uint32_t id;
+    {
+        LoFS::Lock::Guard g(lock);
+        id = segments[seg].id;
+    }
+    // Sealed segments never change, so the scan runs without the store's lock
+    segmentPath(path, sizeof(path), id, false);
+    File file = LoFS::open(path, "r");
+    if (!file) {
+        return false;
+    }
+    KVHint hint = {nullptr, 0, 0, false};
+    bool clean;
+    uint32_t bytes = scanSegment(
+        seg, file, &clean,
+        [](KV *, const Record &record, void *context) {
+            KVHint *hint = (KVHint *)context;
+            if (hint->count == hint->capacity) {
+                uint32_t capacity = hint->capacity ? hint->capacity * 2 : 64;
+                uint8_t *grown = (uint8_t *)realloc(hint->entries, capacity * LOFS_KV_HINT_ENTRY);
+                if (!grown) {
+                    hint->failed = true;
+                    return;
+                }
+                hint->entries = grown;
+                hint->capacity = capacity;
+            }
+            uint8_t *e = hint->entries + hint->count++ * LOFS_KV_HINT_ENTRY;
+            lofsPutLE32(e, record.hash);
+            lofsPutLE32(e + 4, record.offset | ((uint32_t)record.flags << 24));
+            lofsPutLE16(e + 8, record.length);
+            lofsPutLE16(e + 10, record.check);
+        },
+        &hint);
+    {
+        LockDomain::Guard d(*domain);
+        file.close();
+    }
+
+    bool ok = !hint.failed;
+    if (ok) {
+        uint8_t header[LOFS_KV_HINT_HEADER] = {'L', 'o', 'K', 'H', LOFS_KV_VERSION, 0, 0, 0};
+        lofsPutLE32(header + 8, bytes);
+        lofsPutLE32(header + 12, hint.count);
+        uint32_t crc = LoFS::crc32(header, sizeof(header));
+        if (hint.count > 0) {
+            crc = LoFS::crc32(hint.entries, hint.count * LOFS_KV_HINT_ENTRY, crc);
+        }
+        uint8_t trailer[4];
+        lofsPutLE32(trailer, crc);
+
+        // A hint cut short by a power loss fails its CRC and the segment is scanned instead
+        segmentPath(path, sizeof(path), id, true);
+        LoFS::remove(path);
+        File out = LoFS::open(path, "w");
+        ok = (bool)out;
+        if (ok) {
+            size_t entryBytes = hint.count * LOFS_KV_HINT_ENTRY;
+            LockDomain::Guard d(*domain);
+            ok = out.write(header, sizeof(header)) == sizeof(header) &&
+                 (entryBytes == 0 || out.write(hint.entries, entryBytes) == entryBytes) &&
+                 out.write(trailer, sizeof(trailer)) == sizeof(trailer);
+            out.flush();
+            out.close();
+        }
+        if (!ok) {
+            LoFS::remove(path);
+        }
+    }
+    free(hint.entries);
+    return ok;
+}
+
+// Start a new active segment in a free slot (caller holds lock)
+bool LoFS::KV::openSegment()
+{
+    int slot = -1;
+    uint32_t id = 0;
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        if (!segments[i].id) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (segments[i].id > id) {
+            id = segments[i].id;
+        }
+    }
+    if (slot < 0) {
+        return false;
+    }
+
+    char path[LOFS_PATH_MAX];
+    segmentPath(path, sizeof(path), id + 1, false);
+    File file = LoFS::open(path, "w");
+    if (!file) {
+        return false;
+    }
+    uint8_t header[LOFS_KV_SEGMENT_HEADER] = {'L', 'o', 'K', 'V', LOFS_KV_VERSION, 0, 0, 0};
+    bool ok;
+    {
+        LockDomain::Guard d(*domain);
+        ok = file.write(header, sizeof(header)) == sizeof(header);
+        if (!ok) {
+            file.close();
+        }
+    }
+    if (!ok) {
+        LoFS::remove(path);
+        return false;
+    }
+    memset(&segments[slot], 0, sizeof(segments[slot]));
+    segments[slot].id = id + 1;
+    segments[slot].bytes = LOFS_KV_SEGMENT_HEADER;
+    active = slot;
+    writer = file;
+    unsynced = true;
+    return true;
+}
+
+// Seal the active segment and start the next one (caller holds lock)
+bool LoFS::KV::roll(bool torn)
+{
+    {
+        LockDomain::Guard d(*domain);
+        writer.flush();
+        writer.close();
+    }
+    writer = File();
+    unsynced = false;
+    readerStale = true;
+    int sealed = active;
+    active = -1;
+    bool ok = openSegment();
+    if (!ok && !torn) {
+        // Out of segment slots: keep appending to the old one until compaction frees a slot.
+        // Not after a torn record, though: the next scan would stop there and drop what follows.
+        char path[LOFS_PATH_MAX];
+        segmentPath(path, sizeof(path), segments[sealed].id, false);
+        writer = LoFS::open(path, "a");
+        active = writer ? sealed : -1;
+    }
+    schedule();
+    return ok;
+}
+
+bool LoFS::KV::append(Record *record, const void *key, const void *value, size_t len, File *from)
+{
+    // No active segment after a torn write with every slot taken; retry once compaction freed one
+    if (active < 0 && !openSegment()) {
+        return false;
+    }
+    uint32_t length = record->length;
+    Segment &seg = segments[active];
+    if (seg.bytes > LOFS_KV_SEGMENT_HEADER && seg.bytes + length > options.segmentBytes && !roll() &&
+        (active < 0 || segments[active].bytes + length > LOFS_KV_MAX_OFFSET)) {
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t offset = segments[active].bytes;
+    {
+        LockDomain::Guard d(*domain);
+        if (from) {
+            // Compaction: copy the record as it is, CRC included
+            uint8_t chunk[LOFS_KV_CHUNK];
+            for (uint32_t left = length; ok && left > 0;) {
+                size_t want = (left < sizeof(chunk)) ? left : sizeof(chunk);
+                ok = from->read(chunk, want) == want && writer.write(chunk, want) == want;
+                left -= want;
+            }
+        } else {
+            uint8_t header[LOFS_KV_RECORD_HEADER];
+            header[4] = (uint8_t)(length - LOFS_KV_RECORD_HEADER - len);
+            header[5] = record->flags;
+            lofsPutLE16(header + 6, (uint16_t)len);
+            uint32_t crc = LoFS::crc32(header + 4, 4);
+            crc = LoFS::crc32(key, header[4], crc);
+            if (len > 0) {
+                crc = LoFS::crc32(value, len, crc);
+            }
+            lofsPutLE32(header, crc);
+            ok = writer.write(header, sizeof(header)) == sizeof(header) &&
+                 writer.write((const uint8_t *)key, header[4]) == header[4] &&
+                 (len == 0 || writer.write((const uint8_t *)value, len) == len);
+        }
+    }
+    unsynced = true;
+    if (!ok) {
+        // Whatever part of the record got out ends this segment for the next scan; carry on in a new one
+        roll(true);
+        return false;
+    }
+    segments[active].bytes += length;
+    record->seg = active;
+    record->offset = offset;
+    return true;
+}
+
+bool LoFS::KV::put(const void *key, size_t keyLen, const void *value, size_t len)
+{
+    if (!key || keyLen == 0 || keyLen > 255 || (len > 0 && !value) ||
+        LOFS_KV_RECORD_HEADER + keyLen + len > LOFS_KV_MAX_RECORD) {
+        return false;
+    }
+    Record record;
+    record.hash = keyHash(key, keyLen);
+    record.check = keyCheck(key, keyLen);
+    record.flags = 0;
+    record.length = (uint16_t)(LOFS_KV_RECORD_HEADER + keyLen + len);
+
+    LoFS::Lock::Guard g(lock);
+    if (!slots || (keys >= options.maxKeys && findSlot(record.hash, record.check) < 0)) {
+        return false;
+    }
+    if (!append(&record, key, value, len, nullptr)) {
+        return false;
+    }
+    indexPut(record);
+    if (pickVictim(false) >= 0) {
+        schedule();
+    }
+    return true;
+}
+
+int LoFS::KV::get(const void *key, size_t keyLen, void *buf, size_t size)
+{
+    if (!key || keyLen == 0 || keyLen > 255) {
+        return -1;
+    }
+    uint32_t hash = keyHash(key, keyLen);
+    uint16_t check = keyCheck(key, keyLen);
+
+    LoFS::Lock::Guard g(lock);
+    if (!slots) {
+        return -1;
+    }
+    int i = findSlot(hash, check);
+    if (i < 0) {
+        return -1;
+    }
+    int seg = (int)(slots[i].loc >> 24);
+    uint32_t offset = slots[i].loc & LOFS_KV_MAX_OFFSET;
+
+    // The index only holds hashes: make sure the record really is this key's
+    uint8_t head[LOFS_KV_RECORD_HEADER + 255];
+    if (!readAt(seg, offset, head, LOFS_KV_RECORD_HEADER + keyLen) || head[4] != keyLen ||
+        memcmp(head + LOFS_KV_RECORD_HEADER, key, keyLen) != 0) {
+        return -1;
+    }
+    uint16_t valueLen = lofsGetLE16(head + 6);
+    size_t n = (size < valueLen) ? size : valueLen;
+    if (n > 0 && (!buf || !readAt(seg, offset + LOFS_KV_RECORD_HEADER + keyLen, buf, n))) {
+        return -1;
+    }
+    return valueLen;
+}
+
+bool LoFS::KV::contains(const void *key, size_t keyLen)
+{
+    return get(key, keyLen, nullptr, 0) >= 0;
+}
+
+bool LoFS::KV::remove(const void *key, size_t keyLen)
+{
+    if (!key || keyLen == 0 || keyLen > 255) {
+        return false;
+    }
+    Record record;
+    record.hash = keyHash(key, keyLen);
+    record.check = keyCheck(key, keyLen);
+    record.flags = LOFS_KV_TOMBSTONE;
+    record.length = (uint16_t)(LOFS_KV_RECORD_HEADER + keyLen);
+
+    LoFS::Lock::Guard g(lock);
+    if (!slots || findSlot(record.hash, record.check) < 0) {
+        return false;
+    }
+    if (!append(&record, key, nullptr, 0, nullptr)) {
+        return false;
+    }
+    apply(record);
+    if (pickVictim(false) >= 0) {
+        schedule();
+    }
+    return true;
+}
+
+bool LoFS::KV::sync()
+{
+    LoFS::Lock::Guard g(lock);
+    if (!writer) {
+        return false;
+    }
+    if (unsynced) {
+        LockDomain::Guard d(*domain);
+        writer.flush();
+        unsynced = false;
+        readerStale = true;
+    }
+    return true;
+}
+
+// Sealed segment worth compacting, -1 if none (caller holds lock)
+int LoFS::KV::pickVictim(bool force) const
+{
+    int oldest = oldestSegment();
+    int used = 0;
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        used += segments[i].id ? 1 : 0;
+    }
+    // Nearly out of segment slots: take whatever frees the most
+    if (used >= LOFS_KV_MAX_SEGMENTS - 1) {
+        force = true;
+    }
+
+    int best = -1;
+    uint32_t bestPercent = 0;
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        const Segment &seg = segments[i];
+        if (!seg.id || i == active) {
+            continue;
+        }
+        // Tombstones must outlive every older record they may hide
+        uint32_t size = (seg.bytes > LOFS_KV_SEGMENT_HEADER) ? seg.bytes - LOFS_KV_SEGMENT_HEADER : 0;
+        uint32_t reclaim = seg.dead + ((i == oldest) ? seg.tombs : 0);
+        uint32_t percent = size ? (uint32_t)((uint64_t)reclaim * 100 / size) : 100;
+        if (percent == 0 || (!force && percent < options.compactPercent)) {
+            continue;
+        }
+        if (best < 0 || percent > bestPercent) {
+            best = i;
+            bestPercent = percent;
+        }
+    }
+    return best;
+}
+
+// Copy a sealed segment's live records to the active segment, then delete it
+bool LoFS::KV::compactSegment(int seg)
+{
+    char path[LOFS_PATH_MAX];
+    uint32_t end;
+    {
+        LoFS::Lock::Guard g(lock);
+        segmentPath(path, sizeof(path), segments[seg].id, false);
+        end = segments[seg].bytes;
+    }
+    File file = LoFS::open(path, "r");
+    bool ok = (bool)file || end <= LOFS_KV_SEGMENT_HEADER;
+
+    uint8_t head[LOFS_KV_RECORD_HEADER + 255];
+    for (uint32_t offset = LOFS_KV_SEGMENT_HEADER; ok && offset < end;) {
+        {
+            LockDomain::SharedGuard d(*domain);
+            ok = file.seek(offset) && file.read(head, LOFS_KV_RECORD_HEADER) == LOFS_KV_RECORD_HEADER &&
+                 file.read(head + LOFS_KV_RECORD_HEADER, head[4]) == head[4];
+        }
+        if (!ok) {
+            break;
+        }
+        uint8_t keyLen = head[4];
+        Record record;
+        record.hash = keyHash(head + LOFS_KV_RECORD_HEADER, keyLen);
+        record.check = keyCheck(head + LOFS_KV_RECORD_HEADER, keyLen);
+        record.flags = head[5];
+        record.length = (uint16_t)(LOFS_KV_RECORD_HEADER + keyLen + lofsGetLE16(head + 6));
+
+        // One record per lock hold, so get() and put() carry on during a compaction
+        LoFS::Lock::Guard g(lock);
+        int i = findSlot(record.hash, record.check);
+        bool keep;
+        if (record.flags & LOFS_KV_TOMBSTONE) {
+            keep = (i < 0) && oldestSegment() != seg;
+        } else {
+            keep = (i >= 0) && slots[i].loc == makeLoc(seg, offset);
+        }
+        if (keep) {
+            {
+                LockDomain::SharedGuard d(*domain);
+                ok = file.seek(offset);
+            }
+            ok = ok && append(&record, nullptr, nullptr, 0, &file);
+            if (ok && i >= 0) {
+                slots[i].loc = makeLoc(record.seg, record.offset);
+            } else if (ok) {
+                segments[record.seg].tombs += record.length;
+            }
+        }
+        offset += record.length;
+    }
+    if (file) {
+        LockDomain::Guard d(*domain);
+        file.close();
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // The copies must be on flash before the originals go
+    LoFS::Lock::Guard g(lock);
+    if (writer) {
+        LockDomain::Guard d(*domain);
+        writer.flush();
+        unsynced = false;
+        readerStale = true;
+    }
+    if (readerSeg == seg) {
+        LockDomain::Guard d(*domain);
+        reader.close();
+        reader = File();
+        readerSeg = -1;
+    }
+    char hintPath[LOFS_PATH_MAX];
+    segmentPath(hintPath, sizeof(hintPath), segments[seg].id, true);
+    LoFS::remove(hintPath);
+    LoFS::remove(path);
+    memset(&segments[seg], 0, sizeof(segments[seg]));
+    compactions++;
+    return true;
+}
+
+int LoFS::KV::compact(bool force)
+{
+    LoFS::Lock::Guard c(compactLock);
+
+    // Hints first: they make the next begin() cheap, compaction only saves space
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        {
+            LoFS::Lock::Guard g(lock);
+            if (!slots || !segments[i].id || i == active || segments[i].hinted) {
+                continue;
+            }
+        }
+        if (writeHint(i)) {
+            LoFS::Lock::Guard g(lock);
+            segments[i].hinted = true;
+        }
+    }
+
+    int done = 0;
+    while (true) {
+        int victim;
+        {
+            LoFS::Lock::Guard g(lock);
+            victim = slots ? pickVictim(force && done == 0) : -1;
+        }
+        if (victim < 0 || !compactSegment(victim)) {
+            break;
+        }
+        done++;
+    }
+    return done;
+}
+
+LoFS::KV::Stats LoFS::KV::stats()
+{
+    Stats result;
+    memset(&result, 0, sizeof(result));
+    LoFS::Lock::Guard g(lock);
+    result.keys = keys;
+    result.hintedSegments = hinted;
+    result.scannedSegments = scanned;
+    result.compactions = compactions;
+    result.beginMs = beginMs;
+    for (int i = 0; i < LOFS_KV_MAX_SEGMENTS; i++) {
+        if (segments[i].id) {
+            result.segments++;
+            result.bytes += segments[i].bytes;
+            result.deadBytes += segments[i].dead;
+        }
+    }
+    return result;
+}
+
+// Ask the async worker for hints and compaction (caller holds lock)
+void LoFS::KV::schedule()
+{
+    if (!pending) {
+        pending = true;
+        wakeAsync();
+    }
+}
+
+void LoFS::compactKV()
+{
+    LoFS::Lock::Guard l(kvListLock);
+    for (KV *store = kvStores; store; store = store->next) {
+        bool run;
+        {
+            LoFS::Lock::Guard g(store->lock);
+            run = store->pending;
+            store->pending = false;
+        }
+        if (run) {
+            store->compact();
+        }
+    }
+}
@@ -1,634 +1,603 @@
 #include <lofs/LoFS.h>
-#include "SPILock.h"
+#include <lofs/RamBackend.h>
+#include <lofs/CompressedBackend.h>
+#include "Backends.h"
+#include "StatTimer.h"
 #include "configuration.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <string>
-
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-#include <SD.h>
-#include <SPI.h>
-
-// Use the same SPI handler setup as FSCommon.cpp
-#ifdef SDCARD_USE_SPI1
-extern SPIClass SPI_HSPI;
-#define SDHandler SPI_HSPI
-#else
-#define SDHandler SPI
+
+#ifndef LOFS_MAX_MOUNTS
+#define LOFS_MAX_MOUNTS 8
+#endif
+
+// Longest mount segment ("internal" is 8)
+#ifndef LOFS_MOUNT_NAME_MAX
+#define LOFS_MOUNT_NAME_MAX 15
 #endif
 
-#ifndef SD_SPI_FREQUENCY
-#define SD_SPI_FREQUENCY 4000000U
+// Open-addressed hash table; kept at least twice LOFS_MAX_MOUNTS so probes stay short
+#define LOFS_MOUNT_SLOTS 16
+static_assert((LOFS_MOUNT_SLOTS & (LOFS_MOUNT_SLOTS - 1)) == 0, "LOFS_MOUNT_SLOTS must be a power of two");
+static_assert(LOFS_MOUNT_SLOTS >= 2 * LOFS_MAX_MOUNTS, "LOFS_MOUNT_SLOTS too small for LOFS_MAX_MOUNTS");
+
+struct MountEntry {
+    uint32_t hash;
+    uint8_t nameLen;
+    char name[LOFS_MOUNT_NAME_MAX + 1];
+    LoFS::Backend *backend; ///< nullptr = empty slot
+    bool tombstone;         ///< Slot was unmounted; keep probing past it
+};
+
+static MountEntry mountTable[LOFS_MOUNT_SLOTS];
+static size_t mountCount = 0;
+static bool mountsInitialized = false;
+static uint32_t mountChanges = 0; ///< See LoFS::mountGeneration()
+
+static InternalBackend internalBackend;
+static SDBackend sdBackend;
+#if LOFS_RAMDISK && LOFS_RAM_BYTES > 0
+static LoFS::RamBackend ramBackend(LOFS_RAM_BYTES);
 #endif
+#if LOFS_COMPRESS
+static LoFS::CompressedBackend zBackend(LOFS_Z_DIR);
 #endif
 
-bool LoFS::isSDCardAvailable()
-{
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    // Check current card type
-    uint8_t cardType = SD.cardType();
-    
-    // If card type is NONE, try to initialize the SD card
-    if (cardType == CARD_NONE) {
-        concurrency::LockGuard g(spiLock);
-        SDHandler.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
-        if (SD.begin(SDCARD_CS, SDHandler, SD_SPI_FREQUENCY)) {
-            cardType = SD.cardType();
-        }
+// Unprefixed paths go here for backward compatibility
+static LoFS::Backend *const defaultBackend = &internalBackend;
+
+// FNV-1a over a path segment
+static uint32_t hashSegment(const char *segment, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)segment[i];
+        hash *= 16777619u;
     }
-    
-    return (cardType != CARD_NONE);
-#else
-    return false; // SD card support not compiled in or disabled
-#endif
+    return hash;
 }
 
-// Helper to convert mode to SD library mode
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-// ESP32/RP2040: SD library uses string modes
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-static const char *convertToSDMode(const char *modeStr)
+static MountEntry *findMount(const char *segment, size_t len, uint32_t hash)
 {
-    // Already a string, return as-is
-    return modeStr;
+    for (size_t probe = 0; probe < LOFS_MOUNT_SLOTS; probe++) {
+        MountEntry &entry = mountTable[(hash + probe) & (LOFS_MOUNT_SLOTS - 1)];
+        if (!entry.backend && !entry.tombstone) {
+            return nullptr;
+        }
+        if (entry.backend && entry.hash == hash && entry.nameLen == len && memcmp(entry.name, segment, len) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
 }
 
-static const char *convertToSDMode(uint8_t mode)
+// Strip surrounding slashes from a mount prefix; returns segment length or 0 if invalid
+static size_t mountSegment(const char *prefix, const char **segment)
 {
-    // Convert uint8_t to string: 0 = read, non-zero = write
-    return (mode == 0) ? "r" : "w";
+    if (!prefix) {
+        return 0;
+    }
+    while (*prefix == '/') {
+        prefix++;
+    }
+    size_t len = 0;
+    while (prefix[len] && prefix[len] != '/') {
+        len++;
+    }
+    // Only a single segment is allowed ("/a/b/" is rejected)
+    for (const char *p = prefix + len; *p; p++) {
+        if (*p != '/') {
+            return 0;
+        }
+    }
+    if (len > LOFS_MOUNT_NAME_MAX) {
+        return 0;
+    }
+    *segment = prefix;
+    return len;
 }
-#else
-// STM32WL/NRF52: SD library uses uint8_t modes
-static uint8_t convertToSDMode(const char *modeStr)
+
+static bool addMount(const char *segment, size_t len, LoFS::Backend *backend)
 {
-    if (strcmp(modeStr, "r") == 0) {
-        return FILE_READ;
+    uint32_t hash = hashSegment(segment, len);
+    if (findMount(segment, len, hash) || mountCount >= LOFS_MAX_MOUNTS) {
+        return false;
+    }
+    for (size_t probe = 0; probe < LOFS_MOUNT_SLOTS; probe++) {
+        MountEntry &entry = mountTable[(hash + probe) & (LOFS_MOUNT_SLOTS - 1)];
+        if (!entry.backend) {
+            entry.hash = hash;
+            entry.nameLen = (uint8_t)len;
+            memcpy(entry.name, segment, len);
+            entry.name[len] = '\0';
+            entry.backend = backend;
+            entry.tombstone = false;
+            mountCount++;
+            return true;
+        }
     }
-    return FILE_WRITE;
+    return false;
 }
 
-static uint8_t convertToSDMode(uint8_t mode)
+static void initMounts()
 {
-    // STM32WL/NRF52: FILE_O_READ=0, FILE_O_WRITE=1
-    return (mode == 0) ? FILE_READ : FILE_WRITE;
-}
+    if (mountsInitialized) {
+        return;
+    }
+    mountsInitialized = true;
+    addMount("internal", 8, &internalBackend);
+    addMount("sd", 2, &sdBackend);
+#if LOFS_RAMDISK && LOFS_RAM_BYTES > 0
+    addMount("ram", 3, &ramBackend);
 #endif
+#if LOFS_COMPRESS
+    if (LOFS_Z_DIR[0]) {
+        addMount("z", 1, &zBackend);
+    }
 #endif
+}
+
+bool LoFS::mount(const char *prefix, Backend *backend)
+{
+    const char *segment = nullptr;
+    size_t len = mountSegment(prefix, &segment);
+    if (len == 0 || !backend) {
+        return false;
+    }
+    initMounts();
+    if (!addMount(segment, len, backend)) {
+        return false;
+    }
+    mountChanges++;
+    return true;
+}
 
-LoFS::FSType LoFS::parsePath(const char *filepath, char *strippedPath, size_t bufferSize)
+bool LoFS::unmount(const char *prefix)
+{
+    const char *segment = nullptr;
+    size_t len = mountSegment(prefix, &segment);
+    if (len == 0) {
+        return false;
+    }
+    initMounts();
+    MountEntry *entry = findMount(segment, len, hashSegment(segment, len));
+    if (!entry) {
+        return false;
+    }
+    flushExistsCache(entry->backend);
+    invalidateSpaceInfo(entry->backend);
+    entry->backend = nullptr;
+    entry->tombstone = true;
+    mountCount--;
+    mountChanges++;
+    return true;
+}
+
+LoFS::Backend *LoFS::resolve(const char *filepath, char *strippedPath, size_t bufferSize)
+{
+    return resolveRoute(filepath, strippedPath, bufferSize, true);
+}
+
+LoFS::Backend *LoFS::resolveRoute(const char *filepath, char *strippedPath, size_t bufferSize, bool checkAvailable)
 {
     if (!filepath || !strippedPath || bufferSize == 0) {
-        return FSType::INVALID;
+        return nullptr;
     }
 
-    // Check for /internal/ prefix
-    if (strncmp(filepath, "/internal/", 10) == 0) {
-        size_t len = strlen(filepath + 10);
-        if (len + 1 > bufferSize) {
-            return FSType::INVALID;
+    initMounts();
+
+    // Hash the first segment while scanning for its terminating '/'
+    Backend *backend = nullptr;
+    const char *rest = filepath;
+    if (filepath[0] == '/') {
+        const char *segment = filepath + 1;
+        uint32_t hash = 2166136261u;
+        size_t len = 0;
+        while (segment[len] && segment[len] != '/' && len <= LOFS_MOUNT_NAME_MAX) {
+            hash ^= (uint8_t)segment[len];
+            hash *= 16777619u;
+            len++;
         }
-        strcpy(strippedPath, filepath + 10);
-        // Ensure leading slash for internal filesystem
-        if (strippedPath[0] != '/') {
-            memmove(strippedPath + 1, strippedPath, len + 1);
-            strippedPath[0] = '/';
+        // A mount only matches when followed by '/' (e.g. "/sd/x", not "/sdcard")
+        if (segment[len] == '/') {
+            MountEntry *entry = findMount(segment, len, hash);
+            if (entry) {
+                backend = entry->backend;
+                rest = segment + len + 1;
+            }
+#if LOFS_AUTO_TIER
+            else if (len == 4 && memcmp(segment, "auto", 4) == 0) {
+                // Tiered namespace: the index picks /internal/ or /sd/
+                return resolveAuto(segment + len, strippedPath, bufferSize);
+            }
+#endif
         }
-        return FSType::INTERNAL;
     }
 
-    // Check for /sd/ prefix
-    if (strncmp(filepath, "/sd/", 4) == 0) {
-        // Check if SD card is actually available (compile-time or runtime)
-        if (!LoFS::isSDCardAvailable()) {
-            return FSType::INVALID; // SD card not available
-        }
-        size_t len = strlen(filepath + 4);
+    if (!backend) {
+        // Default to internal filesystem if no prefix (backward compatibility)
+        size_t len = strlen(filepath);
         if (len + 1 > bufferSize) {
-            return FSType::INVALID;
+            return nullptr;
         }
-        strcpy(strippedPath, filepath + 4);
-        // SD card paths typically don't need leading slash
-        if (strippedPath[0] == '/') {
-            memmove(strippedPath, strippedPath + 1, len);
+        strcpy(strippedPath, filepath);
+        return defaultBackend;
+    }
+
+    // Check if the backend is actually available (e.g. SD card present)
+    if (checkAvailable && !backend->isAvailable()) {
+        return nullptr;
+    }
+
+    size_t len = strlen(rest);
+    if (backend->leadingSlash()) {
+        // Ensure leading slash (FSCom style)
+        if (rest[0] == '/') {
+            if (len + 1 > bufferSize) {
+                return nullptr;
+            }
+            strcpy(strippedPath, rest);
+        } else {
+            if (len + 2 > bufferSize) {
+                return nullptr;
+            }
+            strippedPath[0] = '/';
+            strcpy(strippedPath + 1, rest);
         }
-        return FSType::SD;
+    } else {
+        // Backend wants no leading slash (SD library style)
+        if (rest[0] == '/') {
+            rest++;
+            len--;
+        }
+        if (len + 1 > bufferSize) {
+            return nullptr;
+        }
+        strcpy(strippedPath, rest);
     }
+    return backend;
+}
 
-    // Default to internal filesystem if no prefix (backward compatibility)
-    size_t len = strlen(filepath);
-    if (len + 1 > bufferSize) {
-        return FSType::INVALID;
+LoFS::Backend *LoFS::builtinBackend(FSType type)
+{
+    if (type == FSType::SD) {
+        return &sdBackend;
     }
-    strcpy(strippedPath, filepath);
-    return FSType::INTERNAL;
+    return (type == FSType::INTERNAL) ? &internalBackend : nullptr;
 }
 
-LoFS::FSType LoFS::parsePath(const char *filepath, char **strippedPath)
+uint32_t LoFS::mountGeneration()
+{
+    return mountChanges;
+}
+
+LoFS::FSType LoFS::fsTypeOf(const char *filepath)
+{
+    char path[LOFS_PATH_MAX];
+    Backend *backend = resolve(filepath, path, sizeof(path));
+    if (backend == &internalBackend) {
+        return FSType::INTERNAL;
+    }
+    if (backend == &sdBackend) {
+        return FSType::SD;
+    }
+    return FSType::INVALID;
+}
+
+LoFS::Backend *LoFS::parsePath(const char *filepath, char **strippedPath)
 {
     if (!filepath) {
         *strippedPath = nullptr;
-        return FSType::INVALID;
+        return nullptr;
     }
 
     size_t maxLen = strlen(filepath) + 10; // Extra space for path manipulation
     *strippedPath = (char *)malloc(maxLen);
     if (!*strippedPath) {
-        return FSType::INVALID;
+        return nullptr;
     }
 
-    return parsePath(filepath, *strippedPath, maxLen);
+    Backend *backend = resolve(filepath, *strippedPath, maxLen);
+    touchAuto(filepath);
+    return backend;
 }
 
-File LoFS::open(const char *filepath, uint8_t mode)
+void LoFS::setTarget(char *target, const char *path)
 {
-    char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
+    strncpy(target, path ? path : "", LOFS_PATH_MAX - 1);
+    target[LOFS_PATH_MAX - 1] = '\0';
+    size_t len = strlen(target);
+    while (len > 0 && target[len - 1] == '/') {
+        target[--len] = '\0';
+    }
+}
 
-    if (!strippedPath || fsType == FSType::INVALID) {
-        if (strippedPath) {
-            free(strippedPath);
-        }
-        return File();
+LoFS::Backend *LoFS::mapTarget(const char *target, const char *path, char *strippedPath, size_t bufferSize)
+{
+    char full[LOFS_PATH_MAX];
+    int len = snprintf(full, sizeof(full), "%s%s%s", target, (path[0] == '/') ? "" : "/", path);
+    if (len < 0 || (size_t)len >= sizeof(full)) {
+        return nullptr;
     }
+    // Calls arrive holding the target's lock, where probing an SD card would take it again
+    return resolveRoute(full, strippedPath, bufferSize, false);
+}
 
-    File result;
+bool LoFS::targetAvailable(const char *target)
+{
+    // Runs ahead of the lock, so probing an SD target is safe here
+    char full[LOFS_PATH_MAX];
+    char buf[LOFS_PATH_MAX];
+    int len = snprintf(full, sizeof(full), "%s/", target);
+    return len > 0 && (size_t)len < sizeof(full) && resolve(full, buf, sizeof(buf));
+}
 
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-        // ESP32/RP2040: SD library uses string modes
-        const char *sdMode = convertToSDMode(mode);
-        result = SD.open(strippedPath, sdMode);
-#else
-        // STM32WL/NRF52: SD library uses uint8_t modes
-        uint8_t sdMode = convertToSDMode(mode);
-        result = SD.open(strippedPath, sdMode);
-#endif
-    } else
-#endif
-    {
-        // Internal filesystem - handle platform-specific mode conversion
-        concurrency::LockGuard g(spiLock);
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-        // ESP32/RP2040: Convert uint8_t mode to string mode
-        // FILE_O_READ is "r" (string), FILE_O_WRITE is "w" (string) on these platforms
-        // mode is uint8_t: 0 = read, non-zero = write
-        const char *modeStr = (mode == 0) ? FILE_O_READ : FILE_O_WRITE;
-        result = FSCom.open(strippedPath, modeStr);
-#else
-        // STM32WL/NRF52: Use uint8_t mode directly
-        // FILE_O_READ=0, FILE_O_WRITE=1 on these platforms
-        result = FSCom.open(strippedPath, mode);
-#endif
-    }
+LoFS::LockDomain &LoFS::targetLockDomain(const char *target)
+{
+    // Calls end up in the target backend, so they need its lock
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = mapTarget(target, "/", buf, sizeof(buf));
+    return inner ? inner->lockDomain() : LockDomain::spi();
+}
 
-    free(strippedPath);
-    return result;
+LoFS::LockDomain &LoFS::lockDomain(const char *filepath)
+{
+    char path[LOFS_PATH_MAX];
+    Backend *backend = resolve(filepath, path, sizeof(path));
+    return backend ? backend->lockDomain() : LockDomain::spi();
+}
+
+File LoFS::open(const char *filepath, uint8_t mode)
+{
+    // mode is uint8_t: 0 = read, non-zero = write (FILE_O_READ/FILE_O_WRITE on STM32WL/NRF52)
+    return open(filepath, (mode == 0) ? "r" : "w");
 }
 
 File LoFS::open(const char *filepath, const char *mode)
 {
     char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
+    Backend *backend = parsePath(filepath, &strippedPath);
 
-    if (!strippedPath || fsType == FSType::INVALID) {
+    if (!strippedPath || !backend || !mode) {
         if (strippedPath) {
             free(strippedPath);
         }
         return File();
     }
 
-    File result;
+    File result = holdAuto(filepath, backend, openResolved(backend, strippedPath, mode));
+    free(strippedPath);
+    return result;
+}
 
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-        // ESP32/RP2040: SD library uses string modes, pass directly
-        result = SD.open(strippedPath, mode);
-#else
-        // STM32WL/NRF52: SD library uses uint8_t modes
-        uint8_t sdMode = convertToSDMode(mode);
-        result = SD.open(strippedPath, sdMode);
-#endif
-    } else
-#endif
-    {
-        // Internal filesystem - handle platform-specific mode
-        concurrency::LockGuard g(spiLock);
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-        // ESP32/RP2040: Use string mode directly
-        result = FSCom.open(strippedPath, mode);
-#else
-        // STM32WL/NRF52: Convert string mode to uint8_t
-        // "r" -> 0 (FILE_O_READ), "w" -> 1 (FILE_O_WRITE)
-        uint8_t modeInt = (strcmp(mode, "r") == 0) ? 0 : 1;
-        result = FSCom.open(strippedPath, modeInt);
-#endif
+File LoFS::openResolved(Backend *backend, const char *strippedPath, const char *mode)
+{
+    StatTimer t(backend, Stats::Op::OPEN);
+    // Any write mode may change the contents under cached blocks
+    if (strcmp(mode, "r") != 0) {
+        invalidateCache(backend, strippedPath);
     }
 
-    free(strippedPath);
-    return result;
+    File result;
+    if (strcmp(mode, "r") == 0) {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        result = backend->open(strippedPath, mode);
+    } else {
+        LockDomain::Guard g(backend->lockDomain());
+        result = backend->open(strippedPath, mode);
+    }
+    if (strcmp(mode, "r") != 0) {
+        if (result) {
+            dentrySet(backend, strippedPath, true);
+        } else {
+            dentryForget(backend, strippedPath, false);
+        }
+    }
+
+    return t.result(result);
 }
 
 bool LoFS::exists(const char *filepath)
 {
     char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
+    Backend *backend = parsePath(filepath, &strippedPath);
 
-    if (!strippedPath || fsType == FSType::INVALID) {
+    if (!strippedPath || !backend) {
         if (strippedPath) {
             free(strippedPath);
         }
         return false;
     }
 
-    bool result = false;
+    bool result = existsResolved(backend, strippedPath);
+    free(strippedPath);
+    return result;
+}
 
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.exists(strippedPath);
-    } else
-#endif
-    {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.exists(strippedPath);
+bool LoFS::existsResolved(Backend *backend, const char *strippedPath)
+{
+    StatTimer t(backend, Stats::Op::EXISTS);
+    bool result = false;
+    uint32_t generation = 0;
+    if (!dentryLookup(backend, strippedPath, &result, &generation)) {
+        {
+            LockDomain::SharedGuard g(backend->lockDomain());
+            result = backend->exists(strippedPath);
+        }
+        dentryStore(backend, strippedPath, result, generation);
     }
 
-    free(strippedPath);
+    // A miss is an answer, not a failure; Backend::exists() has no separate error
+    t.result(true);
     return result;
 }
 
 bool LoFS::mkdir(const char *filepath)
 {
     char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
+    Backend *backend = parsePath(filepath, &strippedPath);
 
-    if (!strippedPath || fsType == FSType::INVALID) {
+    if (!strippedPath || !backend) {
         if (strippedPath) {
             free(strippedPath);
         }
         return false;
     }
 
-    bool result = false;
+    bool result = mkdirResolved(backend, strippedPath);
+    free(strippedPath);
+    return result;
+}
 
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.mkdir(strippedPath);
-    } else
-#endif
+bool LoFS::mkdirResolved(Backend *backend, const char *strippedPath)
+{
+    StatTimer t(backend, Stats::Op::MKDIR);
+    bool result = false;
     {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.mkdir(strippedPath);
+        LockDomain::Guard g(backend->lockDomain());
+        result = backend->mkdir(strippedPath);
+    }
+    if (result) {
+        dentrySet(backend, strippedPath, true);
+    } else {
+        dentryForget(backend, strippedPath, false);
     }
 
-    free(strippedPath);
-    return result;
+    return t.result(result);
 }
 
 bool LoFS::remove(const char *filepath)
 {
     char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
+    Backend *backend = parsePath(filepath, &strippedPath);
 
-    if (!strippedPath || fsType == FSType::INVALID) {
+    if (!strippedPath || !backend) {
         if (strippedPath) {
             free(strippedPath);
         }
         return false;
     }
 
-    bool result = false;
-
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.remove(strippedPath);
-    } else
-#endif
-    {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.remove(strippedPath);
-    }
-
+    bool result = removeResolved(backend, strippedPath);
     free(strippedPath);
     return result;
 }
 
-bool LoFS::rename(const char *oldfilepath, const char *newfilepath)
+bool LoFS::removeResolved(Backend *backend, const char *strippedPath)
 {
-    char *oldStripped = nullptr;
-    char *newStripped = nullptr;
-    FSType oldType = parsePath(oldfilepath, &oldStripped);
-    FSType newType = parsePath(newfilepath, &newStripped);
-
-    if (!oldStripped || !newStripped || oldType == FSType::INVALID || newType == FSType::INVALID) {
-        if (oldStripped) {
-            free(oldStripped);
-        }
-        if (newStripped) {
-            free(newStripped);
-        }
-        return false;
-    }
+    StatTimer t(backend, Stats::Op::REMOVE);
+    invalidateCache(backend, strippedPath);
 
     bool result = false;
-
-    // If both paths are on the same filesystem, use simple rename
-    if (oldType == newType) {
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-        if (oldType == FSType::SD) {
-            concurrency::LockGuard g(spiLock);
-            result = SD.rename(oldStripped, newStripped);
-        } else
-#endif
-        {
-            // Internal filesystem
-            concurrency::LockGuard g(spiLock);
-            result = FSCom.rename(oldStripped, newStripped);
+    bool tracked = spaceTracked(backend);
+    uint64_t size = 0;
+    {
+        LockDomain::Guard g(backend->lockDomain());
+        if (tracked) {
+            size = fileLength(backend, strippedPath);
         }
+        result = backend->remove(strippedPath);
+    }
+    if (result) {
+        spaceAdjust(backend, -(int64_t)size);
+        dentrySet(backend, strippedPath, false);
     } else {
-        // Cross-filesystem rename: copy + delete
-        // Use a single lock for the entire operation to ensure atomicity
-        concurrency::LockGuard g(spiLock);
-
-        // Open source file
-        File srcFile;
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-        if (oldType == FSType::SD) {
-            srcFile = SD.open(oldStripped, FILE_READ);
-        } else
-#endif
-        {
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-            // ESP32/RP2040: FILE_O_READ is "r" (string)
-            srcFile = FSCom.open(oldStripped, FILE_O_READ);
-#else
-            // STM32WL/NRF52: FILE_O_READ is 0 (uint8_t)
-            srcFile = FSCom.open(oldStripped, FILE_O_READ);
-#endif
-        }
-
-        if (!srcFile) {
-            free(oldStripped);
-            free(newStripped);
-            return false;
-        }
-
-        // Remove destination if it exists
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-        if (newType == FSType::SD) {
-            if (SD.exists(newStripped)) {
-                SD.remove(newStripped);
-            }
-        } else
-#endif
-        {
-            if (FSCom.exists(newStripped)) {
-                FSCom.remove(newStripped);
-            }
-        }
-
-        // Open/create destination file
-        File dstFile;
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-        if (newType == FSType::SD) {
-            dstFile = SD.open(newStripped, FILE_WRITE);
-        } else
-#endif
-        {
-#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
-            // ESP32/RP2040: FILE_O_WRITE is "w" (string)
-            dstFile = FSCom.open(newStripped, FILE_O_WRITE);
-#else
-            // STM32WL/NRF52: FILE_O_WRITE is 1 (uint8_t)
-            dstFile = FSCom.open(newStripped, FILE_O_WRITE);
-#endif
-        }
-
-        if (!dstFile) {
-            srcFile.close();
-            free(oldStripped);
-            free(newStripped);
-            return false;
-        }
-
-        // Copy data
-        unsigned char buffer[64]; // Larger buffer for better performance
-        size_t bytesRead;
-        result = true;
-
-        while ((bytesRead = srcFile.read(buffer, sizeof(buffer))) > 0) {
-            if (dstFile.write(buffer, bytesRead) != bytesRead) {
-                result = false;
-                break;
-            }
-        }
-
-        dstFile.flush();
-        dstFile.close();
-        srcFile.close();
-
-        // Delete source file only if copy succeeded
-        if (result) {
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-            if (oldType == FSType::SD) {
-                result = SD.remove(oldStripped);
-            } else
-#endif
-            {
-                result = FSCom.remove(oldStripped);
-            }
-        } else {
-            // Copy failed, try to clean up destination
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-            if (newType == FSType::SD) {
-                SD.remove(newStripped);
-            } else
-#endif
-            {
-                FSCom.remove(newStripped);
-            }
-        }
+        dentryForget(backend, strippedPath, false);
     }
 
-    free(oldStripped);
-    free(newStripped);
-    return result;
+    return t.result(result);
+}
+
+bool LoFS::rename(const char *oldfilepath, const char *newfilepath)
+{
+    return move(oldfilepath, newfilepath);
 }
 
 bool LoFS::rmdir(const char *filepath, bool recursive)
 {
-    if (!exists(filepath)) {
-        return true; // Already doesn't exist, consider it success
+    // Fixed buffer: removeTree() extends it in place with child names
+    char path[LOFS_PATH_MAX];
+    Backend *backend = resolve(filepath, path, sizeof(path));
+    if (!backend) {
+        return false;
     }
+    return rmdirResolved(backend, path, recursive);
+}
 
-    // If recursive, first remove all contents
-    if (recursive) {
-        // Use LoFS::open to get a File object that handles prefix correctly
-        File dir = open(filepath, FILE_O_READ);
+bool LoFS::rmdirResolved(Backend *backend, char *path, bool recursive)
+{
+    StatTimer t(backend, Stats::Op::RMDIR);
+
+    bool isDir;
+    {
+        LockDomain::SharedGuard g(backend->lockDomain());
+        if (!backend->exists(path)) {
+            return t.result(true); // Already doesn't exist, consider it success
+        }
+        File dir = backend->open(path, "r");
         if (!dir) {
             return false;
         }
+        isDir = dir.isDirectory();
+        dir.close();
+    }
 
-        if (!dir.isDirectory()) {
-            dir.close();
-            // If it's not a directory, try removing as a file
-            return remove(filepath);
+    if (!isDir) {
+        // If it's not a directory, try removing as a file (recursive only, as before)
+        if (!recursive) {
+            return false;
         }
-
-        bool result = true;
-        
-        // Recursively remove all files and subdirectories
-        while (true) {
-            File file = dir.openNextFile();
-            if (!file) {
-                break;
-            }
-            
-            // Get the name from file.name() - this might be full path or just filename
-            std::string pathFromFile = file.name();
-            bool isDir = file.isDirectory();
-            file.close();
-            
-            // Always construct full path from parent directory to ensure correctness
-            // Extract just the filename/entry name (after last /)
-            size_t lastSlash = pathFromFile.rfind('/');
-            std::string entryName = (lastSlash != std::string::npos) ? pathFromFile.substr(lastSlash + 1) : pathFromFile;
-            
-            // Skip "." and ".." entries
-            if (entryName == "." || entryName == "..") {
-                continue;
-            }
-            
-            // Build full path: filepath/entryName
-            char fullPathBuf[256];
-            snprintf(fullPathBuf, sizeof(fullPathBuf), "%s/%s", filepath, entryName.c_str());
-            std::string fullPath = fullPathBuf;
-            
-            // Recursively remove subdirectories, or remove files
-            if (isDir) {
-                // Recursively remove subdirectory
-                if (!rmdir(fullPath.c_str(), true)) {
-                    result = false;
-                }
-            } else {
-                // Remove file
-                if (!remove(fullPath.c_str())) {
-                    result = false;
-                }
+        invalidateCache(backend, path);
+        bool result;
+        bool tracked = spaceTracked(backend);
+        uint64_t size = 0;
+        {
+            LockDomain::Guard g(backend->lockDomain());
+            if (tracked) {
+                size = fileLength(backend, path);
             }
+            result = backend->remove(path);
         }
-        dir.close();
-
-        if (!result) {
-            return false;
+        dentryForget(backend, path, false);
+        if (result) {
+            spaceAdjust(backend, -(int64_t)size);
         }
+        return t.result(result);
     }
 
-    // Now remove the directory itself (or if non-recursive, just try to remove empty directory)
-    char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
-
-    if (!strippedPath || fsType == FSType::INVALID) {
-        if (strippedPath) {
-            free(strippedPath);
-        }
-        return false;
+    bool result;
+    if (recursive) {
+        // removeTree() only writes past the root's end in the path buffer
+        size_t rootLen = strlen(path);
+        result = removeTree(backend, path);
+        path[rootLen] = '\0';
+        invalidateCache(backend, path, true); // Also files removeTree() could not address
+        dentryForget(backend, path, true);
+        spaceStale(backend); // Too many files to size one by one
+        return t.result(result);
     }
 
-    bool result = false;
-
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.rmdir(strippedPath);
-    } else
-#endif
+    // Non-recursive: just try to remove the (empty) directory
     {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.rmdir(strippedPath);
+        LockDomain::Guard g(backend->lockDomain());
+        result = backend->rmdir(path);
     }
-
-    free(strippedPath);
-    return result;
+    dentryForget(backend, path, false);
+    return t.result(result);
 }
 
 uint64_t LoFS::totalBytes(const char *filepath)
 {
-    char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
-
-    if (!strippedPath || fsType == FSType::INVALID) {
-        if (strippedPath) {
-            free(strippedPath);
-        }
-        return 0;
-    }
-
-    uint64_t result = 0;
-
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.totalBytes();
-    } else
-#endif
-    {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.totalBytes();
-    }
-
-    free(strippedPath);
-    return result;
+    return spaceInfo(filepath).totalBytes;
 }
 
 uint64_t LoFS::usedBytes(const char *filepath)
 {
-    char *strippedPath = nullptr;
-    FSType fsType = parsePath(filepath, &strippedPath);
-
-    if (!strippedPath || fsType == FSType::INVALID) {
-        if (strippedPath) {
-            free(strippedPath);
-        }
-        return 0;
-    }
-
-    uint64_t result = 0;
-
-#if defined(HAS_SDCARD) && !defined(SDCARD_USE_SOFT_SPI)
-    if (fsType == FSType::SD) {
-        concurrency::LockGuard g(spiLock);
-        result = SD.usedBytes();
-    } else
-#endif
-    {
-        // Internal filesystem
-        concurrency::LockGuard g(spiLock);
-        result = FSCom.usedBytes();
-    }
-
-    free(strippedPath);
-    return result;
+    return spaceInfo(filepath).usedBytes;
 }
 
 uint64_t LoFS::freeBytes(const char *filepath)
 {
-    uint64_t total = totalBytes(filepath);
-    uint64_t used = usedBytes(filepath);
-    if (total == 0) {
-        return 0; // Invalid filesystem
-    }
-    return total - used;
+    return spaceInfo(filepath).freeBytes;
 }
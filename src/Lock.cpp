@@ -0,0 +1,46 @@
+#include <lofs/Lock.h>
+#include "SPILock.h"
+#include "configuration.h"
+
+#ifdef ARCH_PORTDUINO
+
+LoFS::Lock::Lock() : held(false) {}
+
+LoFS::Lock::~Lock() {}
+
+void LoFS::Lock::lock()
+{
+    std::unique_lock<std::mutex> g(mutex);
+    released.wait(g, [this]() { return !held; });
+    held = true;
+}
+
+void LoFS::Lock::unlock()
+{
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        held = false;
+    }
+    released.notify_one();
+}
+
+#else
+
+LoFS::Lock::Lock() : impl(new concurrency::Lock()) {}
+
+LoFS::Lock::~Lock()
+{
+    delete impl;
+}
+
+void LoFS::Lock::lock()
+{
+    impl->lock();
+}
+
+void LoFS::Lock::unlock()
+{
+    impl->unlock();
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include <lofs/Lock.h>
+#include <lofs/LockDomain.h>
+#include "SPILock.h"
+#include "configuration.h"
+#include <string.h>
+
+#ifdef ARCH_PORTDUINO
+// spiLock does nothing without FreeRTOS, but the async worker is a real
+// thread here, so the SPI domains share a LoFS lock instead. A function
+// static, so it exists even for a domain built during static init.
+static LoFS::Lock *hostSpiLock()
+{
+    static LoFS::Lock *lock = new LoFS::Lock();
+    return lock;
+}
+#endif
+
+LoFS::LockDomain::LockDomain(Kind kind, bool sharedReads)
+    : own(nullptr), gate(sharedReads ? new Lock() : nullptr), readers(0), kind(kind), shared(sharedReads),
+      heldSinceUs(0)
+{
+    memset(&counters, 0, sizeof(counters));
+    if (kind == Kind::OWN) {
+        own = new Lock();
+    } else {
+#ifdef ARCH_PORTDUINO
+        own = hostSpiLock();
+#endif
+        // Elsewhere own stays nullptr: spiLock is created by the firmware and may not exist yet
+    }
+}
+
+LoFS::LockDomain &LoFS::LockDomain::spi()
+{
+    static LockDomain domain(Kind::SPI);
+    return domain;
+}
+
+void LoFS::LockDomain::acquire()
+{
+    if (own) {
+        own->lock();
+    } else {
+        spiLock->lock();
+    }
+}
+
+void LoFS::LockDomain::release()
+{
+    if (own) {
+        own->unlock();
+    } else {
+        spiLock->unlock();
+    }
+}
+
+const void *LoFS::LockDomain::lockId()
+{
+    return own ? (const void *)own : (const void *)spiLock;
+}
+
+void LoFS::LockDomain::lock()
+{
+#if LOFS_STATS
+    uint32_t startUs = micros();
+    acquire();
+    heldSinceUs = micros();
+    uint32_t waited = heldSinceUs - startUs;
+    counters.acquisitions++;
+    counters.waitUs += waited;
+    if (waited >= 1000) {
+        counters.contended++;
+    }
+    if (waited > counters.maxWaitUs) {
+        counters.maxWaitUs = waited;
+    }
+#else
+    acquire();
+#endif
+}
+
+void LoFS::LockDomain::unlock()
+{
+#if LOFS_STATS
+    uint32_t held = micros() - heldSinceUs;
+    counters.holdUs += held;
+    if (held > counters.maxHoldUs) {
+        counters.maxHoldUs = held;
+    }
+#endif
+    release();
+}
+
+void LoFS::LockDomain::resetLockCounters()
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+void LoFS::LockDomain::lockShared()
+{
+    if (!shared) {
+        lock();
+        return;
+    }
+    // The first reader takes the exclusive lock for the whole group and the
+    // last one releases it, possibly from another task. That is fine for the
+    // binary semaphores behind LoFS::Lock.
+    Lock::Guard g(gate);
+    if (readers++ == 0) {
+        lock();
+    }
+}
+
+void LoFS::LockDomain::unlockShared()
+{
+    if (!shared) {
+        unlock();
+        return;
+    }
+    Lock::Guard g(gate);
+    if (--readers == 0) {
+        unlock();
+    }
+}
+
+LoFS::LockDomain::PairGuard::PairGuard(LockDomain &a, LockDomain &b) : first(&a), second(&b)
+{
+    const void *lockA = a.lockId();
+    const void *lockB = b.lockId();
+    if (lockA == lockB) {
+        second = nullptr;
+    } else if ((uintptr_t)lockB < (uintptr_t)lockA) {
+        first = &b;
+        second = &a;
+    }
+    first->lock();
+    if (second) {
+        second->lock();
+    }
+}
+
+LoFS::LockDomain::PairGuard::~PairGuard()
+{
+    if (second) {
+        second->unlock();
+    }
+    first->unlock();
+}
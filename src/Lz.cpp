@@ -0,0 +1,311 @@
+#include "Lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_BUF (2 * LOFS_LZ_WINDOW)
+#define LZ_HASH_BITS 9
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+// Candidates tried per position; longer chains compress a little better and run slower
+#ifndef LOFS_LZ_MAX_CHAIN
+#define LOFS_LZ_MAX_CHAIN 16
+#endif
+
+static inline uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+LzEncoder::LzEncoder()
+    : buf(nullptr), head(nullptr), prev(nullptr), start(0), end(0), groupLen(0), groupCount(0), outLen(0),
+      sink(nullptr), context(nullptr), ok(false)
+{
+}
+
+bool LzEncoder::begin(Sink sink, void *context)
+{
+    if (!buf) {
+        buf = (uint8_t *)malloc(LZ_BUF);
+        head = (uint16_t *)malloc(LZ_HASH_SIZE * sizeof(uint16_t));
+        prev = (uint16_t *)malloc(LZ_BUF * sizeof(uint16_t));
+        if (!buf || !head || !prev) {
+            release();
+            return false;
+        }
+    }
+    memset(head, 0, LZ_HASH_SIZE * sizeof(uint16_t));
+    start = 0;
+    end = 0;
+    groupLen = 0;
+    groupCount = 0;
+    outLen = 0;
+    this->sink = sink;
+    this->context = context;
+    ok = true;
+    return true;
+}
+
+void LzEncoder::release()
+{
+    free(buf);
+    free(head);
+    free(prev);
+    buf = nullptr;
+    head = nullptr;
+    prev = nullptr;
+    ok = false;
+}
+
+bool LzEncoder::write(const uint8_t *data, size_t len)
+{
+    while (ok && len > 0) {
+        if (end == LZ_BUF) {
+            slide();
+        }
+        size_t n = LZ_BUF - end;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(buf + end, data, n);
+        end += n;
+        data += n;
+        len -= n;
+        encode(false);
+    }
+    return ok;
+}
+
+bool LzEncoder::finish()
+{
+    if (!ok) {
+        return false;
+    }
+    encode(true);
+    token(true, 0, 0); // Distance 0: end of stream
+    if (groupCount > 0) {
+        put(group, groupLen);
+        groupCount = 0;
+    }
+    return drain();
+}
+
+void LzEncoder::insert(size_t pos)
+{
+    if (pos + LOFS_LZ_MIN_MATCH > end) {
+        return;
+    }
+    uint32_t h = hash3(buf + pos);
+    prev[pos] = head[h];
+    head[h] = (uint16_t)(pos + 1);
+}
+
+// Drop history older than one window so the buffer can take more input
+void LzEncoder::slide()
+{
+    size_t delta = (start > LOFS_LZ_WINDOW) ? start - LOFS_LZ_WINDOW : 0;
+    if (delta == 0) {
+        return;
+    }
+    memmove(buf, buf + delta, end - delta);
+    for (size_t i = 0; i < LZ_HASH_SIZE; i++) {
+        head[i] = (head[i] > delta) ? (uint16_t)(head[i] - delta) : 0;
+    }
+    for (size_t i = 0; i + delta < end; i++) {
+        uint16_t p = prev[i + delta];
+        prev[i] = (p > delta) ? (uint16_t)(p - delta) : 0;
+    }
+    start -= delta;
+    end -= delta;
+}
+
+// Encode buffered input; without final, keep a full match length of lookahead
+void LzEncoder::encode(bool final)
+{
+    while (start < end && (final || end - start >= LOFS_LZ_MAX_MATCH)) {
+        size_t maxLen = end - start;
+        if (maxLen > LOFS_LZ_MAX_MATCH) {
+            maxLen = LOFS_LZ_MAX_MATCH;
+        }
+        size_t bestLen = 0;
+        size_t bestDist = 0;
+        if (maxLen >= LOFS_LZ_MIN_MATCH) {
+            uint16_t candidate = head[hash3(buf + start)];
+            for (int chain = 0; candidate && chain < LOFS_LZ_MAX_CHAIN; chain++) {
+                size_t pos = candidate - 1;
+                size_t dist = start - pos;
+                if (dist >= LOFS_LZ_WINDOW) {
+                    break; // Chains run from newest to oldest
+                }
+                size_t len = 0;
+                while (len < maxLen && buf[pos + len] == buf[start + len]) {
+                    len++;
+                }
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = dist;
+                    if (len == maxLen) {
+                        break;
+                    }
+                }
+                candidate = prev[pos];
+            }
+        }
+
+        if (bestLen >= LOFS_LZ_MIN_MATCH) {
+            token(true, (uint8_t)(((bestDist >> 8) << 4) | (bestLen - LOFS_LZ_MIN_MATCH)), (uint8_t)bestDist);
+            for (size_t i = 0; i < bestLen; i++) {
+                insert(start + i);
+            }
+            start += bestLen;
+        } else {
+            token(false, buf[start], 0);
+            insert(start);
+            start++;
+        }
+    }
+}
+
+void LzEncoder::token(bool match, uint8_t a, uint8_t b)
+{
+    if (groupCount == 0) {
+        group[0] = 0;
+        groupLen = 1;
+    }
+    if (match) {
+        group[0] |= (uint8_t)(1 << groupCount);
+        group[groupLen++] = a;
+        group[groupLen++] = b;
+    } else {
+        group[groupLen++] = a;
+    }
+    if (++groupCount == 8) {
+        put(group, groupLen);
+        groupCount = 0;
+    }
+}
+
+void LzEncoder::put(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        if (outLen == sizeof(out) && !drain()) {
+            return;
+        }
+        size_t n = sizeof(out) - outLen;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(out + outLen, data, n);
+        outLen += n;
+        data += n;
+        len -= n;
+    }
+}
+
+bool LzEncoder::drain()
+{
+    if (ok && outLen > 0) {
+        ok = sink(out, outLen, context);
+    }
+    outLen = 0;
+    return ok;
+}
+
+LzDecoder::LzDecoder()
+    : window(nullptr), written(0), used(0), copyDist(0), copyLen(0), flags(0), flagBits(0), inPos(0), inLen(0),
+      source(nullptr), context(nullptr), done(false), bad(false)
+{
+}
+
+bool LzDecoder::begin(Source source, void *context)
+{
+    if (!window) {
+        window = (uint8_t *)malloc(LOFS_LZ_WINDOW);
+    }
+    written = 0;
+    used = 0;
+    copyDist = 0;
+    copyLen = 0;
+    flagBits = 0;
+    inPos = 0;
+    inLen = 0;
+    this->source = source;
+    this->context = context;
+    done = false;
+    bad = (window == nullptr);
+    return !bad;
+}
+
+void LzDecoder::release()
+{
+    free(window);
+    window = nullptr;
+}
+
+int LzDecoder::next()
+{
+    if (inPos == inLen) {
+        inLen = (uint8_t)source(in, sizeof(in), context);
+        inPos = 0;
+        if (inLen == 0) {
+            bad = true; // Input ended before the end marker
+            return -1;
+        }
+    }
+    used++;
+    return in[inPos++];
+}
+
+size_t LzDecoder::read(uint8_t *data, size_t len)
+{
+    size_t n = 0;
+    while (n < len && !bad) {
+        if (copyLen > 0) {
+            uint8_t c = window[(written - copyDist) & (LOFS_LZ_WINDOW - 1)];
+            window[written++ & (LOFS_LZ_WINDOW - 1)] = c;
+            data[n++] = c;
+            copyLen--;
+            continue;
+        }
+        if (done) {
+            break;
+        }
+        if (flagBits == 0) {
+            int f = next();
+            if (f < 0) {
+                break;
+            }
+            flags = (uint8_t)f;
+            flagBits = 8;
+        }
+        bool match = flags & 1;
+        flags >>= 1;
+        flagBits--;
+
+        int a = next();
+        if (a < 0) {
+            break;
+        }
+        if (!match) {
+            window[written++ & (LOFS_LZ_WINDOW - 1)] = (uint8_t)a;
+            data[n++] = (uint8_t)a;
+            continue;
+        }
+        int b = next();
+        if (b < 0) {
+            break;
+        }
+        uint16_t dist = (uint16_t)(((a >> 4) << 8) | b);
+        if (dist == 0) {
+            done = true;
+            break;
+        }
+        if (dist > written || dist >= LOFS_LZ_WINDOW) {
+            bad = true; // Before the start of the stream or outside our window
+            break;
+        }
+        copyDist = dist;
+        copyLen = (uint8_t)((a & 0x0F) + LOFS_LZ_MIN_MATCH);
+    }
+    return n;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// History the encoder may refer back into; power of two, at most 4096.
+// Decoders need a window at least as large as the encoder that wrote the data.
+#ifndef LOFS_LZ_WINDOW
+#define LOFS_LZ_WINDOW 1024
+#endif
+static_assert((LOFS_LZ_WINDOW & (LOFS_LZ_WINDOW - 1)) == 0 && LOFS_LZ_WINDOW <= 4096,
+              "LOFS_LZ_WINDOW must be a power of two up to 4096");
+
+#define LOFS_LZ_MIN_MATCH 3
+#define LOFS_LZ_MAX_MATCH 18
+
+/**
+ * @brief Streaming LZSS encoder with a bounded window
+ *
+ * Output is groups of eight tokens, each group led by a flag byte (bit i set:
+ * token i is a match). A literal is one byte; a match is two bytes holding a
+ * 12-bit distance and a 4-bit length (3..18). Distance 0 ends the stream.
+ * Matches are found through a 3-byte hash and a short chain, so memory is
+ * fixed at about 2 * LOFS_LZ_WINDOW * 3 bytes plus a 1 KB hash table.
+ *
+ * Usage example:
+ *   LzEncoder enc;
+ *   enc.begin(sink, context);    // sink receives compressed bytes
+ *   enc.write(data, len);        // any number of times
+ *   enc.finish();                // end marker; the encoder can begin() again
+ */
+class LzEncoder
+{
+  public:
+    /// Receives compressed output; return false to fail the stream
+    typedef bool (*Sink)(const uint8_t *data, size_t len, void *context);
+
+    LzEncoder();
+    ~LzEncoder() { release(); }
+
+    /// @return false if the buffers could not be allocated
+    bool begin(Sink sink, void *context);
+    bool write(const uint8_t *data, size_t len);
+
+    /// Encode what is left, write the end marker and flush to the sink
+    bool finish();
+
+    /// Free the buffers
+    void release();
+
+  private:
+    LzEncoder(const LzEncoder &) = delete;
+    LzEncoder &operator=(const LzEncoder &) = delete;
+
+    void encode(bool final);
+    void insert(size_t pos);
+    void slide();
+    void token(bool match, uint8_t a, uint8_t b);
+    void put(const uint8_t *data, size_t len);
+    bool drain();
+
+    uint8_t *buf;   ///< History followed by lookahead, 2 * LOFS_LZ_WINDOW
+    uint16_t *head; ///< Hash -> last position + 1 (0: none)
+    uint16_t *prev; ///< Position -> earlier position + 1 with the same hash
+    size_t start;   ///< Next byte to encode
+    size_t end;     ///< Bytes in buf
+    uint8_t group[17];
+    uint8_t groupLen;
+    uint8_t groupCount;
+    uint8_t out[64];
+    uint8_t outLen;
+    Sink sink;
+    void *context;
+    bool ok;
+};
+
+/**
+ * @brief Streaming decoder for LzEncoder output
+ *
+ * Pulls compressed bytes from a source callback in small chunks and stops
+ * at the end marker. The source may have been read past the marker;
+ * consumed() tells where the stream really ended.
+ */
+class LzDecoder
+{
+  public:
+    /// Provides compressed input; returns bytes stored, 0 at end of input
+    typedef size_t (*Source)(uint8_t *data, size_t len, void *context);
+
+    LzDecoder();
+    ~LzDecoder() { release(); }
+
+    /// @return false if the window could not be allocated
+    bool begin(Source source, void *context);
+
+    /// @return Bytes decoded; fewer than len only at the end marker or on error
+    size_t read(uint8_t *data, size_t len);
+
+    /// End marker reached
+    bool finished() const { return done; }
+
+    /// Input ended early or held an impossible match
+    bool failed() const { return bad; }
+
+    /// Compressed bytes used so far
+    size_t consumed() const { return used; }
+
+    void release();
+
+  private:
+    LzDecoder(const LzDecoder &) = delete;
+    LzDecoder &operator=(const LzDecoder &) = delete;
+
+    int next();
+
+    uint8_t *window;
+    size_t written;    ///< Bytes decoded so far (window position)
+    size_t used;
+    uint16_t copyDist; ///< Pending match
+    uint8_t copyLen;
+    uint8_t flags;
+    uint8_t flagBits;  ///< Tokens left in the current group
+    uint8_t in[32];    ///< Input chunk; may hold bytes past the end marker
+    uint8_t inPos;
+    uint8_t inLen;
+    Source source;
+    void *context;
+    bool done;
+    bool bad;
+};
@@ -0,0 +1,295 @@
+#include <lofs/Backend.h>
+#include <lofs/BufferedFile.h>
+#include <lofs/CachedFile.h>
+#include <lofs/Path.h>
+#include <lofs/ReservedFile.h>
+#include <string.h>
+
+LoFS::Path::Path() : backend(nullptr), generation(0), len(0), offset(0)
+{
+    full[0] = '\0';
+}
+
+LoFS::Path::Path(const char *filepath) : backend(nullptr), generation(0), len(0), offset(0)
+{
+    full[0] = '\0';
+    if (filepath && append(filepath)) {
+        lookup();
+    }
+}
+
+bool LoFS::Path::append(const char *text)
+{
+    size_t n = len;
+    for (; *text; text++) {
+        if (*text == '/' && n > 0 && full[n - 1] == '/') {
+            continue;
+        }
+        if (n + 1 >= sizeof(full)) {
+            len = 0;
+            full[0] = '\0';
+            return false;
+        }
+        full[n++] = *text;
+    }
+    full[n] = '\0';
+    len = (uint16_t)n;
+    // "/sd/" keeps its slash: without it the mount name no longer matches
+    while (len > 1 && full[len - 1] == '/' && (size_t)(len - 1) != firstSlash()) {
+        full[--len] = '\0';
+    }
+    return len > 0;
+}
+
+size_t LoFS::Path::firstSlash() const
+{
+    if (full[0] != '/') {
+        return 0;
+    }
+    const char *slash = strchr(full + 1, '/');
+    return slash ? (size_t)(slash - full) : 0;
+}
+
+void LoFS::Path::lookup()
+{
+    backend = nullptr;
+    offset = 0;
+    generation = mountGeneration();
+    if (len == 0) {
+        return;
+    }
+    char stripped[LOFS_PATH_MAX];
+    Backend *found = resolve(full, stripped, sizeof(stripped));
+    if (!found) {
+        return; // e.g. no SD card yet: resolved again on each use
+    }
+    // Every mount strips a prefix (and the SD backend one '/'), so the backend
+    // path is a suffix of full. /auto/ paths map into a tier directory instead
+    // and are left uncached.
+    size_t strippedLen = strlen(stripped);
+    if (strippedLen <= len && memcmp(full + len - strippedLen, stripped, strippedLen) == 0) {
+        backend = found;
+        offset = (uint16_t)(len - strippedLen);
+    }
+}
+
+bool LoFS::Path::routed() const
+{
+    return backend && generation == mountGeneration();
+}
+
+LoFS::Backend *LoFS::Path::route(char *buf, size_t size, const char **strippedPath) const
+{
+    if (routed()) {
+        if (!backend->isAvailable()) {
+            return nullptr;
+        }
+        *strippedPath = full + offset;
+        return backend;
+    }
+    *strippedPath = buf;
+    if (len == 0) {
+        return nullptr;
+    }
+    Backend *found = resolve(full, buf, size);
+    touchAuto(full); // Unrouted paths include every /auto/ one
+    return found;
+}
+
+LoFS::Path LoFS::Path::join(const char *name) const
+{
+    if (len == 0 || !name) {
+        return Path();
+    }
+    Path child(*this);
+    if (full[len - 1] != '/') {
+        if ((size_t)len + 1 >= sizeof(full)) {
+            return Path();
+        }
+        child.full[child.len++] = '/';
+        child.full[child.len] = '\0';
+    }
+    if (!child.append(name)) {
+        return Path();
+    }
+    // A name that completes the first component ("/sd" + "x") may select another mount
+    if (!routed() || firstSlash() == 0) {
+        child.lookup();
+    }
+    return child;
+}
+
+LoFS::Path LoFS::Path::parent() const
+{
+    Path dir(*this);
+    if (len == 0) {
+        return dir;
+    }
+    size_t slash = firstSlash();
+    const char *last = strrchr(full, '/');
+    size_t cut;
+    if (slash == 0 || len == slash + 1) {
+        // "/x", "/sd/" and "/" go up to "/" (relative "a/b" to "a"), which may be another backend
+        cut = (full[0] == '/') ? 1 : last ? (size_t)(last - full) : 0;
+    } else {
+        // Stays below the mount: "/sd/a/b" -> "/sd/a", "/sd/a" -> "/sd/"
+        cut = (size_t)(last - full);
+        if (cut == slash) {
+            cut++;
+        }
+    }
+    dir.len = (uint16_t)cut;
+    dir.full[cut] = '\0';
+    if (slash == 0 || len == slash + 1 || !routed()) {
+        dir.lookup();
+    }
+    return dir;
+}
+
+const char *LoFS::Path::filename() const
+{
+    if (len == 0 || full[len - 1] == '/') {
+        return full + len;
+    }
+    const char *last = strrchr(full, '/');
+    return last ? last + 1 : full;
+}
+
+File LoFS::open(const Path &path, uint8_t mode)
+{
+    return open(path, (mode == 0) ? "r" : "w");
+}
+
+File LoFS::open(const Path &path, const char *mode)
+{
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *backend = path.route(buf, sizeof(buf), &strippedPath);
+    return (backend && mode) ? holdAuto(path.c_str(), backend, openResolved(backend, strippedPath, mode)) : File();
+}
+
+bool LoFS::exists(const Path &path)
+{
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *backend = path.route(buf, sizeof(buf), &strippedPath);
+    return backend && existsResolved(backend, strippedPath);
+}
+
+bool LoFS::mkdir(const Path &path)
+{
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *backend = path.route(buf, sizeof(buf), &strippedPath);
+    return backend && mkdirResolved(backend, strippedPath);
+}
+
+bool LoFS::remove(const Path &path)
+{
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *backend = path.route(buf, sizeof(buf), &strippedPath);
+    return backend && removeResolved(backend, strippedPath);
+}
+
+bool LoFS::rmdir(const Path &path, bool recursive)
+{
+    char buf[LOFS_PATH_MAX];
+    const char *strippedPath = nullptr;
+    Backend *backend = path.route(buf, sizeof(buf), &strippedPath);
+    if (!backend) {
+        return false;
+    }
+    if (strippedPath != buf) {
+        // removeTree() extends the path in place with child names
+        memcpy(buf, strippedPath, strlen(strippedPath) + 1);
+    }
+    return rmdirResolved(backend, buf, recursive);
+}
+
+bool LoFS::rename(const Path &oldpath, const Path &newpath)
+{
+    return rename(oldpath.c_str(), newpath.c_str());
+}
+
+uint64_t LoFS::totalBytes(const Path &path)
+{
+    return spaceInfo(path.c_str()).totalBytes;
+}
+
+uint64_t LoFS::usedBytes(const Path &path)
+{
+    return spaceInfo(path.c_str()).usedBytes;
+}
+
+uint64_t LoFS::freeBytes(const Path &path)
+{
+    return spaceInfo(path.c_str()).freeBytes;
+}
+
+LoFS::SpaceInfo LoFS::spaceInfo(const Path &path)
+{
+    return spaceInfo(path.c_str());
+}
+
+LoFS::FSType LoFS::fsTypeOf(const Path &path)
+{
+    return fsTypeOf(path.c_str());
+}
+
+bool LoFS::migrate(const Path &path, FSType tier)
+{
+    return migrate(path.c_str(), tier);
+}
+
+bool LoFS::copy(const Path &srcpath, const Path &dstpath, const CopyOptions &options, CopyStats *stats)
+{
+    return copy(srcpath.c_str(), dstpath.c_str(), options, stats);
+}
+
+bool LoFS::move(const Path &srcpath, const Path &dstpath, const CopyOptions &options, CopyStats *stats)
+{
+    return move(srcpath.c_str(), dstpath.c_str(), options, stats);
+}
+
+bool LoFS::checksum(const Path &path, uint32_t *crc)
+{
+    return checksum(path.c_str(), crc);
+}
+
+bool LoFS::sync(const Path &srcDir, const Path &dstDir, const SyncOptions &options, SyncStats *stats)
+{
+    return sync(srcDir.c_str(), dstDir.c_str(), options, stats);
+}
+
+LoFS::CachedFile LoFS::openCached(const Path &path)
+{
+    return openCached(path.c_str());
+}
+
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+File LoFS::openCachedFile(const Path &path)
+{
+    return openCachedFile(path.c_str());
+}
+#endif
+
+bool LoFS::writeAtomic(const Path &path, const void *data, size_t len, bool *changed)
+{
+    return writeAtomic(path.c_str(), data, len, changed);
+}
+
+int LoFS::recoverAtomic(const Path &dirpath)
+{
+    return recoverAtomic(dirpath.c_str());
+}
+
+LoFS::BufferedFile LoFS::open(const Path &path, const char *mode, const Buffered &options)
+{
+    return open(path.c_str(), mode, options);
+}
+
+LoFS::ReservedFile LoFS::reserve(const Path &path, uint32_t bytes)
+{
+    return reserve(path.c_str(), bytes);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <lofs/Backend.h>
+
+#define LOFS_FNV_OFFSET 2166136261u
+#define LOFS_FNV_PRIME 16777619u
+
+/**
+ * @brief FNV-1a over a backend pointer, the seed for per-file hashes
+ *
+ * Continuing the hash over a stripped path gives the same value as hashing
+ * that path on its own, so every prefix's hash falls out of a single pass.
+ */
+static inline uint32_t lofsBackendHash(LoFS::Backend *backend)
+{
+    uint32_t hash = LOFS_FNV_OFFSET;
+    uintptr_t b = (uintptr_t)backend;
+    for (size_t i = 0; i < sizeof(b); i++) {
+        hash ^= (uint8_t)(b >> (i * 8));
+        hash *= LOFS_FNV_PRIME;
+    }
+    return hash;
+}
+
+static inline uint32_t lofsHashStep(uint32_t hash, char c)
+{
+    return (hash ^ (uint8_t)c) * LOFS_FNV_PRIME;
+}
+
+/**
+ * @brief Identify a file by backend + stripped path (never 0)
+ */
+static inline uint32_t lofsPathHash(LoFS::Backend *backend, const char *strippedPath)
+{
+    uint32_t hash = lofsBackendHash(backend);
+    for (const char *p = strippedPath; *p; p++) {
+        hash = lofsHashStep(hash, *p);
+    }
+    return hash ? hash : 1;
+}
@@ -0,0 +1,512 @@
+#include <lofs/RamBackend.h>
+#include "configuration.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if LOFS_RAMDISK
+#include <FSImpl.h>
+
+// Smallest allocation for file data; later growth doubles
+#define LOFS_RAM_MIN_ALLOC 64
+
+// Bytes charged to the budget for an entry besides its data
+#define LOFS_RAM_ENTRY_COST(nameLen) (sizeof(Node) + (nameLen) + 1)
+
+struct LoFS::RamBackend::Node {
+    Node *parent;
+    Node *children; ///< First entry of a directory
+    Node *next;     ///< Next entry in the parent directory
+    char *name;
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    time_t modified;
+    uint16_t handles; ///< Open handles; an unlinked node is freed when the last one closes
+    bool isDir;
+    bool unlinked;
+};
+
+/**
+ * @brief File or directory handle returned through File
+ *
+ * Runs under the caller's lock like any other File I/O (the RAM disk's own
+ * lock domain), so it touches the tree without further locking.
+ */
+class LoFS::RamBackend::Handle : public fs::FileImpl
+{
+  public:
+    Handle(RamBackend *disk, Node *node, const char *path, const char *mode)
+        : disk(disk), node(node), pos(0), cursor(nullptr), nextDir(nullptr), isOpen(true)
+    {
+        fullPath = (char *)malloc(strlen(path) + 1);
+        if (fullPath) {
+            strcpy(fullPath, path);
+        }
+        canRead = (mode[0] == 'r' || strchr(mode, '+'));
+        canWrite = (mode[0] != 'r' || strchr(mode, '+'));
+        append = (mode[0] == 'a');
+        node->handles++;
+        if (node->isDir) {
+            cursor = node->children;
+            nextDir = disk->openDirs;
+            disk->openDirs = this;
+        }
+    }
+
+    ~Handle() override
+    {
+        close();
+        free(fullPath);
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!isOpen || !canWrite || node->isDir) {
+            return 0;
+        }
+        if (append) {
+            pos = node->size;
+        }
+        size_t end = pos + size;
+        if (end > node->capacity) {
+            // Double to keep appends cheap, but never past the budget
+            size_t wanted = node->capacity ? node->capacity * 2 : LOFS_RAM_MIN_ALLOC;
+            if (wanted < end) {
+                wanted = end;
+            }
+            size_t room = node->capacity + (disk->budget - disk->used);
+            if (wanted > room) {
+                wanted = room;
+            }
+            if (wanted <= pos) {
+                return 0; // Disk full
+            }
+            uint8_t *grown = (uint8_t *)realloc(node->data, wanted);
+            if (!grown) {
+                return 0;
+            }
+            disk->charge(wanted - node->capacity);
+            node->data = grown;
+            node->capacity = wanted;
+            if (end > wanted) {
+                size = wanted - pos; // Short write: budget exhausted
+                end = wanted;
+            }
+        }
+        if (pos > node->size) {
+            memset(node->data + node->size, 0, pos - node->size); // Seeked past the end
+        }
+        memcpy(node->data + pos, buf, size);
+        pos = end;
+        if (pos > node->size) {
+            node->size = pos;
+        }
+        node->modified = time(nullptr);
+        return size;
+    }
+
+    size_t read(uint8_t *buf, size_t size) override
+    {
+        if (!isOpen || !canRead || node->isDir || pos >= node->size) {
+            return 0;
+        }
+        if (size > node->size - pos) {
+            size = node->size - pos;
+        }
+        memcpy(buf, node->data + pos, size);
+        pos += size;
+        return size;
+    }
+
+    void flush() override {}
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override
+    {
+        if (!isOpen || node->isDir) {
+            return false;
+        }
+        size_t base = (mode == fs::SeekCur) ? pos : (mode == fs::SeekEnd) ? node->size : 0;
+        size_t target = base + offset;
+        if (target > node->size && !canWrite) {
+            return false;
+        }
+        pos = target;
+        return true;
+    }
+
+    size_t position() const override { return pos; }
+    size_t size() const override { return node->isDir ? 0 : node->size; }
+
+    void close() override
+    {
+        if (!isOpen) {
+            return;
+        }
+        isOpen = false;
+        if (node->isDir) {
+            for (Handle **link = &disk->openDirs; *link; link = &(*link)->nextDir) {
+                if (*link == this) {
+                    *link = nextDir;
+                    break;
+                }
+            }
+        }
+        if (--node->handles == 0 && node->unlinked) {
+            disk->destroy(node);
+        }
+    }
+
+    time_t getLastWrite() override { return node->modified; }
+    const char *path() const override { return fullPath ? fullPath : ""; }
+
+    const char *name() const override
+    {
+        const char *p = path();
+        const char *slash = strrchr(p, '/');
+        return slash ? slash + 1 : p;
+    }
+
+    boolean isDirectory(void) override { return isOpen && node->isDir; }
+
+    fs::FileImplPtr openNextFile(const char *mode) override
+    {
+        if (!isOpen || !node->isDir || !cursor) {
+            return fs::FileImplPtr();
+        }
+        Node *child = cursor;
+        cursor = cursor->next;
+        char childPath[LOFS_PATH_MAX];
+        size_t len = strlen(path());
+        bool slash = (len > 0 && path()[len - 1] != '/');
+        if (len + slash + strlen(child->name) + 1 > sizeof(childPath)) {
+            return fs::FileImplPtr();
+        }
+        strcpy(childPath, path());
+        if (slash) {
+            childPath[len++] = '/';
+        }
+        strcpy(childPath + len, child->name);
+        return std::make_shared<Handle>(disk, child, childPath, "r");
+    }
+
+    void rewindDirectory(void) override { cursor = isOpen && node->isDir ? node->children : nullptr; }
+
+    operator bool() override { return isOpen; }
+
+#ifdef ARCH_ESP32
+    // Directory name iteration of newer arduino-esp32 cores
+    boolean seekDir(long position)
+    {
+        rewindDirectory();
+        while (position-- > 0 && cursor) {
+            cursor = cursor->next;
+        }
+        return cursor != nullptr;
+    }
+
+    String getNextFileName(void)
+    {
+        bool isDir;
+        return getNextFileName(&isDir);
+    }
+
+    String getNextFileName(bool *isDir)
+    {
+        if (!isOpen || !node->isDir || !cursor) {
+            return String();
+        }
+        Node *child = cursor;
+        cursor = cursor->next;
+        *isDir = child->isDir;
+        String name = path();
+        if (!name.endsWith("/")) {
+            name += "/";
+        }
+        return name + child->name;
+    }
+#endif
+
+  private:
+    friend class RamBackend;
+
+    RamBackend *disk;
+    Node *node;
+    char *fullPath;
+    size_t pos;
+    Node *cursor;    ///< Next directory entry to return
+    Handle *nextDir; ///< Next open directory handle of the disk
+    bool canRead;
+    bool canWrite;
+    bool append;
+    bool isOpen;
+};
+
+LoFS::RamBackend::RamBackend(size_t budget)
+    : domain(LockDomain::Kind::OWN), root(nullptr), openDirs(nullptr), budget(budget), used(0)
+{
+}
+
+LoFS::RamBackend::~RamBackend()
+{
+    // Free the tree bottom-up without recursion
+    while (root) {
+        Node *node = root;
+        while (node->children) {
+            node = node->children;
+        }
+        if (node == root) {
+            free(root->name);
+            free(root);
+            root = nullptr;
+            break;
+        }
+        node->handles = 0;
+        unlink(node);
+    }
+}
+
+bool LoFS::RamBackend::charge(size_t bytes)
+{
+    if (bytes > budget - used) {
+        return false;
+    }
+    used += bytes;
+    return true;
+}
+
+void LoFS::RamBackend::release(size_t bytes)
+{
+    used = (bytes > used) ? 0 : used - bytes;
+}
+
+// Walk the first len characters of a path; nullptr if a component is missing
+LoFS::RamBackend::Node *LoFS::RamBackend::lookup(const char *path, size_t len)
+{
+    if (!root) {
+        root = (Node *)calloc(1, sizeof(Node));
+        if (!root) {
+            return nullptr;
+        }
+        root->isDir = true;
+        root->name = (char *)calloc(1, 1);
+    }
+
+    Node *node = root;
+    const char *end = path + len;
+    while (node && path < end) {
+        while (path < end && *path == '/') {
+            path++;
+        }
+        if (path == end) {
+            break;
+        }
+        size_t segment = 0;
+        while (path + segment < end && path[segment] != '/') {
+            segment++;
+        }
+        if (!node->isDir) {
+            return nullptr;
+        }
+        Node *child = node->children;
+        while (child && !(strncmp(child->name, path, segment) == 0 && child->name[segment] == '\0')) {
+            child = child->next;
+        }
+        node = child;
+        path += segment;
+    }
+    return node;
+}
+
+// Directory that would hold a path, and the path's last component
+LoFS::RamBackend::Node *LoFS::RamBackend::lookupParent(const char *path, const char **leaf, size_t *leafLen)
+{
+    size_t end = strlen(path);
+    while (end > 0 && path[end - 1] == '/') {
+        end--;
+    }
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    *leaf = path + start;
+    *leafLen = end - start;
+    if (*leafLen == 0) {
+        return nullptr; // The root itself
+    }
+    Node *parent = lookup(path, start);
+    return (parent && parent->isDir) ? parent : nullptr;
+}
+
+LoFS::RamBackend::Node *LoFS::RamBackend::create(const char *path, bool isDir)
+{
+    const char *leaf;
+    size_t leafLen;
+    Node *parent = lookupParent(path, &leaf, &leafLen);
+    if (!parent || lookup(path, strlen(path)) || !charge(LOFS_RAM_ENTRY_COST(leafLen))) {
+        return nullptr;
+    }
+    Node *node = (Node *)calloc(1, sizeof(Node));
+    char *name = (char *)malloc(leafLen + 1);
+    if (!node || !name) {
+        free(node);
+        free(name);
+        release(LOFS_RAM_ENTRY_COST(leafLen));
+        return nullptr;
+    }
+    memcpy(name, leaf, leafLen);
+    name[leafLen] = '\0';
+    node->name = name;
+    node->isDir = isDir;
+    node->modified = time(nullptr);
+    node->parent = parent;
+    node->next = parent->children;
+    parent->children = node;
+    return node;
+}
+
+// Take a node out of its directory, moving open listings past it
+void LoFS::RamBackend::detach(Node *node)
+{
+    for (Handle *dir = openDirs; dir; dir = dir->nextDir) {
+        if (dir->cursor == node) {
+            dir->cursor = node->next;
+        }
+    }
+    for (Node **link = &node->parent->children; *link; link = &(*link)->next) {
+        if (*link == node) {
+            *link = node->next;
+            break;
+        }
+    }
+    node->parent = nullptr;
+    node->next = nullptr;
+}
+
+void LoFS::RamBackend::unlink(Node *node)
+{
+    detach(node);
+    node->unlinked = true;
+    if (node->handles == 0) {
+        destroy(node);
+    }
+}
+
+void LoFS::RamBackend::destroy(Node *node)
+{
+    release(LOFS_RAM_ENTRY_COST(strlen(node->name)) + node->capacity);
+    free(node->data);
+    free(node->name);
+    free(node);
+}
+
+File LoFS::RamBackend::open(const char *path, const char *mode)
+{
+    bool write = (mode[0] != 'r' || strchr(mode, '+'));
+    Node *node = lookup(path, strlen(path));
+    if (!node) {
+        if (!write) {
+            return File();
+        }
+        node = create(path, false);
+        if (!node) {
+            return File();
+        }
+    } else if (node->isDir) {
+        if (write) {
+            return File();
+        }
+    } else if (mode[0] == 'w') {
+        release(node->capacity);
+        free(node->data);
+        node->data = nullptr;
+        node->size = 0;
+        node->capacity = 0;
+        node->modified = time(nullptr);
+    }
+    return File(std::make_shared<Handle>(this, node, path, mode));
+}
+
+bool LoFS::RamBackend::exists(const char *path)
+{
+    return lookup(path, strlen(path)) != nullptr;
+}
+
+bool LoFS::RamBackend::mkdir(const char *path)
+{
+    return create(path, true) != nullptr;
+}
+
+bool LoFS::RamBackend::remove(const char *path)
+{
+    Node *node = lookup(path, strlen(path));
+    if (!node || node->isDir) {
+        return false;
+    }
+    unlink(node);
+    return true;
+}
+
+bool LoFS::RamBackend::rename(const char *oldpath, const char *newpath)
+{
+    Node *node = lookup(oldpath, strlen(oldpath));
+    const char *leaf;
+    size_t leafLen;
+    Node *parent = lookupParent(newpath, &leaf, &leafLen);
+    if (!node || node == root || !parent) {
+        return false;
+    }
+    // A directory cannot move below itself
+    for (Node *p = parent; p; p = p->parent) {
+        if (p == node) {
+            return false;
+        }
+    }
+
+    Node *target = lookup(newpath, strlen(newpath));
+    if (target == node) {
+        return true;
+    }
+    if (target && (target->isDir || node->isDir)) {
+        return false; // Only a file may replace a file
+    }
+
+    size_t oldLen = strlen(node->name);
+    if (leafLen > oldLen && !charge(leafLen - oldLen)) {
+        return false;
+    }
+    char *name = (char *)malloc(leafLen + 1);
+    if (!name) {
+        if (leafLen > oldLen) {
+            release(leafLen - oldLen);
+        }
+        return false;
+    }
+    if (leafLen < oldLen) {
+        release(oldLen - leafLen);
+    }
+    memcpy(name, leaf, leafLen);
+    name[leafLen] = '\0';
+
+    if (target) {
+        unlink(target);
+    }
+    detach(node);
+    free(node->name);
+    node->name = name;
+    node->parent = parent;
+    node->next = parent->children;
+    parent->children = node;
+    return true;
+}
+
+bool LoFS::RamBackend::rmdir(const char *path)
+{
+    Node *node = lookup(path, strlen(path));
+    if (!node || !node->isDir || node == root || node->children) {
+        return false;
+    }
+    unlink(node);
+    return true;
+}
+#endif
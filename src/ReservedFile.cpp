@@ -0,0 +1,329 @@
+#include <lofs/ReservedFile.h>
+#include <lofs/AtomicWriter.h>
+#include <lofs/Backend.h>
+#include <lofs/LockDomain.h>
+#include "LittleEndian.h"
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+// Byte the reservation is filled with; the end of data is the last other byte
+#ifndef LOFS_RESERVE_PAD
+#define LOFS_RESERVE_PAD 0x00
+#endif
+
+// Writing into the middle of a file needs "r+" opens
+#if defined(ARCH_ESP32) || defined(ARCH_RP2040) || defined(ARCH_PORTDUINO)
+#define LOFS_RESERVE_INPLACE 1
+#else
+#define LOFS_RESERVE_INPLACE 0
+#endif
+
+#define LOFS_RESERVE_CHUNK 512
+
+static bool markerPath(char *buf, size_t size, const char *path)
+{
+    return snprintf(buf, size, "%s" LOFS_RESERVE_SUFFIX, path) < (int)size;
+}
+
+#if LOFS_RESERVE_INPLACE
+// Data length when the file was reserved (0 if unreadable); false if there is no marker
+static bool readMarker(const char *marker, LoFS::LockDomain &domain, uint32_t *base)
+{
+    File f = LoFS::open(marker, "r");
+    if (!f) {
+        return false;
+    }
+    uint8_t b[4] = {0, 0, 0, 0};
+    LoFS::LockDomain::SharedGuard g(domain);
+    size_t n = f.read(b, sizeof(b));
+    f.close();
+    *base = (n == sizeof(b)) ? lofsGetLE32(b) : 0;
+    return true;
+}
+
+// End of data after an unclean shutdown: the last byte that is not padding, but not before base
+static size_t recoverEnd(const char *path, LoFS::LockDomain &domain, size_t base, size_t *size)
+{
+    File f = LoFS::open(path, "r");
+    if (!f) {
+        *size = 0;
+        return 0;
+    }
+    LoFS::LockDomain::SharedGuard g(domain);
+    *size = f.size();
+    size_t pos = *size;
+    uint8_t chunk[LOFS_RESERVE_CHUNK];
+    while (pos > base) {
+        size_t n = (pos - base < sizeof(chunk)) ? pos - base : sizeof(chunk);
+        if (!f.seek((uint32_t)(pos - n)) || f.read(chunk, n) != n) {
+            break; // Keep what we have rather than lose data
+        }
+        while (n > 0 && chunk[n - 1] == LOFS_RESERVE_PAD) {
+            n--;
+            pos--;
+        }
+        if (n > 0) {
+            break;
+        }
+    }
+    f.close();
+    return pos;
+}
+#endif
+
+LoFS::ReservedFile LoFS::reserve(const char *filepath, uint32_t bytes)
+{
+    ReservedFile result;
+    char marker[LOFS_PATH_MAX];
+    if (!filepath || strlen(filepath) >= sizeof(result.path) || !markerPath(marker, sizeof(marker), filepath)) {
+        return result;
+    }
+    strcpy(result.path, filepath);
+    result.domain = &lockDomain(filepath);
+    result.step = bytes;
+
+#if LOFS_RESERVE_INPLACE
+    // LittleFS copies the rest of a file on an in-place write, so only reserve elsewhere
+    if (bytes > 0 && fsTypeOf(filepath) != FSType::INTERNAL) {
+        uint32_t base = 0;
+        size_t size = 0;
+        if (readMarker(marker, *result.domain, &base)) {
+            // Not closed: a trim may have stopped just before its final rename
+            char newPath[LOFS_PATH_MAX];
+            if (!exists(filepath) && snprintf(newPath, sizeof(newPath), "%s" LOFS_ATOMIC_NEW_SUFFIX, filepath) <
+                                         (int)sizeof(newPath)) {
+                rename(newPath, filepath);
+            }
+            result.end = recoverEnd(filepath, *result.domain, base, &size);
+        } else if (exists(filepath)) {
+            File f = open(filepath, "r");
+            LockDomain::SharedGuard g(*result.domain);
+            size = result.end = f ? f.size() : 0;
+            f.close();
+        }
+
+        // Marker first, so a power loss while padding is recovered as well
+        bool marked = false;
+        File m = open(marker, "w");
+        if (m) {
+            uint8_t b[4];
+            lofsPutLE32(b, (uint32_t)result.end);
+            LockDomain::Guard g(*result.domain);
+            marked = (m.write(b, sizeof(b)) == sizeof(b));
+            m.close();
+        }
+
+        if (marked && !exists(filepath)) {
+            File f = open(filepath, "w");
+            LockDomain::Guard g(*result.domain);
+            f.close();
+        }
+        result.file = marked ? open(filepath, "r+") : File();
+        if (result.file) {
+            result.inPlace = true;
+            result.extent = size;
+            // A full card leaves a smaller reservation; writes then extend the file as usual
+            result.extend(result.end + bytes);
+            LockDomain::Guard g(*result.domain);
+            result.file.seek((uint32_t)result.end);
+            return result;
+        }
+        remove(marker);
+    }
+#endif
+
+    result.file = open(filepath, "a");
+    if (result.file) {
+        LockDomain::SharedGuard g(*result.domain);
+        result.end = result.extent = result.file.size();
+    }
+    return result;
+}
+
+LoFS::ReservedFile::ReservedFile() : domain(nullptr), end(0), extent(0), step(0), inPlace(false)
+{
+    path[0] = '\0';
+}
+
+LoFS::ReservedFile::ReservedFile(ReservedFile &&other) : ReservedFile()
+{
+    *this = static_cast<ReservedFile &&>(other);
+}
+
+LoFS::ReservedFile &LoFS::ReservedFile::operator=(ReservedFile &&other)
+{
+    if (this != &other) {
+        close();
+        domain = other.domain;
+        file = other.file;
+        strcpy(path, other.path);
+        end = other.end;
+        extent = other.extent;
+        step = other.step;
+        inPlace = other.inPlace;
+        other.file = File();
+        other.inPlace = false;
+    }
+    return *this;
+}
+
+// Pad the file out to at least minimum bytes; the file position is left at the old extent
+bool LoFS::ReservedFile::extend(size_t minimum)
+{
+    if (minimum <= extent) {
+        return true;
+    }
+    uint8_t pad[LOFS_RESERVE_CHUNK];
+    memset(pad, LOFS_RESERVE_PAD, sizeof(pad));
+    size_t before = extent;
+    {
+        LockDomain::Guard g(*domain);
+        if (!file.seek((uint32_t)extent)) {
+            return false;
+        }
+        while (extent < minimum) {
+            size_t n = (minimum - extent < sizeof(pad)) ? minimum - extent : sizeof(pad);
+            size_t written = file.write(pad, n);
+            extent += written;
+            if (written != n) {
+                break;
+            }
+        }
+        file.flush();
+    }
+    spaceAdjust(path, (int64_t)(extent - before));
+    return extent >= minimum;
+}
+
+size_t LoFS::ReservedFile::write(const uint8_t *buf, size_t size)
+{
+    if (!file || size == 0) {
+        return 0;
+    }
+    if (inPlace && end + size > extent) {
+        // Out of reserved space: grow by another step, then carry on where the data ends
+        size_t want = end + size;
+        extend(want > extent + step ? want : extent + step);
+        LockDomain::Guard g(*domain);
+        file.seek((uint32_t)end);
+    }
+    size_t written;
+    {
+        LockDomain::Guard g(*domain);
+        written = file.write(buf, size);
+    }
+    end += written;
+    if (end > extent) {
+        extent = end;
+    }
+    return written;
+}
+
+bool LoFS::ReservedFile::sync()
+{
+    if (!file) {
+        return false;
+    }
+    LockDomain::Guard g(*domain);
+    file.flush();
+    return true;
+}
+
+// Drop the padding: truncate where the backend can, else copy the data to a
+// temp sibling and rename it over the file
+bool LoFS::ReservedFile::trim()
+{
+    // Truncating rewrites no data, so closing a long-lived log costs no more than a short one
+    char stripped[LOFS_PATH_MAX];
+    Backend *backend = resolve(path, stripped, sizeof(stripped));
+    if (backend) {
+        invalidateCache(backend, stripped);
+        bool truncated;
+        {
+            LockDomain::Guard g(*domain);
+            truncated = backend->truncate(stripped, (uint32_t)end);
+        }
+        if (truncated) {
+            spaceAdjust(path, -(int64_t)(extent - end));
+            extent = end;
+            return true;
+        }
+    }
+
+    char tmpPath[LOFS_PATH_MAX];
+    char newPath[LOFS_PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s" LOFS_ATOMIC_TMP_SUFFIX, path) >= (int)sizeof(tmpPath) ||
+        snprintf(newPath, sizeof(newPath), "%s" LOFS_ATOMIC_NEW_SUFFIX, path) >= (int)sizeof(newPath)) {
+        return false;
+    }
+
+    LoFS::remove(tmpPath);
+    File src = LoFS::open(path, "r");
+    File dst = LoFS::open(tmpPath, "w");
+    bool ok = src && dst;
+    uint8_t chunk[LOFS_RESERVE_CHUNK];
+    for (size_t copied = 0; ok && copied < end;) {
+        // One chunk per lock hold so other users of the card can run in between
+        size_t n = (end - copied < sizeof(chunk)) ? end - copied : sizeof(chunk);
+        LockDomain::Guard g(*domain);
+        ok = src.read(chunk, n) == n && dst.write(chunk, n) == n;
+        copied += n;
+    }
+    {
+        LockDomain::Guard g(*domain);
+        if (dst) {
+            dst.flush();
+            dst.close();
+        }
+        if (src) {
+            src.close();
+        }
+    }
+    if (!ok) {
+        LoFS::remove(tmpPath);
+        return false;
+    }
+
+    // Same dance as AtomicWriter: FAT refuses to rename over an existing file
+    if (!LoFS::rename(tmpPath, path)) {
+        if (!LoFS::rename(tmpPath, newPath)) {
+            LoFS::remove(tmpPath);
+            return false;
+        }
+        LoFS::remove(path);
+        if (!LoFS::rename(newPath, path)) {
+            return false;
+        }
+    }
+    spaceAdjust(path, -(int64_t)(extent - end));
+    extent = end;
+    return true;
+}
+
+bool LoFS::ReservedFile::close(bool release)
+{
+    if (!file) {
+        return true;
+    }
+    {
+        LockDomain::Guard g(*domain);
+        file.flush();
+        file.close();
+    }
+    file = File();
+    if (!inPlace) {
+        return true;
+    }
+    inPlace = false;
+
+    if (!release) {
+        return true; // Marker stays: the next reserve() finds the end of data again
+    }
+    bool result = (extent == end) || trim();
+    char marker[LOFS_PATH_MAX];
+    if (result && markerPath(marker, sizeof(marker), path)) {
+        LoFS::remove(marker);
+    }
+    return result;
+}
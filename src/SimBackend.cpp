@@ -0,0 +1,228 @@
+#include <lofs/SimBackend.h>
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+// Open files are wrapped through the ESP32-style fs::FileImpl to delay writes
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO)
+#include <FSImpl.h>
+#define LOFS_SIM_FILES 1
+#else
+#define LOFS_SIM_FILES 0
+#endif
+
+LoFS::SimBackend::Profile LoFS::SimBackend::Profile::littleFS()
+{
+    Profile p;
+    p.openUs = 300;
+    p.existsUs = 200;
+    p.mkdirUs = 3000;
+    p.removeUs = 3000;
+    p.renameUs = 3000;
+    p.rmdirUs = 3000;
+    p.totalBytesUs = 10;
+    p.usedBytesUs = 20000; // lfs_fs_size() traverses every allocated block
+    p.writeUsPerKB = 1600; // 256 B page programs
+    p.syncUs = 3000;       // Metadata pair commit
+    return p;
+}
+
+LoFS::SimBackend::Profile LoFS::SimBackend::Profile::fatSPI()
+{
+    Profile p;
+    p.openUs = 2000;
+    p.existsUs = 1500;
+    p.mkdirUs = 8000;
+    p.removeUs = 5000;
+    p.renameUs = 6000;
+    p.rmdirUs = 6000;
+    p.totalBytesUs = 500;
+    p.usedBytesUs = 5000;
+    p.usedBytesUsPerMB = 50; // ~1.6 s on a 32 GB card
+    p.writeUsPerKB = 500;    // ~2 MB/s over SPI
+    p.syncUs = 1500;         // Directory entry read-modify-write
+    p.growUs = 4000;         // FAT sectors (both copies) and FSINFO
+    return p;
+}
+
+LoFS::SimBackend::SimBackend(const char *target, const Profile &profile) : profile(profile), simulated(0)
+{
+    setTarget(this->target, target);
+}
+
+// Translate a path of this mount to the target backend's stripped path
+LoFS::Backend *LoFS::SimBackend::map(const char *path, char *buf, size_t size)
+{
+    return mapTarget(target, path, buf, size);
+}
+
+bool LoFS::SimBackend::isAvailable()
+{
+    return targetAvailable(target);
+}
+
+void LoFS::SimBackend::wait(uint32_t us)
+{
+    simulated += us;
+    if (us >= 1000) {
+        delay(us / 1000);
+    }
+    if (us % 1000) {
+        delayMicroseconds(us % 1000);
+    }
+}
+
+LoFS::LockDomain &LoFS::SimBackend::lockDomain()
+{
+    return targetLockDomain(target);
+}
+
+#if LOFS_SIM_FILES
+/**
+ * @brief Open file of the target, with writes charged to the profile
+ *
+ * Runs under the target's lock like any other File I/O, so the delays are
+ * spent holding it.
+ */
+class LoFS::SimBackend::Handle : public fs::FileImpl
+{
+  public:
+    Handle(SimBackend *sim, const File &inner) : sim(sim), inner(inner), dirty(false), grown(false) {}
+    ~Handle() override { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        size_t before = inner.size();
+        size_t n = inner.write(buf, size);
+        if (n > 0) {
+            dirty = true;
+            grown = grown || inner.size() > before;
+            sim->wait((uint32_t)(((uint64_t)n * sim->profile.writeUsPerKB + 1023) / 1024));
+        }
+        return n;
+    }
+
+    size_t read(uint8_t *buf, size_t size) override { return inner.read(buf, size); }
+
+    void flush() override
+    {
+        inner.flush();
+        commit();
+    }
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override { return inner.seek(offset, mode); }
+    size_t position() const override { return inner.position(); }
+    size_t size() const override { return inner.size(); }
+
+    void close() override
+    {
+        if (inner) {
+            commit();
+            inner.close();
+        }
+    }
+
+    time_t getLastWrite() override { return inner.getLastWrite(); }
+    const char *path() const override { return inner.path(); }
+    const char *name() const override { return inner.name(); }
+    boolean isDirectory(void) override { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) override { return fs::FileImplPtr(); }
+    void rewindDirectory(void) override {}
+    operator bool() override { return (bool)inner; }
+
+  private:
+    // Charge the metadata update the writes since the last flush will cost
+    void commit()
+    {
+        if (dirty) {
+            sim->wait(sim->profile.syncUs + (grown ? sim->profile.growUs : 0));
+        }
+        dirty = false;
+        grown = false;
+    }
+
+    SimBackend *sim;
+    File inner;
+    bool dirty; ///< Written since the last flush
+    bool grown; ///< Those writes made the file larger
+};
+#endif
+
+File LoFS::SimBackend::open(const char *path, const char *mode)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    wait(profile.openUs);
+    if (!inner) {
+        return File();
+    }
+    File file = inner->open(buf, mode);
+#if LOFS_SIM_FILES
+    if (file && !file.isDirectory() && (profile.writeUsPerKB || profile.syncUs || profile.growUs)) {
+        return File(std::make_shared<Handle>(this, file));
+    }
+#endif
+    return file;
+}
+
+bool LoFS::SimBackend::exists(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    wait(profile.existsUs);
+    return inner && inner->exists(buf);
+}
+
+bool LoFS::SimBackend::mkdir(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    wait(profile.mkdirUs);
+    return inner && inner->mkdir(buf);
+}
+
+bool LoFS::SimBackend::remove(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    wait(profile.removeUs);
+    return inner && inner->remove(buf);
+}
+
+bool LoFS::SimBackend::rename(const char *oldpath, const char *newpath)
+{
+    char oldBuf[LOFS_PATH_MAX];
+    char newBuf[LOFS_PATH_MAX];
+    Backend *inner = map(oldpath, oldBuf, sizeof(oldBuf));
+    Backend *newInner = map(newpath, newBuf, sizeof(newBuf));
+    wait(profile.renameUs);
+    return inner && inner == newInner && inner->rename(oldBuf, newBuf);
+}
+
+bool LoFS::SimBackend::rmdir(const char *path)
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map(path, buf, sizeof(buf));
+    wait(profile.rmdirUs);
+    return inner && inner->rmdir(buf);
+}
+
+uint64_t LoFS::SimBackend::totalBytes()
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map("/", buf, sizeof(buf));
+    wait(profile.totalBytesUs);
+    return inner ? inner->totalBytes() : 0;
+}
+
+uint64_t LoFS::SimBackend::usedBytes()
+{
+    char buf[LOFS_PATH_MAX];
+    Backend *inner = map("/", buf, sizeof(buf));
+    if (!inner) {
+        return 0;
+    }
+    uint64_t total = inner->totalBytes();
+    wait(profile.usedBytesUs + (uint32_t)(profile.usedBytesUsPerMB * (total >> 20)));
+    return inner->usedBytes();
+}
@@ -0,0 +1,243 @@
+#include <lofs/Backend.h>
+#include <lofs/Lock.h>
+#include "StatTimer.h"
+#include "configuration.h"
+#include <string.h>
+
+// Backends whose figures are kept; set to 0 to always ask the backend
+#ifndef LOFS_SPACE_CACHE_ENTRIES
+#define LOFS_SPACE_CACHE_ENTRIES 4
+#endif
+
+// Age after which cached figures are re-measured in the background
+#ifndef LOFS_SPACE_RESYNC_MS
+#define LOFS_SPACE_RESYNC_MS 60000
+#endif
+
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+struct SpaceEntry {
+    LoFS::Backend *backend; ///< nullptr when the slot is free
+    uint64_t total;
+    uint64_t used;          ///< Last measurement plus LoFS's own writes and removes since
+    uint32_t syncedMs;      ///< millis() of the last measurement
+    bool resyncPending;     ///< Re-measure on the next background pass
+};
+
+static SpaceEntry spaceEntries[LOFS_SPACE_CACHE_ENTRIES];
+static LoFS::Lock *const spaceLock = new LoFS::Lock();
+
+static SpaceEntry *findSpace(LoFS::Backend *backend)
+{
+    for (size_t i = 0; i < LOFS_SPACE_CACHE_ENTRIES; i++) {
+        if (spaceEntries[i].backend == backend) {
+            return &spaceEntries[i];
+        }
+    }
+    return nullptr;
+}
+#endif
+
+// Measure under the backend's lock; on FAT usedBytes() walks the whole allocation table
+static void measureSpace(LoFS::Backend *backend, uint64_t *total, uint64_t *used)
+{
+    LoFS::LockDomain::SharedGuard g(backend->lockDomain());
+    *total = backend->totalBytes();
+    *used = (*total > 0) ? backend->usedBytes() : 0;
+}
+
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+static void storeSpace(LoFS::Backend *backend, uint64_t total, uint64_t used)
+{
+    LoFS::Lock::Guard g(spaceLock);
+    SpaceEntry *entry = findSpace(backend);
+    if (!entry) {
+        // Reuse a free slot, else the one measured longest ago
+        entry = &spaceEntries[0];
+        for (size_t i = 0; i < LOFS_SPACE_CACHE_ENTRIES; i++) {
+            SpaceEntry &candidate = spaceEntries[i];
+            if (!candidate.backend) {
+                entry = &candidate;
+                break;
+            }
+            if ((int32_t)(candidate.syncedMs - entry->syncedMs) < 0) {
+                entry = &candidate;
+            }
+        }
+    }
+    entry->backend = backend;
+    entry->total = total;
+    entry->used = (used > total) ? total : used;
+    entry->syncedMs = millis();
+    entry->resyncPending = false;
+}
+#endif
+
+LoFS::SpaceInfo LoFS::spaceInfo(const char *filepath)
+{
+    SpaceInfo info;
+    char path[LOFS_PATH_MAX];
+    Backend *backend = resolve(filepath, path, sizeof(path));
+    if (!backend) {
+        return info;
+    }
+
+    StatTimer t(backend, Stats::Op::SPACE);
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    bool stale = false;
+    bool cached = false;
+    {
+        LoFS::Lock::Guard g(spaceLock);
+        SpaceEntry *entry = findSpace(backend);
+        if (entry) {
+            cached = true;
+            info.totalBytes = entry->total;
+            info.usedBytes = entry->used;
+            if (!entry->resyncPending && millis() - entry->syncedMs >= LOFS_SPACE_RESYNC_MS) {
+                entry->resyncPending = true;
+                stale = true;
+            }
+        }
+    }
+
+    if (!cached) {
+        // First use of this backend: measure once in the foreground
+        measureSpace(backend, &info.totalBytes, &info.usedBytes);
+        if (info.totalBytes > 0) {
+            storeSpace(backend, info.totalBytes, info.usedBytes);
+        }
+    } else if (stale && !wakeAsync()) {
+        // No background worker on this target
+        resyncSpace();
+    }
+#else
+    measureSpace(backend, &info.totalBytes, &info.usedBytes);
+#endif
+
+    if (info.usedBytes > info.totalBytes) {
+        info.usedBytes = info.totalBytes;
+    }
+    info.freeBytes = info.totalBytes - info.usedBytes;
+    t.result(info.totalBytes > 0);
+    return info;
+}
+
+void LoFS::invalidateSpaceInfo()
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    LoFS::Lock::Guard g(spaceLock);
+    memset(spaceEntries, 0, sizeof(spaceEntries));
+#endif
+}
+
+void LoFS::invalidateSpaceInfo(Backend *backend)
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    LoFS::Lock::Guard g(spaceLock);
+    SpaceEntry *entry = findSpace(backend);
+    if (entry) {
+        memset(entry, 0, sizeof(*entry));
+    }
+#endif
+}
+
+bool LoFS::spaceTracked(Backend *backend)
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    LoFS::Lock::Guard g(spaceLock);
+    return findSpace(backend) != nullptr;
+#else
+    return false;
+#endif
+}
+
+void LoFS::spaceAdjust(Backend *backend, int64_t delta)
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    if (!backend || delta == 0) {
+        return;
+    }
+    LoFS::Lock::Guard g(spaceLock);
+    SpaceEntry *entry = findSpace(backend);
+    if (!entry) {
+        return;
+    }
+    if (delta < 0 && (uint64_t)-delta > entry->used) {
+        entry->used = 0;
+    } else {
+        entry->used += delta;
+        if (entry->used > entry->total) {
+            entry->used = entry->total;
+        }
+    }
+#endif
+}
+
+void LoFS::spaceAdjust(const char *filepath, int64_t delta)
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    char path[LOFS_PATH_MAX];
+    spaceAdjust(resolve(filepath, path, sizeof(path)), delta);
+#endif
+}
+
+void LoFS::spaceStale(Backend *backend)
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    {
+        LoFS::Lock::Guard g(spaceLock);
+        SpaceEntry *entry = findSpace(backend);
+        if (!entry || entry->resyncPending) {
+            return;
+        }
+        entry->resyncPending = true;
+    }
+    if (!wakeAsync()) {
+        resyncSpace();
+    }
+#endif
+}
+
+void LoFS::resyncSpace()
+{
+#if LOFS_SPACE_CACHE_ENTRIES > 0
+    while (true) {
+        Backend *backend = nullptr;
+        {
+            LoFS::Lock::Guard g(spaceLock);
+            for (size_t i = 0; i < LOFS_SPACE_CACHE_ENTRIES; i++) {
+                if (spaceEntries[i].backend && spaceEntries[i].resyncPending) {
+                    backend = spaceEntries[i].backend;
+                    break;
+                }
+            }
+        }
+        if (!backend) {
+            return;
+        }
+
+        uint64_t total;
+        uint64_t used;
+        if (backend->isAvailable()) {
+            measureSpace(backend, &total, &used);
+        } else {
+            total = 0;
+        }
+        if (total > 0) {
+            storeSpace(backend, total, used);
+        } else {
+            invalidateSpaceInfo(backend);
+        }
+    }
+#endif
+}
+
+uint64_t LoFS::fileLength(Backend *backend, const char *strippedPath)
+{
+    File file = backend->open(strippedPath, "r");
+    if (!file) {
+        return 0;
+    }
+    uint64_t size = file.isDirectory() ? 0 : file.size();
+    file.close();
+    return size;
+}
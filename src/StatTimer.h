@@ -0,0 +1,43 @@
+#pragma once
+
+#include <lofs/Stats.h>
+
+void lofsRecordOp(LoFS::Backend *backend, LoFS::Stats::Op op, bool ok, uint32_t us);
+void lofsRecordBytes(LoFS::Backend *backend, uint64_t bytesRead, uint64_t bytesWritten);
+void lofsRecordSDProbe(bool ok, uint32_t us);
+
+/**
+ * @brief Times one LoFS operation and records it when going out of scope
+ *
+ * The outcome is whatever was last passed through result(); an operation
+ * that returns without it counts as an error. Empty when LOFS_STATS is 0.
+ *
+ * Usage example:
+ *   StatTimer t(backend, LoFS::Stats::Op::MKDIR);
+ *   ...
+ *   return t.result(backend->mkdir(path));
+ */
+class StatTimer
+{
+  public:
+#if LOFS_STATS
+    StatTimer(LoFS::Backend *backend, LoFS::Stats::Op op) : backend(backend), op(op), ok(false), startUs(micros()) {}
+    ~StatTimer() { lofsRecordOp(backend, op, ok, micros() - startUs); }
+
+    template <typename T> T result(T value)
+    {
+        ok = (bool)value;
+        return value;
+    }
+
+  private:
+    LoFS::Backend *backend;
+    LoFS::Stats::Op op;
+    bool ok;
+    uint32_t startUs;
+#else
+    StatTimer(LoFS::Backend *, LoFS::Stats::Op) {}
+
+    template <typename T> T result(T value) { return value; }
+#endif
+};
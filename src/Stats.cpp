@@ -0,0 +1,108 @@
+#include <lofs/Backend.h>
+#include <lofs/Stats.h>
+#include "StatTimer.h"
+#include "configuration.h"
+#include <string.h>
+
+#if LOFS_STATS
+static LoFS::Stats counters;
+
+// Slots are claimed on a backend's first operation and never released, so
+// lookups need no lock; two tasks racing to claim may at worst split the
+// first few counts of a backend over two slots.
+static LoFS::Stats::BackendCounters *countersFor(LoFS::Backend *backend)
+{
+    if (!backend) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < LOFS_STATS_BACKENDS; i++) {
+        LoFS::Stats::BackendCounters &slot = counters.backends[i];
+        if (slot.backend == backend) {
+            return &slot;
+        }
+        if (!slot.backend) {
+            slot.backend = backend;
+            return &slot;
+        }
+    }
+    return nullptr; // More backends than LOFS_STATS_BACKENDS
+}
+
+static void recordLatency(LoFS::Stats::OpCounters &op, bool ok, uint32_t us)
+{
+    op.calls++;
+    if (!ok) {
+        op.errors++;
+    }
+    op.totalUs += us;
+    if (us > op.maxUs) {
+        op.maxUs = us;
+    }
+    // Bucket = bit length of the latency: 0 us -> 0, 1 us -> 1, 2-3 us -> 2, ...
+    size_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= LOFS_STATS_BUCKETS) {
+        bucket = LOFS_STATS_BUCKETS - 1;
+    }
+    op.histogram[bucket]++;
+}
+#endif
+
+void lofsRecordOp(LoFS::Backend *backend, LoFS::Stats::Op op, bool ok, uint32_t us)
+{
+#if LOFS_STATS
+    LoFS::Stats::BackendCounters *slot = countersFor(backend);
+    if (slot) {
+        recordLatency(slot->ops[(size_t)op], ok, us);
+    }
+#endif
+}
+
+void lofsRecordBytes(LoFS::Backend *backend, uint64_t bytesRead, uint64_t bytesWritten)
+{
+#if LOFS_STATS
+    LoFS::Stats::BackendCounters *slot = countersFor(backend);
+    if (slot) {
+        slot->bytesRead += bytesRead;
+        slot->bytesWritten += bytesWritten;
+    }
+#endif
+}
+
+void lofsRecordSDProbe(bool ok, uint32_t us)
+{
+#if LOFS_STATS
+    recordLatency(counters.sdProbe, ok, us);
+#endif
+}
+
+bool LoFS::stats(Stats *out)
+{
+#if LOFS_STATS
+    *out = counters;
+    for (size_t i = 0; i < LOFS_STATS_BACKENDS; i++) {
+        if (out->backends[i].backend) {
+            out->backends[i].lock = out->backends[i].backend->lockDomain().lockCounters();
+        }
+    }
+    out->spiLock = LockDomain::spi().lockCounters();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LoFS::resetStats()
+{
+#if LOFS_STATS
+    for (size_t i = 0; i < LOFS_STATS_BACKENDS; i++) {
+        Backend *backend = counters.backends[i].backend;
+        memset(&counters.backends[i], 0, sizeof(counters.backends[i]));
+        counters.backends[i].backend = backend; // Keep the slot assignment
+        if (backend) {
+            backend->lockDomain().resetLockCounters();
+        }
+    }
+    memset(&counters.sdProbe, 0, sizeof(counters.sdProbe));
+    LockDomain::spi().resetLockCounters();
+#endif
+}
@@ -0,0 +1,316 @@
+#include <lofs/AtomicWriter.h>
+#include <lofs/Backend.h>
+#include <lofs/LockDomain.h>
+#include <lofs/DirIterator.h>
+#include "configuration.h"
+#include <stdio.h>
+#include <string.h>
+
+// Directory levels below srcDir that sync() descends into
+#ifndef LOFS_SYNC_MAX_DEPTH
+#define LOFS_SYNC_MAX_DEPTH 8
+#endif
+
+// Files are copied under this suffix and renamed into place when complete
+#define LOFS_SYNC_TMP_SUFFIX ".lofs-sync"
+
+// File::getLastWrite() is not available on every core
+#if defined(ARCH_ESP32) || defined(ARCH_PORTDUINO) || defined(ARCH_RP2040)
+#define LOFS_SYNC_MTIME 1
+#else
+#define LOFS_SYNC_MTIME 0
+#endif
+
+struct FileMeta {
+    bool exists;
+    bool isDir;
+    uint64_t size;
+    time_t modified; ///< 0 where the core has no mtime
+};
+
+static FileMeta statFile(const char *path, LoFS::LockDomain &domain)
+{
+    FileMeta meta = {false, false, 0, 0};
+    if (!LoFS::exists(path)) {
+        return meta;
+    }
+    File f = LoFS::open(path, "r");
+    if (!f) {
+        return meta;
+    }
+    LoFS::LockDomain::SharedGuard g(domain);
+    meta.exists = true;
+    meta.isDir = f.isDirectory();
+    if (!meta.isDir) {
+        meta.size = f.size();
+#if LOFS_SYNC_MTIME
+        meta.modified = f.getLastWrite();
+#endif
+    }
+    f.close();
+    return meta;
+}
+
+static bool sameContents(const char *a, const char *b)
+{
+    uint32_t crcA, crcB;
+    return LoFS::checksum(a, &crcA) && LoFS::checksum(b, &crcB) && crcA == crcB;
+}
+
+// Rename a complete temp file over the target
+static bool replaceFile(const char *tmpPath, const char *path)
+{
+    if (LoFS::rename(tmpPath, path)) {
+        return true;
+    }
+    // FAT refuses to rename over an existing file: go through AtomicWriter's
+    // ".lofs-new" name, which recoverAtomic() completes after a power loss
+    char newPath[LOFS_PATH_MAX];
+    if (snprintf(newPath, sizeof(newPath), "%s" LOFS_ATOMIC_NEW_SUFFIX, path) >= (int)sizeof(newPath) ||
+        !LoFS::rename(tmpPath, newPath)) {
+        return false;
+    }
+    LoFS::remove(path);
+    return LoFS::rename(newPath, path);
+}
+
+static bool syncFile(const char *src, LoFS::LockDomain &srcDomain, const char *dst, LoFS::LockDomain &dstDomain,
+                     const LoFS::SyncOptions &options, LoFS::SyncStats *stats)
+{
+    FileMeta from = statFile(src, srcDomain);
+    if (!from.exists) {
+        return false;
+    }
+    FileMeta to = statFile(dst, dstDomain);
+    if (to.isDir && !LoFS::rmdir(dst, true)) {
+        return false; // A directory where the source has a file
+    }
+
+    if (to.exists && !to.isDir && to.size == from.size) {
+        bool same;
+        if (options.compare == LoFS::SyncCompare::CHECKSUM) {
+            same = sameContents(src, dst);
+        } else {
+            same = (from.modified <= to.modified); // Size only where there is no mtime (both 0)
+        }
+        if (same) {
+            stats->filesSkipped++;
+            stats->bytesSkipped += from.size;
+            return true;
+        }
+    }
+
+    char tmpPath[LOFS_PATH_MAX];
+    if (strlen(dst) + sizeof(LOFS_SYNC_TMP_SUFFIX) > sizeof(tmpPath)) {
+        return false;
+    }
+    snprintf(tmpPath, sizeof(tmpPath), "%s" LOFS_SYNC_TMP_SUFFIX, dst);
+
+    // A temp file left by an interrupted run is only a valid prefix if the
+    // source has not changed since it was written (or is verified afterwards)
+    FileMeta partial = statFile(tmpPath, dstDomain);
+    if (partial.isDir && !LoFS::rmdir(tmpPath, true)) {
+        return false;
+    }
+    bool verify = (options.compare == LoFS::SyncCompare::CHECKSUM);
+    LoFS::CopyOptions copyOptions = options.copy;
+    copyOptions.resume = partial.exists && !partial.isDir && partial.size <= from.size &&
+                         (verify || (from.modified != 0 && from.modified <= partial.modified));
+    copyOptions.verify = copyOptions.verify || verify;
+
+    LoFS::CopyStats copyStats;
+    bool result = LoFS::copy(src, tmpPath, copyOptions, &copyStats);
+    stats->bytesCopied += copyStats.bytesCopied;
+    if (!result && copyOptions.resume && verify && !LoFS::exists(tmpPath)) {
+        // Verification removed a stale prefix: start over
+        copyOptions.resume = false;
+        result = LoFS::copy(src, tmpPath, copyOptions, &copyStats);
+        stats->bytesCopied += copyStats.bytesCopied;
+    }
+    if (!result || !replaceFile(tmpPath, dst)) {
+        return false;
+    }
+    stats->filesCopied++;
+    return true;
+}
+
+// Append "/name" (or "name" after a trailing '/') to path; false if it does not fit
+static bool appendName(char *path, size_t len, const char *name)
+{
+    bool needsSlash = (len > 0 && path[len - 1] != '/');
+    size_t nameLen = strlen(name);
+    if (len + needsSlash + nameLen + 1 > LOFS_PATH_MAX) {
+        return false;
+    }
+    if (needsSlash) {
+        path[len] = '/';
+    }
+    memcpy(path + len + needsSlash, name, nameLen + 1);
+    return true;
+}
+
+// Remove entries of dst that src does not have; both paths are restored on return
+static void pruneDir(char *src, char *dst, LoFS::SyncStats *stats)
+{
+    size_t srcLen = strlen(src);
+    size_t dstLen = strlen(dst);
+    uint16_t kept = 0; // Entries at the start of the listing that stay
+
+    while (true) {
+        bool found = false;
+        bool isDir = false;
+        {
+            LoFS::DirIterator it(dst);
+            uint16_t index = 0;
+            while (it.next()) {
+                if (index++ < kept) {
+                    continue;
+                }
+                if (!appendName(src, srcLen, it.name()) || !appendName(dst, dstLen, it.name()) ||
+                    LoFS::exists(src)) {
+                    kept++;
+                    src[srcLen] = '\0';
+                    dst[dstLen] = '\0';
+                    continue;
+                }
+                found = true;
+                isDir = it.isDirectory();
+                break;
+            }
+        }
+        if (!found) {
+            return;
+        }
+
+        // Nothing is open in dst while the entry goes
+        if (isDir ? LoFS::rmdir(dst, true) : LoFS::remove(dst)) {
+            stats->filesDeleted++;
+        } else {
+            stats->errors++;
+            kept++;
+        }
+        src[srcLen] = '\0';
+        dst[dstLen] = '\0';
+    }
+}
+
+// Make dst a directory, replacing a file of the same name
+static bool ensureDir(const char *dst, LoFS::LockDomain &domain)
+{
+    FileMeta meta = statFile(dst, domain);
+    if (meta.isDir) {
+        return true;
+    }
+    if (meta.exists && !LoFS::remove(dst)) {
+        return false;
+    }
+    return LoFS::mkdir(dst);
+}
+
+bool LoFS::sync(const char *srcDir, const char *dstDir, const SyncOptions &options, SyncStats *stats)
+{
+    uint32_t startMs = millis();
+    SyncStats local;
+    if (!stats) {
+        stats = &local;
+    }
+    *stats = SyncStats();
+
+    if (!srcDir || !dstDir || strlen(srcDir) >= LOFS_PATH_MAX || strlen(dstDir) >= LOFS_PATH_MAX) {
+        return false;
+    }
+
+    // A destination inside the source would be walked while it grows
+    char srcStripped[LOFS_PATH_MAX];
+    char dstStripped[LOFS_PATH_MAX];
+    Backend *srcBackend = resolve(srcDir, srcStripped, sizeof(srcStripped));
+    Backend *dstBackend = resolve(dstDir, dstStripped, sizeof(dstStripped));
+    if (!srcBackend || !dstBackend) {
+        return false;
+    }
+    size_t srcStrippedLen = strlen(srcStripped);
+    while (srcStrippedLen > 0 && srcStripped[srcStrippedLen - 1] == '/') {
+        srcStrippedLen--;
+    }
+    if (srcBackend == dstBackend && strncmp(srcStripped, dstStripped, srcStrippedLen) == 0 &&
+        (dstStripped[srcStrippedLen] == '\0' || dstStripped[srcStrippedLen] == '/')) {
+        return false;
+    }
+
+    LockDomain &srcDomain = srcBackend->lockDomain();
+    LockDomain &dstDomain = dstBackend->lockDomain();
+
+    char src[LOFS_PATH_MAX];
+    char dst[LOFS_PATH_MAX];
+    strcpy(src, srcDir);
+    strcpy(dst, dstDir);
+    if (!statFile(src, srcDomain).isDir || !ensureDir(dst, dstDomain)) {
+        return false;
+    }
+
+    // Depth-first like removeTree(): one source directory open at a time,
+    // re-opened on the way back up and fast-forwarded past the entries done
+    uint16_t skip[LOFS_SYNC_MAX_DEPTH + 1];
+    size_t srcLens[LOFS_SYNC_MAX_DEPTH + 1];
+    size_t dstLens[LOFS_SYNC_MAX_DEPTH + 1];
+    size_t depth = 0;
+    skip[0] = 0;
+    srcLens[0] = strlen(src);
+    dstLens[0] = strlen(dst);
+
+    while (true) {
+        size_t srcLen = srcLens[depth];
+        size_t dstLen = dstLens[depth];
+        bool descended = false;
+        {
+            DirIterator it(src);
+            uint16_t index = 0;
+            while (it.next()) {
+                if (index++ < skip[depth]) {
+                    continue;
+                }
+                skip[depth]++;
+                if (!appendName(src, srcLen, it.name()) || !appendName(dst, dstLen, it.name())) {
+                    stats->errors++; // Too long to address
+                    src[srcLen] = '\0';
+                    dst[dstLen] = '\0';
+                    continue;
+                }
+
+                if (it.isDirectory()) {
+                    if (depth < LOFS_SYNC_MAX_DEPTH && ensureDir(dst, dstDomain)) {
+                        descended = true;
+                        break;
+                    }
+                    stats->errors++;
+                } else if (!syncFile(src, srcDomain, dst, dstDomain, options, stats)) {
+                    stats->errors++;
+                }
+                src[srcLen] = '\0';
+                dst[dstLen] = '\0';
+            }
+        }
+
+        if (descended) {
+            depth++;
+            skip[depth] = 0;
+            srcLens[depth] = strlen(src);
+            dstLens[depth] = strlen(dst);
+            continue;
+        }
+
+        if (options.deleteExtraneous) {
+            pruneDir(src, dst, stats);
+        }
+        if (depth == 0) {
+            break;
+        }
+        // Back up to the parent
+        depth--;
+        src[srcLens[depth]] = '\0';
+        dst[dstLens[depth]] = '\0';
+    }
+
+    stats->elapsedMs = millis() - startMs;
+    return stats->errors == 0;
+}
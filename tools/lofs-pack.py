@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Build a LoFS asset bundle (read by LoFS::Bundle, see include/lofs/Bundle.h).
+
+Packs every file below a directory into one bundle. Names are the paths
+relative to that directory, with '/' separators.
+
+    lofs-pack.py data/assets -o data/assets.lfb        # bundle file to upload
+    lofs-pack.py data/assets --c-array kAssets -o assets.h  # linked into the firmware
+    lofs-pack.py --list data/assets.lfb                 # show a bundle's index
+
+Format (little-endian):
+    header   "LoFB", version (1), 3 reserved bytes, entry count (u32), name table size (u32)
+    entries  name offset, data offset, size, CRC32 (4 x u32), sorted by name byte-wise
+    names    NUL-terminated
+    data     each asset 4-byte aligned
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b"LoFB"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xII")
+ENTRY = struct.Struct("<IIII")
+ALIGN = 4
+
+
+def collect(root):
+    assets = []
+    for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
+        for filename in filenames:
+            path = os.path.join(dirpath, filename)
+            name = os.path.relpath(path, root).replace(os.sep, "/").encode("utf-8")
+            with open(path, "rb") as f:
+                assets.append((name, f.read()))
+    # LoFS::Bundle binary-searches with strcmp(), i.e. unsigned byte order
+    assets.sort(key=lambda asset: asset[0])
+    return assets
+
+
+def pack(assets):
+    names = bytearray()
+    name_offsets = []
+    for name, _ in assets:
+        if b"\0" in name:
+            raise ValueError("NUL in asset name %r" % name)
+        name_offsets.append(len(names))
+        names += name + b"\0"
+
+    offset = HEADER.size + ENTRY.size * len(assets) + len(names)
+    entries = bytearray()
+    data = bytearray()
+    for (name, blob), name_offset in zip(assets, name_offsets):
+        pad = -(offset + len(data)) % ALIGN
+        data += b"\0" * pad
+        entries += ENTRY.pack(name_offset, offset + len(data), len(blob), zlib.crc32(blob) & 0xFFFFFFFF)
+        data += blob
+
+    return HEADER.pack(MAGIC, VERSION, len(assets), len(names)) + bytes(entries) + bytes(names) + bytes(data)
+
+
+def c_array(bundle, symbol):
+    lines = [
+        "// Generated by lofs-pack.py; use with LoFS::Bundle::begin(%s, sizeof(%s))" % (symbol, symbol),
+        "#pragma once",
+        "#include <stdint.h>",
+        "",
+        "alignas(4) static const uint8_t %s[] = {" % symbol,
+    ]
+    for i in range(0, len(bundle), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in bundle[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def list_bundle(path):
+    with open(path, "rb") as f:
+        bundle = f.read()
+    magic, version, count, names_size = HEADER.unpack_from(bundle)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("%s: not a version %d LoFS bundle" % (path, VERSION))
+    names_at = HEADER.size + ENTRY.size * count
+    for i in range(count):
+        name_offset, offset, size, crc = ENTRY.unpack_from(bundle, HEADER.size + ENTRY.size * i)
+        name = bundle[names_at + name_offset:bundle.index(b"\0", names_at + name_offset)].decode("utf-8")
+        print("%8d  %08x  %s" % (size, crc, name))
+    print("%d assets, %d bytes" % (count, len(bundle)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a LoFS asset bundle")
+    parser.add_argument("source", help="directory to pack, or bundle file with --list")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    parser.add_argument("--c-array", metavar="SYMBOL", help="write a C header defining SYMBOL instead of binary")
+    parser.add_argument("--list", action="store_true", help="print the index of an existing bundle")
+    args = parser.parse_args()
+
+    if args.list:
+        list_bundle(args.source)
+        return 0
+
+    if not os.path.isdir(args.source):
+        parser.error("%s is not a directory" % args.source)
+    bundle = pack(collect(args.source))
+    output = c_array(bundle, args.c_array).encode("ascii") if args.c_array else bundle
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(output)
+    else:
+        sys.stdout.buffer.write(output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())